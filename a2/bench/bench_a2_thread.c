@@ -0,0 +1,591 @@
+/**
+ * @file Microbenchmarks of the thread library's context switches and
+ * primitives, next to pthread and raw ucontext baselines doing the same work.
+ *
+ * Each benchmark is run as a number of samples of many operations each, after
+ * one warm-up sample, and reports the median, 99th percentile and minimum time
+ * per operation over the samples. The whole process is pinned to one CPU, so
+ * that the pthread baselines measure kernel context switches rather than
+ * cross-CPU wakeups.
+ *
+ * Usage: bench_a2_thread [-s samples] [-n iterations] [-c | -j]
+ *   -c prints CSV, -j prints one JSON object per line, instead of a table.
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "csc369_interrupts.h"
+#include "csc369_thread.h"
+
+// Number of threads woken together by the fan-out benchmarks
+#define FAN_OUT 64
+// Time, in nanoseconds, that each thread computes for in the preemption
+// benchmark, so that it is interrupted several times
+#define PREEMPT_WORK_NSEC 4000000
+
+typedef enum
+{
+  OUTPUT_TABLE,
+  OUTPUT_CSV,
+  OUTPUT_JSON
+} Output;
+
+Output output = OUTPUT_TABLE;
+int samples_num = 31;
+long iters = 10000;
+
+// Set to stop the threads of a benchmark
+volatile int stop;
+
+//****************************************************************************
+// Measurement
+//****************************************************************************
+long long
+now_nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int
+compare_double(void const* a, void const* b)
+{
+  double const x = *(double const*)a;
+  double const y = *(double const*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Print the statistics of ns, the time per operation of each sample, for the
+ * implementation impl of the benchmark bench. Sorts ns.
+ */
+void
+report(char const* bench, char const* impl, double* ns, int n)
+{
+  qsort(ns, n, sizeof(double), compare_double);
+  double const median = ns[n / 2];
+  double const p99 = ns[(99 * n + 99) / 100 - 1];
+  double const min = ns[0];
+
+  switch (output) {
+    case OUTPUT_TABLE:
+      printf("%-16s %-8s %12.1f %12.1f %12.1f\n", bench, impl, median, p99, min);
+      break;
+    case OUTPUT_CSV:
+      printf("%s,%s,%d,%ld,%.1f,%.1f,%.1f\n",
+             bench,
+             impl,
+             n,
+             iters,
+             median,
+             p99,
+             min);
+      break;
+    case OUTPUT_JSON:
+      printf("{\"bench\": \"%s\", \"impl\": \"%s\", \"samples\": %d, "
+             "\"iters\": %ld, \"median_ns\": %.1f, \"p99_ns\": %.1f, "
+             "\"min_ns\": %.1f}\n",
+             bench,
+             impl,
+             n,
+             iters,
+             median,
+             p99,
+             min);
+      break;
+  }
+  fflush(stdout);
+}
+
+/**
+ * Run sample(iters) once to warm up, then once per sample, and report the
+ * times per operation that it returns.
+ */
+void
+run(char const* bench, char const* impl, double (*sample)(long))
+{
+  double ns[samples_num];
+  sample(iters);
+  for (int i = 0; i < samples_num; i++)
+    ns[i] = sample(iters);
+  report(bench, impl, ns, samples_num);
+}
+
+//****************************************************************************
+// Yield round-trip: two threads yield to each other, each operation is one
+// switch there and one back
+//****************************************************************************
+void
+f_yield_partner(void* arg)
+{
+  (void)arg;
+  while (!stop)
+    CSC369_ThreadYield();
+}
+
+double
+sample_yield(long n)
+{
+  stop = 0;
+  Tid const tid = CSC369_ThreadCreate(f_yield_partner, NULL);
+  CSC369_ThreadYield();
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++)
+    CSC369_ThreadYield();
+  long long const end = now_nsec();
+  stop = 1;
+  int exit_code;
+  CSC369_ThreadJoin(tid, &exit_code);
+  return (double)(end - start) / n;
+}
+
+void*
+f_yield_partner_pthread(void* arg)
+{
+  (void)arg;
+  while (!stop)
+    sched_yield();
+  return NULL;
+}
+
+double
+sample_yield_pthread(long n)
+{
+  stop = 0;
+  pthread_t thread;
+  pthread_create(&thread, NULL, f_yield_partner_pthread, NULL);
+  sched_yield();
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++)
+    sched_yield();
+  long long const end = now_nsec();
+  stop = 1;
+  pthread_join(thread, NULL);
+  return (double)(end - start) / n;
+}
+
+ucontext_t main_context;
+ucontext_t partner_context;
+
+void
+f_yield_partner_ucontext(void)
+{
+  while (1)
+    swapcontext(&partner_context, &main_context);
+}
+
+double
+sample_yield_ucontext(long n)
+{
+  static char stack[CSC369_THREAD_STACK_SIZE];
+  getcontext(&partner_context);
+  partner_context.uc_stack.ss_sp = stack;
+  partner_context.uc_stack.ss_size = sizeof(stack);
+  partner_context.uc_link = NULL;
+  makecontext(&partner_context, f_yield_partner_ucontext, 0);
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++)
+    swapcontext(&main_context, &partner_context);
+  return (double)(now_nsec() - start) / n;
+}
+
+//****************************************************************************
+// Create and join: each operation creates a thread that returns immediately,
+// and waits for it
+//****************************************************************************
+void
+f_nothing(void* arg)
+{
+  (void)arg;
+}
+
+double
+sample_create_join(long n)
+{
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++) {
+    int exit_code;
+    CSC369_ThreadJoin(CSC369_ThreadCreate(f_nothing, NULL), &exit_code);
+  }
+  return (double)(now_nsec() - start) / n;
+}
+
+void*
+f_nothing_pthread(void* arg)
+{
+  return arg;
+}
+
+double
+sample_create_join_pthread(long n)
+{
+  // pthread_create is far slower, keep the sample to a similar duration
+  n /= 10;
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, f_nothing_pthread, NULL);
+    pthread_join(thread, NULL);
+  }
+  return (double)(now_nsec() - start) / n;
+}
+
+double
+sample_create_join_ucontext(long n)
+{
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++) {
+    ucontext_t context;
+    void* stack = malloc(CSC369_THREAD_STACK_SIZE);
+    getcontext(&context);
+    context.uc_stack.ss_sp = stack;
+    context.uc_stack.ss_size = CSC369_THREAD_STACK_SIZE;
+    context.uc_link = &main_context;
+    makecontext(&context, (void (*)(void))f_nothing, 1, NULL);
+    swapcontext(&main_context, &context);
+    free(stack);
+  }
+  return (double)(now_nsec() - start) / n;
+}
+
+//****************************************************************************
+// Sleep/wake ping-pong: two threads take turns waking each other up and
+// sleeping, each operation is one turn of both
+//****************************************************************************
+CSC369_WaitQueue* ping_queue;
+CSC369_WaitQueue* pong_queue;
+
+void
+f_pong(void* arg)
+{
+  (void)arg;
+  CSC369_InterruptsDisable();
+  CSC369_ThreadSleep(pong_queue);
+  while (!stop) {
+    CSC369_ThreadWakeNext(ping_queue);
+    CSC369_ThreadSleep(pong_queue);
+  }
+}
+
+double
+sample_ping_pong(long n)
+{
+  stop = 0;
+  Tid const tid = CSC369_ThreadCreate(f_pong, NULL);
+  int const prev_state = CSC369_InterruptsDisable();
+  CSC369_ThreadYield();
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++) {
+    CSC369_ThreadWakeNext(pong_queue);
+    CSC369_ThreadSleep(ping_queue);
+  }
+  long long const end = now_nsec();
+  stop = 1;
+  CSC369_ThreadWakeNext(pong_queue);
+  CSC369_InterruptsSet(prev_state);
+  int exit_code;
+  CSC369_ThreadJoin(tid, &exit_code);
+  return (double)(end - start) / n;
+}
+
+sem_t ping_sem;
+sem_t pong_sem;
+
+void*
+f_pong_pthread(void* arg)
+{
+  (void)arg;
+  sem_wait(&pong_sem);
+  while (!stop) {
+    sem_post(&ping_sem);
+    sem_wait(&pong_sem);
+  }
+  return NULL;
+}
+
+double
+sample_ping_pong_pthread(long n)
+{
+  stop = 0;
+  pthread_t thread;
+  pthread_create(&thread, NULL, f_pong_pthread, NULL);
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++) {
+    sem_post(&pong_sem);
+    sem_wait(&ping_sem);
+  }
+  long long const end = now_nsec();
+  stop = 1;
+  sem_post(&pong_sem);
+  pthread_join(thread, NULL);
+  return (double)(end - start) / n;
+}
+
+//****************************************************************************
+// Fan-out: FAN_OUT threads sleep on one queue, each operation wakes all of
+// them and waits until the last one has run
+//****************************************************************************
+CSC369_WaitQueue* fan_queue;
+CSC369_WaitQueue* fan_done_queue;
+int fan_asleep;
+int fan_woken;
+
+void
+f_fan(void* arg)
+{
+  (void)arg;
+  CSC369_InterruptsDisable();
+  fan_asleep++;
+  CSC369_ThreadSleep(fan_queue);
+  while (!stop) {
+    if (++fan_woken == FAN_OUT)
+      CSC369_ThreadWakeNext(fan_done_queue);
+    CSC369_ThreadSleep(fan_queue);
+  }
+}
+
+double
+sample_wake_all(long n)
+{
+  // Each operation runs every thread, keep the sample to a similar duration
+  n /= FAN_OUT;
+  stop = 0;
+  fan_asleep = 0;
+  Tid tids[FAN_OUT];
+  for (int i = 0; i < FAN_OUT; i++)
+    tids[i] = CSC369_ThreadCreate(f_fan, NULL);
+  int const prev_state = CSC369_InterruptsDisable();
+  while (fan_asleep < FAN_OUT)
+    CSC369_ThreadYield();
+
+  long long const start = now_nsec();
+  for (long i = 0; i < n; i++) {
+    fan_woken = 0;
+    CSC369_ThreadWakeAll(fan_queue);
+    CSC369_ThreadSleep(fan_done_queue);
+  }
+  long long const end = now_nsec();
+  stop = 1;
+  CSC369_ThreadWakeAll(fan_queue);
+  CSC369_InterruptsSet(prev_state);
+  int exit_codes[FAN_OUT];
+  CSC369_ThreadJoinAll(tids, FAN_OUT, exit_codes);
+  return (double)(end - start) / n;
+}
+
+pthread_mutex_t fan_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t fan_cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t fan_done_cond = PTHREAD_COND_INITIALIZER;
+long fan_generation;
+
+void*
+f_fan_pthread(void* arg)
+{
+  // The generation when the thread was created, which may have passed since
+  long generation = (long)arg;
+  pthread_mutex_lock(&fan_mutex);
+  while (1) {
+    while (generation == fan_generation)
+      pthread_cond_wait(&fan_cond, &fan_mutex);
+    generation = fan_generation;
+    if (stop)
+      break;
+    if (++fan_woken == FAN_OUT)
+      pthread_cond_signal(&fan_done_cond);
+  }
+  pthread_mutex_unlock(&fan_mutex);
+  return NULL;
+}
+
+double
+sample_wake_all_pthread(long n)
+{
+  n /= FAN_OUT;
+  stop = 0;
+  pthread_t threads[FAN_OUT];
+  for (int i = 0; i < FAN_OUT; i++)
+    pthread_create(&threads[i], NULL, f_fan_pthread, (void*)fan_generation);
+
+  long long const start = now_nsec();
+  pthread_mutex_lock(&fan_mutex);
+  for (long i = 0; i < n; i++) {
+    fan_woken = 0;
+    fan_generation++;
+    pthread_cond_broadcast(&fan_cond);
+    while (fan_woken < FAN_OUT)
+      pthread_cond_wait(&fan_done_cond, &fan_mutex);
+  }
+  long long const end = now_nsec();
+  stop = 1;
+  fan_generation++;
+  pthread_cond_broadcast(&fan_cond);
+  pthread_mutex_unlock(&fan_mutex);
+  for (int i = 0; i < FAN_OUT; i++)
+    pthread_join(threads[i], NULL);
+  return (double)(end - start) / n;
+}
+
+//****************************************************************************
+// Preemption tick: two threads compute for a fixed amount of work, with and
+// without interrupts, and the difference is spread over the ticks that
+// preempted them
+//****************************************************************************
+volatile unsigned long sink;
+long work_units;
+long ticks;
+int preempt_disabled;
+
+void
+compute(long units)
+{
+  unsigned long x = sink;
+  for (long i = 0; i < units; i++)
+    x = x * 6364136223846793005UL + 1442695040888963407UL;
+  sink = x;
+}
+
+void
+f_compute(void* arg)
+{
+  (void)arg;
+  int const prev_state =
+    preempt_disabled ? CSC369_InterruptsDisable() : CSC369_InterruptsEnable();
+  compute(work_units);
+  CSC369_InterruptsSet(prev_state);
+
+  CSC369_ThreadStats stats;
+  CSC369_ThreadGetStats(CSC369_ThreadId(), &stats);
+  ticks += stats.preempted_switches;
+}
+
+long long
+time_compute(int disabled)
+{
+  preempt_disabled = disabled;
+  ticks = 0;
+  long long const start = now_nsec();
+  Tid const tids[2] = { CSC369_ThreadCreate(f_compute, NULL),
+                        CSC369_ThreadCreate(f_compute, NULL) };
+  int exit_codes[2];
+  CSC369_ThreadJoinAll(tids, 2, exit_codes);
+  return now_nsec() - start;
+}
+
+void
+run_preempt(void)
+{
+  // Find how much work takes PREEMPT_WORK_NSEC
+  int const prev_state = CSC369_InterruptsDisable();
+  long long const start = now_nsec();
+  compute(1 << 22);
+  work_units = (1LL << 22) * PREEMPT_WORK_NSEC / (now_nsec() - start + 1);
+  CSC369_InterruptsSet(prev_state);
+
+  double baseline[samples_num];
+  double ns[samples_num];
+  int n = 0;
+  time_compute(1);
+  for (int i = 0; i < samples_num; i++)
+    baseline[i] = (double)time_compute(1);
+  qsort(baseline, samples_num, sizeof(double), compare_double);
+  time_compute(0);
+  for (int i = 0; i < samples_num; i++) {
+    double const elapsed = (double)time_compute(0);
+    if (ticks > 0)
+      ns[n++] = (elapsed - baseline[samples_num / 2]) / ticks;
+  }
+  if (n > 0)
+    report("preempt_tick", "csc369", ns, n);
+}
+
+//****************************************************************************
+// Main
+//****************************************************************************
+void
+pin_to_one_cpu(void)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  sched_getaffinity(0, sizeof(set), &set);
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set)) {
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      sched_setaffinity(0, sizeof(set), &set);
+      return;
+    }
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "s:n:cj")) != -1) {
+    switch (opt) {
+      case 's':
+        samples_num = atoi(optarg);
+        break;
+      case 'n':
+        iters = atol(optarg);
+        break;
+      case 'c':
+        output = OUTPUT_CSV;
+        break;
+      case 'j':
+        output = OUTPUT_JSON;
+        break;
+      default:
+        fprintf(stderr,
+                "usage: %s [-s samples] [-n iterations] [-c | -j]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (samples_num < 1 || iters < 100) {
+    fprintf(stderr, "need at least 1 sample and 100 iterations\n");
+    return 1;
+  }
+
+  pin_to_one_cpu();
+  CSC369_ThreadInit();
+  ping_queue = CSC369_WaitQueueCreate();
+  pong_queue = CSC369_WaitQueueCreate();
+  fan_queue = CSC369_WaitQueueCreate();
+  fan_done_queue = CSC369_WaitQueueCreate();
+  sem_init(&ping_sem, 0, 0);
+  sem_init(&pong_sem, 0, 0);
+
+  if (output == OUTPUT_TABLE)
+    printf("%-16s %-8s %12s %12s %12s\n",
+           "bench",
+           "impl",
+           "median_ns",
+           "p99_ns",
+           "min_ns");
+  else if (output == OUTPUT_CSV)
+    printf("bench,impl,samples,iters,median_ns,p99_ns,min_ns\n");
+
+  // Without interrupts, so that no tick lands in the measurements
+  run("yield", "csc369", sample_yield);
+  run("yield", "pthread", sample_yield_pthread);
+  run("yield", "ucontext", sample_yield_ucontext);
+  run("create_join", "csc369", sample_create_join);
+  run("create_join", "pthread", sample_create_join_pthread);
+  run("create_join", "ucontext", sample_create_join_ucontext);
+  run("ping_pong", "csc369", sample_ping_pong);
+  run("ping_pong", "pthread", sample_ping_pong_pthread);
+  run("wake_all_64", "csc369", sample_wake_all);
+  run("wake_all_64", "pthread", sample_wake_all_pthread);
+
+  CSC369_InterruptsInit();
+  CSC369_InterruptsSetLogLevel(CSC369_INTERRUPTS_QUIET);
+  run_preempt();
+  return 0;
+}
@@ -7,6 +7,7 @@
 #include <sys/time.h>
 
 #include "csc369_interrupts.h"
+#include "csc369_sync.h"
 #include "csc369_thread.h"
 
 // Number of threads to create
@@ -17,7 +18,7 @@
 // Each thread tracks whether it has the hot potato
 int thread_storage[THREAD_COUNT];
 // One lock for the thread_storage array
-int lock = 0;
+CSC369_Mutex lock;
 // The original start time
 struct timeval start_time;
 
@@ -42,8 +43,8 @@ pass_hot_potato_randomly(int this_index)
   double const rand = ((double)random()) / RAND_MAX;
   int const next_index = (int)(rand * THREAD_COUNT - 1);
 
-  int err = __sync_bool_compare_and_swap(&lock, 0, 1);
-  if (err == 0) {
+  // Sleep until the lock is free, instead of spinning on it
+  if (CSC369_MutexLock(&lock) != 0) {
     return 0; // Could not acquire the lock, try again later
   }
 
@@ -55,8 +56,9 @@ pass_hot_potato_randomly(int this_index)
     report_pass(this_index, next_index);
   }
 
-  err = __sync_bool_compare_and_swap(&lock, 1, 0);
-  assert(err); // We should definitely be able to release the lock
+  int const err = CSC369_MutexUnlock(&lock);
+  assert(!err); // We should definitely be able to release the lock
+  (void)err;
 
   return 1;
 }
@@ -68,8 +70,8 @@ pass_hot_potato(int this_index)
 
   int const next_index = (this_index + 1) % THREAD_COUNT;
 
-  int err = __sync_bool_compare_and_swap(&lock, 0, 1);
-  if (!err) {
+  // Sleep until the lock is free, instead of spinning on it
+  if (CSC369_MutexLock(&lock) != 0) {
     return 0; // Could not acquire the lock, try again later
   }
 
@@ -79,8 +81,9 @@ pass_hot_potato(int this_index)
     report_pass(this_index, next_index);
   }
 
-  err = __sync_bool_compare_and_swap(&lock, 1, 0);
-  assert(err); // We should definitely be able to release the lock
+  int const err = CSC369_MutexUnlock(&lock);
+  assert(!err); // We should definitely be able to release the lock
+  (void)err;
 
   return 1;
 }
@@ -108,6 +111,7 @@ void
 run_hot_potato()
 {
   srandom(369);
+  CSC369_MutexInit(&lock);
 
   CSC369_InterruptsPrintf("Starting hot potato.\n");
   gettimeofday(&start_time, NULL);
@@ -0,0 +1,519 @@
+#include "csc369_chan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "csc369_interrupts.h"
+
+#ifdef NDEBUG
+#define assert(x) do { (void)sizeof(x);} while (0)
+#else
+#include <assert.h>
+#endif
+
+//****************************************************************************
+// Private Definitions
+//****************************************************************************
+struct chan_park_t;
+
+/**
+ * A case that a sleeping thread waits on a channel to complete.
+ */
+typedef struct chan_waiter_t
+{
+  struct chan_waiter_t* next;
+
+  struct chan_waiter_t* prev;
+
+  /**
+   * The list this waiter is on, or NULL.
+   */
+  struct chan_wait_list_t* list;
+
+  struct chan_park_t* park;
+
+  /**
+   * The element to send, or where to store the element received. It is on the
+   * stack of the sleeping thread, so it must not be touched unless the thread
+   * is known to still be sleeping.
+   */
+  void* elem;
+
+  /**
+   * The index of the case in the select.
+   */
+  int index;
+} ChanWaiter;
+
+typedef struct chan_wait_list_t
+{
+  ChanWaiter* head;
+  ChanWaiter* tail;
+} ChanWaitList;
+
+/**
+ * Where a thread sleeps while it waits on channels. A thread's park is created
+ * the first time it waits, and freed when it exits or is killed, which also
+ * takes its waiters off every channel.
+ */
+typedef struct chan_park_t
+{
+  /**
+   * Only the owner of the park ever sleeps on this queue.
+   */
+  CSC369_WaitQueue* queue;
+
+  /**
+   * A waiter for each case of the current select.
+   */
+  ChanWaiter* waiters;
+
+  int waiters_num;
+
+  int waiters_size;
+
+  /**
+   * The index of the case that completed, and its status.
+   */
+  int done;
+
+  int status;
+} ChanPark;
+
+struct csc369_chan_t
+{
+  size_t elem_size;
+
+  /**
+   * The most elements buffered, or CSC369_CHAN_UNBOUNDED.
+   */
+  int capacity;
+
+  /**
+   * The ring buffer of size slots, count of which are used starting at head.
+   */
+  char* buffer;
+
+  int size;
+
+  int head;
+
+  int count;
+
+  int closed;
+
+  ChanWaitList senders;
+
+  ChanWaitList receivers;
+};
+
+//****************************************************************************
+// Private Global Variables (Library State)
+//****************************************************************************
+/**
+ * The park of each thread identifier, or NULL if that thread never waited.
+ */
+ChanPark** chan_parks = NULL;
+
+int chan_parks_num = 0;
+
+/**
+ * Rotates the case that CSC369_ChanSelect tries first.
+ */
+unsigned int chan_select_start = 0;
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+void
+ChanWaitList_Append(ChanWaitList* list, ChanWaiter* waiter)
+{
+  assert(waiter->list == NULL);
+  waiter->prev = list->tail;
+  waiter->next = NULL;
+  if (list->tail == NULL)
+    list->head = waiter;
+  else
+    list->tail->next = waiter;
+  list->tail = waiter;
+  waiter->list = list;
+}
+
+void
+ChanWaitList_Unlink(ChanWaiter* waiter)
+{
+  ChanWaitList* list = waiter->list;
+  assert(list != NULL);
+  if (waiter->prev == NULL)
+    list->head = waiter->next;
+  else
+    waiter->prev->next = waiter->next;
+  if (waiter->next == NULL)
+    list->tail = waiter->prev;
+  else
+    waiter->next->prev = waiter->prev;
+  waiter->next = NULL;
+  waiter->prev = NULL;
+  waiter->list = NULL;
+}
+
+/**
+ * Take the park's waiters off every channel.
+ */
+void
+ChanPark_Unlink(ChanPark* park)
+{
+  for (int i = 0; i < park->waiters_num; i++) {
+    if (park->waiters[i].list != NULL)
+      ChanWaitList_Unlink(&park->waiters[i]);
+  }
+}
+
+/**
+ * @return the park of the calling thread, ready for a select of num cases, or
+ * NULL if there is no memory available.
+ */
+ChanPark*
+ChanPark_Get(int num)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  Tid const tid = CSC369_ThreadId();
+  if (tid >= chan_parks_num) {
+    int size = chan_parks_num > 0 ? chan_parks_num : 64;
+    while (size <= tid)
+      size *= 2;
+    ChanPark** parks = realloc(chan_parks, size * sizeof(ChanPark*));
+    if (parks == NULL)
+      return NULL;
+    for (int i = chan_parks_num; i < size; i++)
+      parks[i] = NULL;
+    chan_parks = parks;
+    chan_parks_num = size;
+  }
+
+  ChanPark* park = chan_parks[tid];
+  if (park == NULL) {
+    park = calloc(1, sizeof(ChanPark));
+    if (park == NULL)
+      return NULL;
+    park->queue = CSC369_WaitQueueCreate();
+    if (park->queue == NULL) {
+      free(park);
+      return NULL;
+    }
+    chan_parks[tid] = park;
+  }
+
+  // The waiters of the previous select were all taken off their channels
+  if (num > park->waiters_size) {
+    ChanWaiter* waiters = realloc(park->waiters, num * sizeof(ChanWaiter));
+    if (waiters == NULL)
+      return NULL;
+    park->waiters = waiters;
+    park->waiters_size = num;
+  }
+  park->waiters_num = num;
+  for (int i = 0; i < num; i++) {
+    park->waiters[i].list = NULL;
+    park->waiters[i].park = park;
+  }
+  park->done = -1;
+  return park;
+}
+
+/**
+ * Complete the case of waiter with status, and wake up its thread.
+ *
+ * @return 1 on success, 0 if the thread is no longer sleeping (it was killed),
+ * in which case its element must not be touched.
+ */
+int
+ChanWaiter_Complete(ChanWaiter* waiter, int status)
+{
+  ChanPark* park = waiter->park;
+  ChanPark_Unlink(park);
+  // The woken thread cannot run until interrupts are enabled again
+  if (!CSC369_ThreadWakeNext(park->queue))
+    return 0;
+  park->done = waiter->index;
+  park->status = status;
+  return 1;
+}
+
+/**
+ * @return the first waiter of list whose thread is still sleeping, having
+ * completed its case successfully, or NULL if there is none.
+ */
+ChanWaiter*
+ChanWaitList_Complete(ChanWaitList* list)
+{
+  while (list->head != NULL) {
+    ChanWaiter* waiter = list->head;
+    if (ChanWaiter_Complete(waiter, 0))
+      return waiter;
+  }
+  return NULL;
+}
+
+void
+ChanWaitList_CompleteAll(ChanWaitList* list, int status)
+{
+  while (list->head != NULL)
+    ChanWaiter_Complete(list->head, status);
+}
+
+void*
+Chan_Slot(CSC369_Chan* chan, int index)
+{
+  return chan->buffer + (size_t)((chan->head + index) % chan->size) * chan->elem_size;
+}
+
+/**
+ * Make room for one more element in an unbounded channel.
+ *
+ * @return 0 on success, -1 if there is no memory available.
+ */
+int
+Chan_Grow(CSC369_Chan* chan)
+{
+  int const size = chan->size * 2;
+  char* buffer = malloc((size_t)size * chan->elem_size + 1);
+  if (buffer == NULL)
+    return -1;
+  for (int i = 0; i < chan->count; i++)
+    memcpy(buffer + (size_t)i * chan->elem_size, Chan_Slot(chan, i), chan->elem_size);
+  free(chan->buffer);
+  chan->buffer = buffer;
+  chan->size = size;
+  chan->head = 0;
+  return 0;
+}
+
+/**
+ * Send elem if it can be done without sleeping.
+ *
+ * @return 0 on success, or the error CSC369_ChanTrySend would return.
+ */
+int
+Chan_TrySendLocked(CSC369_Chan* chan, void const* elem)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (chan->closed)
+    return CSC369_ERROR_CLOSED;
+
+  // Receivers only wait while the channel is empty
+  ChanWaiter* receiver = ChanWaitList_Complete(&chan->receivers);
+  if (receiver != NULL) {
+    memcpy(receiver->elem, elem, chan->elem_size);
+    return 0;
+  }
+
+  if (chan->count == chan->size) {
+    if (chan->capacity != CSC369_CHAN_UNBOUNDED)
+      return CSC369_ERROR_WOULD_BLOCK;
+    if (Chan_Grow(chan))
+      return CSC369_ERROR_SYS_MEM;
+  }
+  memcpy(Chan_Slot(chan, chan->count), elem, chan->elem_size);
+  chan->count++;
+  return 0;
+}
+
+/**
+ * Receive into elem if it can be done without sleeping.
+ *
+ * @return 0 on success, or the error CSC369_ChanTryRecv would return.
+ */
+int
+Chan_TryRecvLocked(CSC369_Chan* chan, void* elem)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (chan->count > 0) {
+    memcpy(elem, Chan_Slot(chan, 0), chan->elem_size);
+    chan->head = (chan->head + 1) % chan->size;
+    chan->count--;
+    // Senders only wait while the channel is full, so one can take the slot
+    ChanWaiter* sender = ChanWaitList_Complete(&chan->senders);
+    if (sender != NULL) {
+      memcpy(Chan_Slot(chan, chan->count), sender->elem, chan->elem_size);
+      chan->count++;
+    }
+    return 0;
+  }
+
+  // An unbuffered channel passes the element straight from the sender
+  ChanWaiter* sender = ChanWaitList_Complete(&chan->senders);
+  if (sender != NULL) {
+    memcpy(elem, sender->elem, chan->elem_size);
+    return 0;
+  }
+  return chan->closed ? CSC369_ERROR_CLOSED : CSC369_ERROR_WOULD_BLOCK;
+}
+
+/**
+ * Complete the case if it can be done without sleeping.
+ *
+ * @return 0 on success, or the error otherwise.
+ */
+int
+Chan_TryCaseLocked(CSC369_SelectCase* c)
+{
+  if (c->op == CSC369_SELECT_SEND)
+    return Chan_TrySendLocked(c->chan, c->elem);
+  return Chan_TryRecvLocked(c->chan, c->elem);
+}
+
+//****************************************************************************
+// chan.h Functions
+//****************************************************************************
+void
+Chan_ThreadExit(Tid tid)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (tid >= chan_parks_num || chan_parks[tid] == NULL)
+    return;
+  ChanPark* park = chan_parks[tid];
+  chan_parks[tid] = NULL;
+  ChanPark_Unlink(park);
+  // A killed thread was taken off the queue already
+  CSC369_WaitQueueDestroy(park->queue);
+  free(park->waiters);
+  free(park);
+}
+
+CSC369_Chan*
+CSC369_ChanCreate(int capacity, size_t elem_size)
+{
+  if (capacity < 0 && capacity != CSC369_CHAN_UNBOUNDED)
+    return NULL;
+  CSC369_Chan* chan = malloc(sizeof(CSC369_Chan));
+  if (chan == NULL)
+    return NULL;
+  chan->elem_size = elem_size;
+  chan->capacity = capacity;
+  chan->size = capacity == CSC369_CHAN_UNBOUNDED ? 16 : capacity;
+  chan->buffer = malloc((size_t)chan->size * elem_size + 1);
+  if (chan->buffer == NULL) {
+    free(chan);
+    return NULL;
+  }
+  chan->head = 0;
+  chan->count = 0;
+  chan->closed = 0;
+  chan->senders = (ChanWaitList){ NULL, NULL };
+  chan->receivers = (ChanWaitList){ NULL, NULL };
+  return chan;
+}
+
+int
+CSC369_ChanDestroy(CSC369_Chan* chan)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  if (chan->senders.head != NULL || chan->receivers.head != NULL) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_OTHER;
+  }
+  free(chan->buffer);
+  free(chan);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+int
+CSC369_ChanSend(CSC369_Chan* chan, void const* elem)
+{
+  CSC369_SelectCase c = { chan, CSC369_SELECT_SEND, (void*)elem, 0 };
+  int const ret = CSC369_ChanSelect(&c, 1, 1);
+  return ret < 0 ? ret : c.status;
+}
+
+int
+CSC369_ChanRecv(CSC369_Chan* chan, void* elem)
+{
+  CSC369_SelectCase c = { chan, CSC369_SELECT_RECV, elem, 0 };
+  int const ret = CSC369_ChanSelect(&c, 1, 1);
+  return ret < 0 ? ret : c.status;
+}
+
+int
+CSC369_ChanTrySend(CSC369_Chan* chan, void const* elem)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  int const ret = Chan_TrySendLocked(chan, elem);
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+int
+CSC369_ChanTryRecv(CSC369_Chan* chan, void* elem)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  int const ret = Chan_TryRecvLocked(chan, elem);
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+int
+CSC369_ChanClose(CSC369_Chan* chan)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  if (chan->closed) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_CLOSED;
+  }
+  chan->closed = 1;
+  ChanWaitList_CompleteAll(&chan->receivers, CSC369_ERROR_CLOSED);
+  ChanWaitList_CompleteAll(&chan->senders, CSC369_ERROR_CLOSED);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+int
+CSC369_ChanSelect(CSC369_SelectCase* cases, int num, int block)
+{
+  if (num <= 0)
+    return CSC369_ERROR_OTHER;
+
+  int prev_state = CSC369_InterruptsDisable();
+  unsigned int const start = num > 1 ? chan_select_start++ % num : 0;
+  for (int i = 0; i < num; i++) {
+    int const index = (start + i) % num;
+    int const ret = Chan_TryCaseLocked(&cases[index]);
+    if (ret == CSC369_ERROR_SYS_MEM) {
+      CSC369_InterruptsSet(prev_state);
+      return ret;
+    } else if (ret != CSC369_ERROR_WOULD_BLOCK) {
+      cases[index].status = ret;
+      CSC369_InterruptsSet(prev_state);
+      return index;
+    }
+  }
+  if (!block) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_WOULD_BLOCK;
+  }
+
+  // Wait on every channel until one of them completes a case for us
+  ChanPark* park = ChanPark_Get(num);
+  if (park == NULL) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_MEM;
+  }
+  for (int i = 0; i < num; i++) {
+    ChanWaiter* waiter = &park->waiters[i];
+    waiter->elem = cases[i].elem;
+    waiter->index = i;
+    ChanWaitList_Append(cases[i].op == CSC369_SELECT_SEND ? &cases[i].chan->senders
+                                                          : &cases[i].chan->receivers,
+                        waiter);
+  }
+  int ret = CSC369_ThreadSleep(park->queue);
+  if (ret < 0) {
+    ChanPark_Unlink(park);
+  } else {
+    ret = park->done;
+    cases[ret].status = park->status;
+  }
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
@@ -0,0 +1,160 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines channels, which pass fixed-size elements between threads.
+ *
+ * A channel buffers up to its capacity of elements in a ring buffer, or any
+ * number if it is unbounded. A thread that sends to a full channel (or receives
+ * from an empty one) sleeps until a receiver (or sender) arrives. A sender that
+ * finds a receiver waiting copies its element directly to the receiver, and a
+ * receiver that finds a sender waiting copies directly from the sender, so an
+ * element passed through an unbuffered channel is copied only once.
+ */
+#ifndef CSC369_CHAN_H
+#define CSC369_CHAN_H
+
+#include <stddef.h>
+
+#include "csc369_thread.h"
+
+/**
+ * The capacity of a channel that never fills up.
+ */
+#define CSC369_CHAN_UNBOUNDED (-1)
+
+typedef struct csc369_chan_t CSC369_Chan;
+
+typedef enum
+{
+  CSC369_SELECT_SEND = 0,
+  CSC369_SELECT_RECV = 1
+} CSC369_SelectOp;
+
+/**
+ * An operation that CSC369_ChanSelect may complete.
+ */
+typedef struct
+{
+  CSC369_Chan* chan;
+
+  CSC369_SelectOp op;
+
+  /**
+   * The element to send, or where to store the element received.
+   */
+  void* elem;
+
+  /**
+   * Set when this case completes: 0 if the element was passed, or
+   * CSC369_ERROR_CLOSED if the channel was closed.
+   */
+  int status;
+} CSC369_SelectCase;
+
+/**
+ * Create a channel of elements of elem_size bytes.
+ *
+ * @param capacity How many elements the channel buffers: 0 for an unbuffered
+ * channel, where each send waits for a receiver, or CSC369_CHAN_UNBOUNDED.
+ *
+ * @return the channel, or NULL if there is no memory available or capacity is
+ * invalid.
+ */
+CSC369_Chan*
+CSC369_ChanCreate(int capacity, size_t elem_size);
+
+/**
+ * Free the channel and the elements it buffers.
+ *
+ * This function may fail if:
+ *  - threads are waiting on the channel (CSC369_ERROR_OTHER)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ChanDestroy(CSC369_Chan* chan);
+
+/**
+ * Send the element at elem, sleeping until there is room for it or a receiver
+ * takes it.
+ *
+ * This function may fail if:
+ *  - the channel is, or becomes, closed (CSC369_ERROR_CLOSED), or
+ *  - there are no other threads that can run to receive it
+ * (CSC369_ERROR_SYS_THREAD), or
+ *  - there is no memory available to grow an unbounded channel
+ * (CSC369_ERROR_SYS_MEM)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ChanSend(CSC369_Chan* chan, void const* elem);
+
+/**
+ * Receive an element into elem, sleeping until one is sent if the channel is
+ * empty. The elements buffered when a channel is closed can still be received.
+ *
+ * This function may fail if:
+ *  - the channel is closed and empty (CSC369_ERROR_CLOSED), or
+ *  - there are no other threads that can run to send one
+ * (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ChanRecv(CSC369_Chan* chan, void* elem);
+
+/**
+ * Like CSC369_ChanSend, but fails with CSC369_ERROR_WOULD_BLOCK instead of
+ * sleeping.
+ */
+int
+CSC369_ChanTrySend(CSC369_Chan* chan, void const* elem);
+
+/**
+ * Like CSC369_ChanRecv, but fails with CSC369_ERROR_WOULD_BLOCK instead of
+ * sleeping.
+ */
+int
+CSC369_ChanTryRecv(CSC369_Chan* chan, void* elem);
+
+/**
+ * Close the channel, waking up every thread waiting on it. Sends then fail,
+ * and receives fail once the channel is empty.
+ *
+ * This function may fail if:
+ *  - the channel is already closed (CSC369_ERROR_CLOSED)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ChanClose(CSC369_Chan* chan);
+
+/**
+ * Complete one of the num cases, sleeping until one can complete if block is
+ * non-zero. When several can complete at once, which one does varies from call
+ * to call, so that no case starves.
+ *
+ * This function may fail if:
+ *  - num is not positive (CSC369_ERROR_OTHER), or
+ *  - block is 0 and no case can complete (CSC369_ERROR_WOULD_BLOCK), or
+ *  - there are no other threads that can run to complete a case
+ * (CSC369_ERROR_SYS_THREAD), or
+ *  - there is no memory available (CSC369_ERROR_SYS_MEM)
+ *
+ * @return If successful, the index of the case that completed, whose status is
+ * set. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ChanSelect(CSC369_SelectCase* cases, int num, int block);
+
+/**
+ * Take the waiters of the thread whose identifier is tid off every channel, and
+ * free what it used to wait on channels. Called with interrupts disabled when
+ * the thread exits or is killed, so that no channel is left with a waiter that
+ * nothing will complete.
+ */
+void
+Chan_ThreadExit(Tid tid);
+
+#endif // CSC369_CHAN_H
@@ -0,0 +1,108 @@
+#include "csc369_context.h"
+
+#ifdef CSC369_THREAD_FAST_SWITCH
+
+#include <stddef.h>
+
+// The offsets below are hardcoded in the assembly routines.
+_Static_assert(offsetof(CSC369_Context, rsp) == 48, "CSC369_Context layout");
+_Static_assert(offsetof(CSC369_Context, rip) == 56, "CSC369_Context layout");
+_Static_assert(offsetof(CSC369_Context, mxcsr) == 64, "CSC369_Context layout");
+_Static_assert(offsetof(CSC369_Context, fpucw) == 68, "CSC369_Context layout");
+
+/**
+ * The first code run by a context built with Context_Make. Moves the arguments
+ * stashed in callee-saved registers into argument registers, then jumps (not
+ * calls) to the entry function so that the stack alignment is that of a call.
+ */
+void
+Context_Trampoline(void);
+
+__asm__(
+  ".text\n"
+  ".globl Context_Get\n"
+  ".type Context_Get, @function\n"
+  "Context_Get:\n"
+  "  movq %rbx, 0(%rdi)\n"
+  "  movq %rbp, 8(%rdi)\n"
+  "  movq %r12, 16(%rdi)\n"
+  "  movq %r13, 24(%rdi)\n"
+  "  movq %r14, 32(%rdi)\n"
+  "  movq %r15, 40(%rdi)\n"
+  // The stack pointer of the caller, once this function has returned
+  "  leaq 8(%rsp), %rdx\n"
+  "  movq %rdx, 48(%rdi)\n"
+  // Resume at our return address
+  "  movq (%rsp), %rdx\n"
+  "  movq %rdx, 56(%rdi)\n"
+  "  stmxcsr 64(%rdi)\n"
+  "  fnstcw 68(%rdi)\n"
+  "  xorl %eax, %eax\n"
+  "  ret\n"
+  ".size Context_Get, .-Context_Get\n"
+
+  ".globl Context_Set\n"
+  ".type Context_Set, @function\n"
+  "Context_Set:\n"
+  "  movq 0(%rdi), %rbx\n"
+  "  movq 8(%rdi), %rbp\n"
+  "  movq 16(%rdi), %r12\n"
+  "  movq 24(%rdi), %r13\n"
+  "  movq 32(%rdi), %r14\n"
+  "  movq 40(%rdi), %r15\n"
+  "  ldmxcsr 64(%rdi)\n"
+  "  fldcw 68(%rdi)\n"
+  "  movq 48(%rdi), %rsp\n"
+  // Context_Get returns 0 the second time as well
+  "  xorl %eax, %eax\n"
+  "  jmpq *56(%rdi)\n"
+  ".size Context_Set, .-Context_Set\n"
+
+  ".globl Context_Trampoline\n"
+  ".type Context_Trampoline, @function\n"
+  "Context_Trampoline:\n"
+  "  movq %r12, %rdi\n"
+  "  movq %r13, %rsi\n"
+  "  jmpq *%rbx\n"
+  ".size Context_Trampoline, .-Context_Trampoline\n");
+
+int
+Context_Make(CSC369_Context* context,
+             void (*entry)(void (*)(void*), void*),
+             void (*f)(void*),
+             void* arg,
+             void* stack_top)
+{
+  *context = (CSC369_Context){ 0 };
+  context->rbx = (uint64_t)entry;
+  context->r12 = (uint64_t)f;
+  context->r13 = (uint64_t)arg;
+  context->rsp = (uint64_t)stack_top;
+  context->rip = (uint64_t)&Context_Trampoline;
+
+  // New threads start with the floating point environment of their creator
+  __asm__ volatile("stmxcsr %0" : "=m"(context->mxcsr));
+  __asm__ volatile("fnstcw %0" : "=m"(context->fpucw));
+  return 0;
+}
+
+#else
+
+int
+Context_Make(CSC369_Context* context,
+             void (*entry)(void (*)(void*), void*),
+             void (*f)(void*),
+             void* arg,
+             void* stack_top)
+{
+  int err = getcontext(context);
+  if (err)
+    return -1;
+  context->uc_mcontext.gregs[REG_RIP] = (greg_t)entry;
+  context->uc_mcontext.gregs[REG_RDI] = (greg_t)f;
+  context->uc_mcontext.gregs[REG_RSI] = (greg_t)arg;
+  context->uc_mcontext.gregs[REG_RSP] = (greg_t)stack_top;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines the context switch backend used by the CSC369 Thread Library.
+ *
+ * By default, contexts are saved and restored with getcontext()/setcontext().
+ * Those also save and restore the signal mask, which costs a system call each.
+ *
+ * When CSC369_THREAD_FAST_SWITCH is defined, contexts are instead saved and
+ * restored by hand-written x86-64 routines that only preserve what the System V
+ * ABI requires to survive a function call: the callee-saved registers, the
+ * stack pointer and the floating point control words. No system calls are made.
+ */
+#ifndef CSC369_CONTEXT_H
+#define CSC369_CONTEXT_H
+
+#ifdef CSC369_THREAD_FAST_SWITCH
+
+#if !defined(__x86_64__)
+#error "CSC369_THREAD_FAST_SWITCH requires an x86-64 target"
+#endif
+
+#include <stdint.h>
+
+/**
+ * The registers a function call must preserve.
+ */
+typedef struct
+{
+  uint64_t rbx;
+  uint64_t rbp;
+  uint64_t r12;
+  uint64_t r13;
+  uint64_t r14;
+  uint64_t r15;
+  uint64_t rsp;
+  uint64_t rip;
+  uint32_t mxcsr;
+  uint16_t fpucw;
+} CSC369_Context;
+
+/**
+ * Save the calling context. Like getcontext(), this function returns 0 a
+ * second time when the saved context is resumed by Context_Set.
+ *
+ * @return 0.
+ */
+int
+Context_Get(CSC369_Context* context) __attribute__((returns_twice));
+
+/**
+ * Resume a context saved by Context_Get or built by Context_Make.
+ *
+ * @return This function does not return.
+ */
+void
+Context_Set(CSC369_Context const* context) __attribute__((noreturn));
+
+#else
+
+#include <ucontext.h>
+
+typedef ucontext_t CSC369_Context;
+
+#define Context_Get(context) getcontext(context)
+#define Context_Set(context) setcontext(context)
+
+#endif
+
+/**
+ * Build a context that calls entry(f, arg) on the stack ending at stack_top.
+ *
+ * @pre stack_top + 8 is 16-byte aligned (i.e., as if a call just happened).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int
+Context_Make(CSC369_Context* context,
+             void (*entry)(void (*)(void*), void*),
+             void (*f)(void*),
+             void* arg,
+             void* stack_top);
+
+#endif // CSC369_CONTEXT_H
@@ -0,0 +1,274 @@
+#include "csc369_executor.h"
+
+#include <stdlib.h>
+
+#include "csc369_interrupts.h"
+
+#ifdef NDEBUG
+#define assert(x) do { (void)sizeof(x);} while (0)
+#else
+#include <assert.h>
+#endif
+
+//****************************************************************************
+// Private Definitions
+//****************************************************************************
+struct csc369_future_t
+{
+  /**
+   * The next task in the queue of the executor, or the next free future.
+   */
+  struct csc369_future_t* next;
+
+  CSC369_Executor* executor;
+
+  void* (*fn)(void*);
+
+  void* arg;
+
+  void* result;
+
+  int done;
+
+  /**
+   * The thread waiting for the task, if any.
+   */
+  CSC369_WaitQueue* waiters;
+};
+
+struct csc369_executor_t
+{
+  /**
+   * The threads of the executor, or -1 for those that have stopped running
+   * tasks and will not be joined.
+   */
+  Tid* threads;
+
+  int threads_num;
+
+  /**
+   * The tasks that no thread has started yet, in the order submitted.
+   */
+  CSC369_Future* head;
+
+  CSC369_Future* tail;
+
+  /**
+   * The threads waiting for tasks.
+   */
+  CSC369_WaitQueue* idle;
+
+  /**
+   * Futures that were waited on, ready to be reused without allocating.
+   */
+  CSC369_Future* free_futures;
+
+  /**
+   * The number of futures that have not been waited on yet.
+   */
+  int futures_num;
+
+  int stopping;
+};
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+/**
+ * @return a future for a new task, or NULL if there is no memory available.
+ */
+CSC369_Future*
+Executor_AllocFuture(CSC369_Executor* executor)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  CSC369_Future* future = executor->free_futures;
+  if (future != NULL) {
+    executor->free_futures = future->next;
+    return future;
+  }
+
+  future = malloc(sizeof(CSC369_Future));
+  if (future == NULL)
+    return NULL;
+  future->waiters = CSC369_WaitQueueCreate();
+  if (future->waiters == NULL) {
+    free(future);
+    return NULL;
+  }
+  future->executor = executor;
+  return future;
+}
+
+/**
+ * Remove the calling thread from the threads of executor, which it no longer
+ * uses. Its identifier may be reused once it exits, so CSC369_ExecutorDestroy
+ * must not join it after this point.
+ */
+void
+Executor_Leave(CSC369_Executor* executor)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  Tid const tid = CSC369_ThreadId();
+  for (int i = 0; i < executor->threads_num; i++) {
+    if (executor->threads[i] == tid) {
+      executor->threads[i] = -1;
+      break;
+    }
+  }
+  // Whether or not it is joined, the thread is cleaned up after it exits
+  CSC369_ThreadDetach(tid);
+}
+
+/**
+ * Run the tasks of the executor arg as they are submitted, until it is
+ * stopped.
+ */
+void
+Executor_Run(void* arg)
+{
+  CSC369_Executor* executor = arg;
+  int prev_state = CSC369_InterruptsDisable();
+  while (1) {
+    CSC369_Future* task = executor->head;
+    if (task == NULL) {
+      // Stop only once the queue is drained. A failed sleep means no thread
+      // is left that could submit a task.
+      if (executor->stopping || CSC369_ThreadSleep(executor->idle) < 0)
+        break;
+      continue;
+    }
+    executor->head = task->next;
+    if (executor->head == NULL)
+      executor->tail = NULL;
+
+    CSC369_InterruptsSet(prev_state);
+    void* result = task->fn(task->arg);
+    CSC369_InterruptsDisable();
+
+    task->result = result;
+    task->done = 1;
+    CSC369_ThreadWakeNext(task->waiters);
+  }
+  Executor_Leave(executor);
+  CSC369_InterruptsSet(prev_state);
+}
+
+//****************************************************************************
+// executor.h Functions
+//****************************************************************************
+CSC369_Executor*
+CSC369_ExecutorCreate(int threads_num)
+{
+  if (threads_num <= 0)
+    return NULL;
+  CSC369_Executor* executor = malloc(sizeof(CSC369_Executor));
+  if (executor == NULL)
+    return NULL;
+  executor->threads = malloc(threads_num * sizeof(Tid));
+  executor->idle = CSC369_WaitQueueCreate();
+  if (executor->threads == NULL || executor->idle == NULL) {
+    free(executor->threads);
+    if (executor->idle != NULL)
+      CSC369_WaitQueueDestroy(executor->idle);
+    free(executor);
+    return NULL;
+  }
+  executor->threads_num = 0;
+  executor->head = NULL;
+  executor->tail = NULL;
+  executor->free_futures = NULL;
+  executor->futures_num = 0;
+  executor->stopping = 0;
+
+  for (int i = 0; i < threads_num; i++) {
+    Tid const tid = CSC369_ThreadCreate(Executor_Run, executor);
+    if (tid < 0) {
+      CSC369_ExecutorDestroy(executor);
+      return NULL;
+    }
+    executor->threads[executor->threads_num++] = tid;
+  }
+  return executor;
+}
+
+int
+CSC369_ExecutorDestroy(CSC369_Executor* executor)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  if (executor->futures_num > 0) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_OTHER;
+  }
+  executor->stopping = 1;
+  CSC369_ThreadWakeAll(executor->idle);
+
+  // Interrupts stay disabled between checking a thread and joining it, so it
+  // cannot leave and be cleaned up in between
+  int ret = 0;
+  for (int i = 0; i < executor->threads_num; i++) {
+    Tid const tid = executor->threads[i];
+    int exit_code;
+    if (tid >= 0 && CSC369_ThreadJoin(tid, &exit_code) != tid)
+      ret = CSC369_ERROR_SYS_THREAD;
+  }
+  CSC369_InterruptsSet(prev_state);
+
+  while (executor->free_futures != NULL) {
+    CSC369_Future* future = executor->free_futures;
+    executor->free_futures = future->next;
+    CSC369_WaitQueueDestroy(future->waiters);
+    free(future);
+  }
+  CSC369_WaitQueueDestroy(executor->idle);
+  free(executor->threads);
+  free(executor);
+  return ret;
+}
+
+CSC369_Future*
+CSC369_ExecutorSubmit(CSC369_Executor* executor, void* (*fn)(void*), void* arg)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  CSC369_Future* future = Executor_AllocFuture(executor);
+  if (future == NULL) {
+    CSC369_InterruptsSet(prev_state);
+    return NULL;
+  }
+  future->next = NULL;
+  future->fn = fn;
+  future->arg = arg;
+  future->result = NULL;
+  future->done = 0;
+  executor->futures_num++;
+
+  if (executor->tail == NULL)
+    executor->head = future;
+  else
+    executor->tail->next = future;
+  executor->tail = future;
+  CSC369_ThreadWakeNext(executor->idle);
+  CSC369_InterruptsSet(prev_state);
+  return future;
+}
+
+int
+CSC369_FutureWait(CSC369_Future* future, void** result)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  while (!future->done) {
+    int const ret = CSC369_ThreadSleep(future->waiters);
+    if (ret < 0) {
+      CSC369_InterruptsSet(prev_state);
+      return ret;
+    }
+  }
+  if (result != NULL)
+    *result = future->result;
+
+  CSC369_Executor* executor = future->executor;
+  future->next = executor->free_futures;
+  executor->free_futures = future;
+  executor->futures_num--;
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
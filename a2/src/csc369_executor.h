@@ -0,0 +1,65 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines executors, which run tasks on a fixed set of threads.
+ *
+ * The threads of an executor are created once and sleep while there are no
+ * tasks, so submitting a task costs a queue push and a wakeup rather than the
+ * creation and exit of a thread. Each submitted task has a future, which a
+ * thread waits on for the task's result.
+ */
+#ifndef CSC369_EXECUTOR_H
+#define CSC369_EXECUTOR_H
+
+#include "csc369_thread.h"
+
+typedef struct csc369_executor_t CSC369_Executor;
+
+typedef struct csc369_future_t CSC369_Future;
+
+/**
+ * Create an executor that runs tasks on threads_num threads.
+ *
+ * @return the executor, or NULL if threads_num is not positive or the
+ * threads could not be created.
+ */
+CSC369_Executor*
+CSC369_ExecutorCreate(int threads_num);
+
+/**
+ * Wait for the tasks that were submitted to finish, then stop the threads of
+ * the executor and free it. Must not be called by one of those threads.
+ *
+ * This function may fail if:
+ *  - a future of the executor has not been waited on (CSC369_ERROR_OTHER), or
+ *  - one of the threads of the executor was killed (CSC369_ERROR_SYS_THREAD),
+ * in which case the executor is still freed
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ExecutorDestroy(CSC369_Executor* executor);
+
+/**
+ * Queue a task that calls fn(arg) on one of the threads of the executor.
+ *
+ * @return the future of the task, or NULL if there is no memory available.
+ */
+CSC369_Future*
+CSC369_ExecutorSubmit(CSC369_Executor* executor, void* (*fn)(void*), void* arg);
+
+/**
+ * Suspend the calling thread until the task of future has run, and store what
+ * it returned in result (if result is not NULL). The future is freed, so each
+ * future must be waited on exactly once.
+ *
+ * This function may fail if:
+ *  - there are no other threads that can run the task
+ * (CSC369_ERROR_SYS_THREAD), in which case the future is not freed
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_FutureWait(CSC369_Future* future, void** result);
+
+#endif // CSC369_EXECUTOR_H
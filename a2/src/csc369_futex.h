@@ -0,0 +1,52 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines waiting on and waking up addresses, like Linux futexes.
+ *
+ * Any int in memory can be waited on, without creating a wait queue for it:
+ * waiting threads are kept in a fixed table of queues shared by all addresses,
+ * chosen by hashing the address. A lock or flag built on these functions can
+ * then be a single int that needs no initialization or memory of its own, and
+ * that is only touched with atomic instructions until threads contend for it.
+ */
+#ifndef CSC369_FUTEX_H
+#define CSC369_FUTEX_H
+
+/**
+ * The number of queues that waiting threads are spread over.
+ */
+#define CSC369_FUTEX_BUCKETS 256
+
+/**
+ * If *addr is still expected, suspend the calling thread until another thread
+ * calls CSC369_FutexWake on addr. Checking *addr and going to sleep are atomic
+ * with respect to CSC369_FutexWake, so a thread that changes *addr and then
+ * wakes up the waiters of addr never misses one.
+ *
+ * As with Linux futexes, the caller should check *addr again after waking up.
+ *
+ * This function may fail if:
+ *  - *addr is not expected (CSC369_ERROR_WOULD_BLOCK), or
+ *  - there are no other threads that can run (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_FutexWait(volatile int* addr, int expected);
+
+/**
+ * Wake up the first n threads waiting on addr, or all of them if there are
+ * fewer, in FIFO order (and move them to the ready queue).
+ *
+ * The calling thread continues to execute (i.e., it is not suspended).
+ *
+ * This function may fail if:
+ *  - n is negative (CSC369_ERROR_OTHER)
+ *
+ * @return The number of threads woken up, which can be 0, or the appropriate
+ * error code.
+ */
+int
+CSC369_FutexWake(volatile int* addr, int n);
+
+#endif // CSC369_FUTEX_H
@@ -1,158 +1,432 @@
-#include <assert.h>
-#include <signal.h>
-#include <stdarg.h>
-#include <sys/time.h>
-
-#include "csc369_interrupts.h"
-#include "csc369_thread.h"
-
-#define UNUSED(x) (void)(x)
-
-// The type of signal to use for delivering "interrupts"
-#define CSC369_INTERRUPTS_SIGNAL_TYPE SIGALRM
-
-// Whether we should log debugging information to stdout
-int interrupts_log_level = CSC369_INTERRUPTS_QUIET;
-
-/**
- * Ask the operating system to set an alarm for some time (i.e., SIG_INTERVAL)
- * in the future.
- */
-void
-ScheduleAlarmSignal(void)
-{
-  struct itimerval val;
-  val.it_interval.tv_sec = 0;
-  val.it_interval.tv_usec = 0;
-  val.it_value.tv_sec = 0;
-  val.it_value.tv_usec = CSC369_INTERRUPTS_SIGNAL_INTERVAL;
-
-  int ret = setitimer(ITIMER_REAL, &val, NULL);
-  assert(!ret);
-}
-
-/**
- * Handle a signal from the operating system.
- */
-void
-HandleSignal(int sig, siginfo_t* sip, void* contextVP)
-{
-  UNUSED(sig);
-  UNUSED(sip);
-  assert(!CSC369_InterruptsAreEnabled());
-
-  static int first = 1;
-  static struct timeval start, end, diff = { 0, 0 };
-
-  if (interrupts_log_level) {
-    int ret = gettimeofday(&end, NULL);
-    assert(!ret);
-
-    if (first) {
-      first = 0;
-    } else {
-      timersub(&end, &start, &diff);
-    }
-
-    ucontext_t* context = (ucontext_t*)contextVP;
-    start = end;
-    printf("%s: context at %10p, time diff = %ld us\n",
-           __func__,
-           (void*)context,
-           diff.tv_sec * 1000000 + diff.tv_usec);
-  }
-
-  // Set up the next interrupt
-  ScheduleAlarmSignal();
-  // Yield to "preempt" the current thread and switch to another
-  CSC369_ThreadYield();
-}
-
-void
-CSC369_InterruptsInit(void)
-{
-  // Ensure this function is only called once
-  static int init = 0;
-  assert(!init);
-  init = 1;
-
-  struct sigaction action;
-  action.sa_handler = NULL;
-  action.sa_sigaction = HandleSignal;
-
-  // Block alarm signals while the interrupt handler is running. This will avoid
-  // recursive interrupts where an interrupt occurs before the previous
-  // interrupt handler has finished running.
-  int error = sigemptyset(&action.sa_mask);
-  assert(!error);
-
-  // Use sa_sigaction as handler instead of sa_handler
-  action.sa_flags = SA_SIGINFO;
-  if (sigaction(CSC369_INTERRUPTS_SIGNAL_TYPE, &action, NULL)) {
-    perror("Setting up signal handler");
-    assert(0);
-  }
-  ScheduleAlarmSignal();
-}
-
-CSC369_InterruptsState
-CSC369_InterruptsSet(CSC369_InterruptsState state)
-{
-  sigset_t mask, omask;
-
-  // Create a signal set with only CSC369_INTERRUPTS_SIGNAL_TYPE
-  int ret = sigemptyset(&mask);
-  assert(!ret);
-  ret = sigaddset(&mask, CSC369_INTERRUPTS_SIGNAL_TYPE);
-  assert(!ret);
-
-  // Based on state, block or unblock signals of CSC369_INTERRUPTS_SIGNAL_TYPE
-  if (state) {
-    ret = sigprocmask(SIG_UNBLOCK, &mask, &omask);
-  } else {
-    ret = sigprocmask(SIG_BLOCK, &mask, &omask);
-  }
-  assert(!ret);
-  return (sigismember(&omask, CSC369_INTERRUPTS_SIGNAL_TYPE) ? 0 : 1);
-}
-
-CSC369_InterruptsState
-CSC369_InterruptsEnable(void)
-{
-  return CSC369_InterruptsSet(CSC369_INTERRUPTS_ENABLED);
-}
-
-CSC369_InterruptsState
-CSC369_InterruptsDisable(void)
-{
-  return CSC369_InterruptsSet(CSC369_INTERRUPTS_DISABLED);
-}
-
-int
-CSC369_InterruptsAreEnabled(void)
-{
-  sigset_t mask;
-  int ret = sigprocmask(0, NULL, &mask);
-  assert(!ret);
-  return (sigismember(&mask, CSC369_INTERRUPTS_SIGNAL_TYPE) ? 0 : 1);
-}
-
-void
-CSC369_InterruptsSetLogLevel(CSC369_InterruptsOutput level)
-{
-  interrupts_log_level = level;
-}
-
-int
-CSC369_InterruptsPrintf(const char* fmt, ...)
-{
-  int const prev_state = CSC369_InterruptsDisable();
-
-  va_list args;
-  va_start(args, fmt);
-  int ret = vprintf(fmt, args);
-  va_end(args);
-
-  CSC369_InterruptsSet(prev_state);
-  return ret;
-}
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csc369_interrupts.h"
+#include "csc369_thread.h"
+#include "csc369_trace.h"
+
+#define UNUSED(x) (void)(x)
+
+// The type of signal to use for delivering "interrupts"
+#define CSC369_INTERRUPTS_SIGNAL_TYPE SIGALRM
+
+// Older versions of glibc do not name the field for SIGEV_THREAD_ID
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// Whether we should log debugging information to stdout
+int interrupts_log_level = CSC369_INTERRUPTS_QUIET;
+
+// Whether CSC369_InterruptsInit has been called
+volatile int interrupts_initialized = 0;
+
+// Whether several kernel threads ("CPUs") use interrupts, see
+// CSC369_InterruptsInitSMP
+int interrupts_smp = 0;
+
+/**
+ * In SMP mode, the CPU that has interrupts disabled holds this lock, so that
+ * disabling interrupts excludes every other CPU as well.
+ */
+volatile int interrupts_lock = 0;
+
+// Whether this CPU holds interrupts_lock
+__thread int interrupts_lock_held __attribute__((tls_model("initial-exec"))) = 0;
+
+// How often, in microseconds, a CPU is interrupted unless the thread it runs
+// asks otherwise, see CSC369_InterruptsSetQuantum
+volatile int interrupts_quantum = CSC369_INTERRUPTS_SIGNAL_INTERVAL;
+
+// Each CPU is interrupted by its own periodic timer, which only signals the
+// kernel thread that created it
+__thread timer_t interrupts_timer __attribute__((tls_model("initial-exec")));
+
+__thread int interrupts_timer_created __attribute__((tls_model("initial-exec"))) = 0;
+
+// The period of this CPU's timer in microseconds, or 0 if it is stopped
+__thread int interrupts_period __attribute__((tls_model("initial-exec"))) = 0;
+
+// Whether the interrupt handler on this CPU is preempting the running thread
+__thread int interrupts_preempted __attribute__((tls_model("initial-exec"))) = 0;
+
+#ifdef CSC369_INTERRUPTS_SOFT_MASK
+// Set while interrupts are disabled
+#define CSC369_INTERRUPTS_FLAG_MASKED 0x1
+// Set when a signal arrived while interrupts were disabled
+#define CSC369_INTERRUPTS_FLAG_PENDING 0x2
+
+/**
+ * The software interrupt state of this CPU. Instead of blocking the signal with
+ * sigprocmask, a critical section only sets the MASKED bit. A signal that
+ * arrives during a critical section sets the PENDING bit, and the preemption it
+ * would have caused is run when interrupts are next enabled.
+ */
+__thread volatile sig_atomic_t interrupts_flags
+  __attribute__((tls_model("initial-exec"))) = 0;
+
+/**
+ * @return this CPU's interrupts_flags.
+ *
+ * The caller may resume on another CPU after a thread switch, and the compiler
+ * assumes the thread pointer does not change within a function. So the flags
+ * are always reached through this (opaque) function instead.
+ */
+__attribute__((noinline)) volatile sig_atomic_t*
+Interrupts_Flags(void)
+{
+  __asm__ volatile("");
+  return &interrupts_flags;
+}
+#endif
+
+/**
+ * @return this CPU's errno.
+ *
+ * As with the interrupt flags, errno is per kernel thread, so it is looked up
+ * again after a thread switch instead of through a location the compiler may
+ * have kept from before it.
+ */
+__attribute__((noinline)) int*
+Interrupts_Errno(void)
+{
+  __asm__ volatile("");
+  return &errno;
+}
+
+void
+Interrupts_Lock(void)
+{
+  while (__atomic_exchange_n(&interrupts_lock, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(&interrupts_lock, __ATOMIC_RELAXED))
+      __builtin_ia32_pause();
+  }
+}
+
+void
+Interrupts_Unlock(void)
+{
+  __atomic_store_n(&interrupts_lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Set the calling CPU's timer to go off every usec microseconds, starting usec
+ * from now, or stop it if usec is 0.
+ */
+void
+ScheduleAlarmSignal(int usec)
+{
+  if (!interrupts_timer_created)
+    return;
+  struct itimerspec spec;
+  spec.it_value.tv_sec = usec / 1000000;
+  spec.it_value.tv_nsec = (usec % 1000000) * 1000L;
+  spec.it_interval = spec.it_value;
+  int ret = timer_settime(interrupts_timer, 0, &spec, NULL);
+  assert(!ret);
+  interrupts_period = usec;
+}
+
+/**
+ * Handle a signal from the operating system.
+ */
+void
+HandleSignal(int sig, siginfo_t* sip, void* contextVP)
+{
+  UNUSED(sig);
+  UNUSED(sip);
+#ifdef CSC369_INTERRUPTS_SOFT_MASK
+  volatile sig_atomic_t* flags = Interrupts_Flags();
+  if (*flags & CSC369_INTERRUPTS_FLAG_MASKED) {
+    // Defer the preemption until the critical section ends
+    *flags |= CSC369_INTERRUPTS_FLAG_PENDING;
+    return;
+  }
+  // Mask interrupts for the rest of the handler, as the kernel would have
+  *flags = CSC369_INTERRUPTS_FLAG_MASKED;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  if (interrupts_smp)
+    Interrupts_Lock();
+#else
+  assert(!CSC369_InterruptsAreEnabled());
+#endif
+
+  static int first = 1;
+  static struct timeval start, end, diff = { 0, 0 };
+
+  if (interrupts_log_level) {
+    int ret = gettimeofday(&end, NULL);
+    assert(!ret);
+
+    if (first) {
+      first = 0;
+    } else {
+      timersub(&end, &start, &diff);
+    }
+
+    ucontext_t* context = (ucontext_t*)contextVP;
+    start = end;
+    printf("%s: context at %10p, time diff = %ld us\n",
+           __func__,
+           (void*)context,
+           diff.tv_sec * 1000000 + diff.tv_usec);
+  }
+
+  // The timer is periodic, so the next interrupt is already set up
+  interrupts_preempted = 1;
+  Trace_Record(TRACE_PREEMPT, CSC369_ThreadId(), 0);
+  // Yield to "preempt" the current thread and switch to another. The thread
+  // may have been interrupted between a system call and its check of errno,
+  // which the threads run meanwhile overwrite, and it may resume on another
+  // kernel thread, with an errno of its own.
+  int const saved_errno = *Interrupts_Errno();
+  CSC369_ThreadYield();
+  *Interrupts_Errno() = saved_errno;
+#ifdef CSC369_INTERRUPTS_SOFT_MASK
+  // There is no signal mask for the kernel to restore when we return
+  CSC369_InterruptsEnable();
+#else
+  // The kernel restores the signal mask when we return, but not the lock
+  if (interrupts_smp)
+    CSC369_InterruptsEnable();
+#endif
+}
+
+/**
+ * Create the calling CPU's timer, which signals only this kernel thread.
+ */
+void
+CreateAlarmTimer(void)
+{
+  struct sigevent event = { 0 };
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = CSC369_INTERRUPTS_SIGNAL_TYPE;
+  event.sigev_notify_thread_id = gettid();
+
+  int ret = timer_create(CLOCK_MONOTONIC, &event, &interrupts_timer);
+  assert(!ret);
+  interrupts_timer_created = 1;
+}
+
+void
+CSC369_InterruptsInit(void)
+{
+  // Ensure this function is only called once
+  static int init = 0;
+  assert(!init);
+  init = 1;
+
+  struct sigaction action;
+  action.sa_handler = NULL;
+  action.sa_sigaction = HandleSignal;
+
+  // Block alarm signals while the interrupt handler is running. This will avoid
+  // recursive interrupts where an interrupt occurs before the previous
+  // interrupt handler has finished running.
+  int error = sigemptyset(&action.sa_mask);
+  assert(!error);
+
+  // Use sa_sigaction as handler instead of sa_handler. Threads make system
+  // calls between ticks, which come periodically, so restart the calls a tick
+  // lands in rather than fail them with EINTR.
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+#ifdef CSC369_INTERRUPTS_SOFT_MASK
+  // Recursive interrupts are instead avoided by masking them in software. The
+  // kernel must not block the signal for the duration of the handler: the
+  // handler may switch to a thread that never returns through it.
+  action.sa_flags |= SA_NODEFER;
+#endif
+  if (sigaction(CSC369_INTERRUPTS_SIGNAL_TYPE, &action, NULL)) {
+    perror("Setting up signal handler");
+    assert(0);
+  }
+  CreateAlarmTimer();
+  interrupts_initialized = 1;
+  ScheduleAlarmSignal(interrupts_quantum);
+}
+
+void
+CSC369_InterruptsInitSMP(void)
+{
+  assert(!interrupts_initialized);
+  interrupts_smp = 1;
+}
+
+int
+CSC369_InterruptsInitCPU(void)
+{
+  assert(interrupts_smp);
+  if (!interrupts_initialized)
+    return -1;
+  if (!interrupts_timer_created) {
+    CreateAlarmTimer();
+    ScheduleAlarmSignal(interrupts_quantum);
+  }
+  return 0;
+}
+
+int
+CSC369_InterruptsSetQuantum(int usec)
+{
+  if (usec <= 0)
+    return -1;
+  interrupts_quantum = usec;
+  return 0;
+}
+
+int
+CSC369_InterruptsGetQuantum(void)
+{
+  return interrupts_quantum;
+}
+
+void
+CSC369_InterruptsSetPeriod(int usec)
+{
+  assert(usec >= 0);
+  // Keep the phase of a timer that already has the right period
+  if (usec != interrupts_period)
+    ScheduleAlarmSignal(usec);
+}
+
+int
+CSC369_InterruptsWasPreempted(void)
+{
+  int const preempted = interrupts_preempted;
+  interrupts_preempted = 0;
+  return preempted;
+}
+
+#ifdef CSC369_INTERRUPTS_SOFT_MASK
+CSC369_InterruptsState
+CSC369_InterruptsSet(CSC369_InterruptsState state)
+{
+  if (!state) {
+    volatile sig_atomic_t* flags = Interrupts_Flags();
+    if (*flags & CSC369_INTERRUPTS_FLAG_MASKED) {
+      return CSC369_INTERRUPTS_DISABLED;
+    }
+    // A signal cannot have set PENDING while we were unmasked
+    *flags = CSC369_INTERRUPTS_FLAG_MASKED;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    if (interrupts_smp)
+      Interrupts_Lock();
+    return CSC369_INTERRUPTS_ENABLED;
+  }
+
+  if (!(*Interrupts_Flags() & CSC369_INTERRUPTS_FLAG_MASKED)) {
+    return CSC369_INTERRUPTS_ENABLED;
+  }
+
+  while (1) {
+    // Run the preemptions that were deferred by the critical section. This may
+    // resume on another CPU, so the flags are looked up again every time.
+    int flags = __atomic_fetch_and(
+      Interrupts_Flags(), ~CSC369_INTERRUPTS_FLAG_PENDING, __ATOMIC_SEQ_CST);
+    if (flags & CSC369_INTERRUPTS_FLAG_PENDING) {
+      // As in HandleSignal, the yield counts as a preemption, and the thread
+      // keeps its errno across it
+      interrupts_preempted = 1;
+      Trace_Record(TRACE_PREEMPT, CSC369_ThreadId(), 0);
+      int const saved_errno = *Interrupts_Errno();
+      CSC369_ThreadYield();
+      *Interrupts_Errno() = saved_errno;
+      continue;
+    }
+
+    if (interrupts_smp)
+      Interrupts_Unlock();
+    // Clear both bits at once, so that a signal cannot set PENDING in between
+    flags = __atomic_exchange_n(Interrupts_Flags(), 0, __ATOMIC_SEQ_CST);
+    if (!(flags & CSC369_INTERRUPTS_FLAG_PENDING)) {
+      return CSC369_INTERRUPTS_DISABLED;
+    }
+
+    // A signal arrived while the lock was being released
+    *Interrupts_Flags() = CSC369_INTERRUPTS_FLAG_MASKED;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    if (interrupts_smp)
+      Interrupts_Lock();
+  }
+}
+#else
+CSC369_InterruptsState
+CSC369_InterruptsSet(CSC369_InterruptsState state)
+{
+  sigset_t mask, omask;
+
+  // Create a signal set with only CSC369_INTERRUPTS_SIGNAL_TYPE
+  int ret = sigemptyset(&mask);
+  assert(!ret);
+  ret = sigaddset(&mask, CSC369_INTERRUPTS_SIGNAL_TYPE);
+  assert(!ret);
+
+  // Based on state, block or unblock signals of CSC369_INTERRUPTS_SIGNAL_TYPE.
+  // In SMP mode, the lock is only held while signals are blocked.
+  if (state) {
+    if (interrupts_lock_held) {
+      interrupts_lock_held = 0;
+      Interrupts_Unlock();
+    }
+    ret = sigprocmask(SIG_UNBLOCK, &mask, &omask);
+  } else {
+    ret = sigprocmask(SIG_BLOCK, &mask, &omask);
+    if (interrupts_smp && !interrupts_lock_held) {
+      Interrupts_Lock();
+      interrupts_lock_held = 1;
+    }
+  }
+  assert(!ret);
+  return (sigismember(&omask, CSC369_INTERRUPTS_SIGNAL_TYPE) ? 0 : 1);
+}
+#endif
+
+CSC369_InterruptsState
+CSC369_InterruptsEnable(void)
+{
+  return CSC369_InterruptsSet(CSC369_INTERRUPTS_ENABLED);
+}
+
+CSC369_InterruptsState
+CSC369_InterruptsDisable(void)
+{
+  return CSC369_InterruptsSet(CSC369_INTERRUPTS_DISABLED);
+}
+
+int
+CSC369_InterruptsAreEnabled(void)
+{
+#ifdef CSC369_INTERRUPTS_SOFT_MASK
+  return (*Interrupts_Flags() & CSC369_INTERRUPTS_FLAG_MASKED) ? 0 : 1;
+#else
+  sigset_t mask;
+  int ret = sigprocmask(0, NULL, &mask);
+  assert(!ret);
+  return (sigismember(&mask, CSC369_INTERRUPTS_SIGNAL_TYPE) ? 0 : 1);
+#endif
+}
+
+void
+CSC369_InterruptsSetLogLevel(CSC369_InterruptsOutput level)
+{
+  interrupts_log_level = level;
+}
+
+int
+CSC369_InterruptsPrintf(const char* fmt, ...)
+{
+  int const prev_state = CSC369_InterruptsDisable();
+
+  va_list args;
+  va_start(args, fmt);
+  int ret = vprintf(fmt, args);
+  va_end(args);
+
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
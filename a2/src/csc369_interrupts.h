@@ -1,88 +1,157 @@
-/**
- * CSC369 Assignment 2
- *
- * @file Defines the public interface for controlling "simulated interrupts".
- */
-#ifndef CSC369_INTERRUPTS_H
-#define CSC369_INTERRUPTS_H
-#include <signal.h>
-#include <stdio.h>
-
-/**
- * How frequently this process will be interrupted.
- */
-#define CSC369_INTERRUPTS_SIGNAL_INTERVAL 200
-
-/**
- * Enum specifying the state of interrupts.
- */
-typedef enum
-{
-  CSC369_INTERRUPTS_DISABLED = 0,
-  CSC369_INTERRUPTS_ENABLED = 1,
-} CSC369_InterruptsState;
-
-/**
- * Enum specifying the verbosity of outputs (logging) produced by interrupts.
- */
-typedef enum
-{
-  CSC369_INTERRUPTS_QUIET = 0,
-  CSC369_INTERRUPTS_VERBOSE = 1,
-} CSC369_InterruptsOutput;
-
-/**
- * Initialize the CSC369 interrupt library.
- *
- * This must be called before using other functions in this header.
- *
- * @return 0 on success, -1 otherwise.
- */
-void
-CSC369_InterruptsInit(void);
-
-/**
- * Set whether interrupts should be enabled or disabled.
- *
- * @return The state of interrupts before the call to this function.
- */
-CSC369_InterruptsState
-CSC369_InterruptsSet(CSC369_InterruptsState state);
-
-/**
- * Enable interrupts.
- *
- * @return The state of interrupts before the call to this function.
- */
-CSC369_InterruptsState
-CSC369_InterruptsEnable(void);
-
-/**
- * Disable interrupts.
- *
- * @return The state of interrupts before the call to this function.
- */
-CSC369_InterruptsState
-CSC369_InterruptsDisable(void);
-
-/**
- * @return whether interrupts are enabled (1) or not (0).
- */
-int
-CSC369_InterruptsAreEnabled(void);
-
-/**
- * Set the verbosity of logging.
- */
-void
-CSC369_InterruptsSetLogLevel(CSC369_InterruptsOutput level);
-
-/**
- * Print to stdout safely (i.e., without being interrupted).
- *
- * This function can be called as if it were printf.
- */
-int
-CSC369_InterruptsPrintf(const char* fmt, ...);
-
-#endif // CSC369_INTERRUPTS_H
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines the public interface for controlling "simulated interrupts".
+ */
+#ifndef CSC369_INTERRUPTS_H
+#define CSC369_INTERRUPTS_H
+#include <signal.h>
+#include <stdio.h>
+
+/**
+ * How frequently, in microseconds, this process is interrupted by default (see
+ * CSC369_InterruptsSetQuantum).
+ */
+#define CSC369_INTERRUPTS_SIGNAL_INTERVAL 200
+
+/**
+ * Enum specifying the state of interrupts.
+ */
+typedef enum
+{
+  CSC369_INTERRUPTS_DISABLED = 0,
+  CSC369_INTERRUPTS_ENABLED = 1,
+} CSC369_InterruptsState;
+
+/**
+ * Enum specifying the verbosity of outputs (logging) produced by interrupts.
+ */
+typedef enum
+{
+  CSC369_INTERRUPTS_QUIET = 0,
+  CSC369_INTERRUPTS_VERBOSE = 1,
+} CSC369_InterruptsOutput;
+
+/**
+ * Initialize the CSC369 interrupt library.
+ *
+ * This must be called before using other functions in this header.
+ *
+ * System calls that an interrupt lands in are restarted (see SA_RESTART in
+ * signal(7)), except those that the kernel never restarts, such as sleeps and
+ * waits with a timeout, which still fail with EINTR.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+void
+CSC369_InterruptsInit(void);
+
+/**
+ * Prepare interrupts for several kernel threads ("CPUs") running user threads.
+ *
+ * Each CPU is then interrupted by its own timer, and disabling interrupts also
+ * takes a lock shared by all CPUs, so that code run with interrupts disabled
+ * excludes every CPU and not just the calling one.
+ *
+ * This must be called before CSC369_InterruptsInit.
+ */
+void
+CSC369_InterruptsInitSMP(void);
+
+/**
+ * Start interrupting the calling CPU, if it has not been started already. The
+ * CPU that calls CSC369_InterruptsInit is started by it.
+ *
+ * @return 0 on success, -1 if CSC369_InterruptsInit has not been called yet.
+ *
+ * @pre CSC369_InterruptsInitSMP has been called.
+ */
+int
+CSC369_InterruptsInitCPU(void);
+
+/**
+ * Set how often, in microseconds, each CPU is interrupted while it runs a
+ * thread without a quantum of its own (see CSC369_ThreadSetQuantum). This is
+ * CSC369_INTERRUPTS_SIGNAL_INTERVAL until set, and takes effect on each CPU the
+ * next time it switches threads.
+ *
+ * Timed sleeps are woken up when a CPU is interrupted, in ticks of the default
+ * CSC369_INTERRUPTS_SIGNAL_INTERVAL, so a longer quantum also delays them.
+ *
+ * @return 0 on success, -1 if usec is not positive.
+ */
+int
+CSC369_InterruptsSetQuantum(int usec);
+
+/**
+ * @return how often, in microseconds, each CPU is interrupted by default.
+ */
+int
+CSC369_InterruptsGetQuantum(void);
+
+/**
+ * Interrupt the calling CPU every usec microseconds, the first time usec
+ * microseconds from now, or stop interrupting it if usec is 0. Nothing changes
+ * if the CPU is already interrupted every usec microseconds, so that switching
+ * between threads with the same quantum does not delay the next interrupt.
+ *
+ * Does nothing before the CPU's interrupts are started.
+ *
+ * @pre usec is not negative, interrupts are disabled.
+ */
+void
+CSC369_InterruptsSetPeriod(int usec);
+
+/**
+ * @return whether (1) or not (0) the calling CPU is yielding because of an
+ * interrupt, rather than because the running thread asked to, since this
+ * function was last called.
+ */
+int
+CSC369_InterruptsWasPreempted(void);
+
+/**
+ * Set whether interrupts should be enabled or disabled.
+ *
+ * @return The state of interrupts before the call to this function.
+ */
+CSC369_InterruptsState
+CSC369_InterruptsSet(CSC369_InterruptsState state);
+
+/**
+ * Enable interrupts.
+ *
+ * @return The state of interrupts before the call to this function.
+ */
+CSC369_InterruptsState
+CSC369_InterruptsEnable(void);
+
+/**
+ * Disable interrupts.
+ *
+ * @return The state of interrupts before the call to this function.
+ */
+CSC369_InterruptsState
+CSC369_InterruptsDisable(void);
+
+/**
+ * @return whether interrupts are enabled (1) or not (0).
+ */
+int
+CSC369_InterruptsAreEnabled(void);
+
+/**
+ * Set the verbosity of logging.
+ */
+void
+CSC369_InterruptsSetLogLevel(CSC369_InterruptsOutput level);
+
+/**
+ * Print to stdout safely (i.e., without being interrupted).
+ *
+ * This function can be called as if it were printf.
+ */
+int
+CSC369_InterruptsPrintf(const char* fmt, ...);
+
+#endif // CSC369_INTERRUPTS_H
@@ -0,0 +1,150 @@
+#include "csc369_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "csc369_interrupts.h"
+#include "csc369_thread.h"
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+/**
+ * Put fd in non-blocking mode, if it is not already.
+ *
+ * @return 0 on success, -1 on failure (and errno is set).
+ */
+int
+Io_SetNonBlocking(int fd)
+{
+  int const flags = fcntl(fd, F_GETFL);
+  if (flags < 0)
+    return -1;
+  if (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return -1;
+  return 0;
+}
+
+/**
+ * @return whether an operation that failed with error only would have blocked.
+ */
+int
+Io_WouldBlock(int error)
+{
+  return error == EAGAIN || error == EWOULDBLOCK;
+}
+
+/**
+ * @return ret, the result of a system call that set errno to error if it
+ * failed, with errno set to error again.
+ */
+ssize_t
+Io_Return(ssize_t ret, int error)
+{
+  if (ret < 0)
+    errno = error;
+  return ret;
+}
+
+/**
+ * Sleep until fd is ready for event.
+ *
+ * @return 0 on success, -1 on failure (and errno is set).
+ */
+int
+Io_Wait(int fd, CSC369_IoEvent event)
+{
+  int const ret = CSC369_WaitFd(fd, event);
+  if (ret == CSC369_ERROR_SYS_MEM)
+    errno = ENOMEM;
+  return ret < 0 ? -1 : 0;
+}
+
+//****************************************************************************
+// io.h Functions
+//****************************************************************************
+ssize_t
+CSC369_Read(int fd, void* buf, size_t count)
+{
+  if (Io_SetNonBlocking(fd))
+    return -1;
+  while (1) {
+    // Take errno before an interrupt can run another thread, or move this one
+    // to another kernel thread, which has an errno of its own
+    int const prev_state = CSC369_InterruptsDisable();
+    ssize_t const ret = read(fd, buf, count);
+    int const error = errno;
+    CSC369_InterruptsSet(prev_state);
+    if (ret >= 0 || !Io_WouldBlock(error))
+      return Io_Return(ret, error);
+    if (Io_Wait(fd, CSC369_IO_READ))
+      return -1;
+  }
+}
+
+ssize_t
+CSC369_Write(int fd, void const* buf, size_t count)
+{
+  if (Io_SetNonBlocking(fd))
+    return -1;
+  while (1) {
+    // Take errno before an interrupt can run another thread, or move this one
+    // to another kernel thread, which has an errno of its own
+    int const prev_state = CSC369_InterruptsDisable();
+    ssize_t const ret = write(fd, buf, count);
+    int const error = errno;
+    CSC369_InterruptsSet(prev_state);
+    if (ret >= 0 || !Io_WouldBlock(error))
+      return Io_Return(ret, error);
+    if (Io_Wait(fd, CSC369_IO_WRITE))
+      return -1;
+  }
+}
+
+int
+CSC369_Accept(int fd, struct sockaddr* addr, socklen_t* addrlen)
+{
+  if (Io_SetNonBlocking(fd))
+    return -1;
+  while (1) {
+    // Take errno before an interrupt can run another thread, or move this one
+    // to another kernel thread, which has an errno of its own
+    int const prev_state = CSC369_InterruptsDisable();
+    int const ret = accept(fd, addr, addrlen);
+    int const error = errno;
+    CSC369_InterruptsSet(prev_state);
+    if (ret >= 0 || !Io_WouldBlock(error))
+      return Io_Return(ret, error);
+    if (Io_Wait(fd, CSC369_IO_READ))
+      return -1;
+  }
+}
+
+int
+CSC369_Connect(int fd, struct sockaddr const* addr, socklen_t addrlen)
+{
+  if (Io_SetNonBlocking(fd))
+    return -1;
+  int const prev_state = CSC369_InterruptsDisable();
+  int const ret = connect(fd, addr, addrlen);
+  int const error = errno;
+  CSC369_InterruptsSet(prev_state);
+  if (ret == 0)
+    return 0;
+  // Even if the call was interrupted, the connection is still being made
+  if (error != EINPROGRESS && error != EINTR)
+    return Io_Return(ret, error);
+  if (Io_Wait(fd, CSC369_IO_WRITE))
+    return -1;
+
+  int result;
+  socklen_t len = sizeof(result);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &result, &len))
+    return -1;
+  if (result != 0) {
+    errno = result;
+    return -1;
+  }
+  return 0;
+}
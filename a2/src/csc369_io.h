@@ -0,0 +1,66 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines I/O on file descriptors that blocks only the calling thread.
+ *
+ * The wrappers put the file descriptor in non-blocking mode. When the operation
+ * would block, the calling thread sleeps until the file descriptor is ready
+ * and other threads run in the meantime. Otherwise, they behave like the system
+ * calls they wrap, returning -1 and setting errno on failure.
+ */
+#ifndef CSC369_IO_H
+#define CSC369_IO_H
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/**
+ * What a thread waits for a file descriptor to be ready for.
+ */
+typedef enum
+{
+  CSC369_IO_READ = 0,
+  CSC369_IO_WRITE = 1
+} CSC369_IoEvent;
+
+/**
+ * Suspend the calling thread until fd is ready for event (or has an error or
+ * was hung up), and run other threads in the meantime. Unlike
+ * CSC369_ThreadSleep, it may be called when no other thread can run.
+ *
+ * This function may fail if:
+ *  - there is no memory available (CSC369_ERROR_SYS_MEM), or
+ *  - fd cannot be waited on, e.g., it is not open (CSC369_ERROR_OTHER, and
+ * errno is set)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_WaitFd(int fd, CSC369_IoEvent event);
+
+/**
+ * Read up to count bytes from fd into buf, as read(2).
+ */
+ssize_t
+CSC369_Read(int fd, void* buf, size_t count);
+
+/**
+ * Write up to count bytes from buf to fd, as write(2).
+ */
+ssize_t
+CSC369_Write(int fd, void const* buf, size_t count);
+
+/**
+ * Accept a connection on the listening socket fd, as accept(2).
+ */
+int
+CSC369_Accept(int fd, struct sockaddr* addr, socklen_t* addrlen);
+
+/**
+ * Connect the socket fd to addr, as connect(2), sleeping until the connection
+ * is made or fails.
+ */
+int
+CSC369_Connect(int fd, struct sockaddr const* addr, socklen_t addrlen);
+
+#endif // CSC369_IO_H
@@ -0,0 +1,215 @@
+#include "csc369_poll.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "csc369_interrupts.h"
+
+#ifdef NDEBUG
+#define assert(x) do { (void)sizeof(x);} while (0)
+#else
+#include <assert.h>
+#endif
+
+// The events that wake up readers
+#define CSC369_POLL_READ_EVENTS (EPOLLIN | EPOLLRDHUP)
+
+//****************************************************************************
+// Private Global Variables (Library State)
+//****************************************************************************
+/**
+ * The epoll instance, created when a thread first waits on a file descriptor.
+ */
+int poller_epoll_fd = -1;
+
+/**
+ * The state of each file descriptor, indexed by the file descriptor, or NULL if
+ * no thread has waited on it.
+ */
+PollFd** poller_fds = NULL;
+
+int poller_fds_num = 0;
+
+/**
+ * The number of file descriptors with events armed.
+ */
+int poller_armed = 0;
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+/**
+ * Replace the events armed for fd with events.
+ *
+ * @return 0 on success, -1 if epoll failed (and errno is set).
+ */
+int
+PollFd_Rearm(int fd, PollFd* pfd, unsigned int events)
+{
+  struct epoll_event event = { 0 };
+  event.events = events | EPOLLONESHOT;
+  event.data.fd = fd;
+  // The registration outlives the one-shot event, but not the file descriptor
+  if (epoll_ctl(poller_epoll_fd, EPOLL_CTL_MOD, fd, &event) &&
+      (errno != ENOENT || epoll_ctl(poller_epoll_fd, EPOLL_CTL_ADD, fd, &event)))
+    return -1;
+
+  if (pfd->events == 0)
+    poller_armed++;
+  pfd->events = events;
+  return 0;
+}
+
+/**
+ * Grow the table of file descriptors to include fd.
+ *
+ * @return 0 on success, -1 if there is no memory available.
+ */
+int
+Poller_Grow(int fd)
+{
+  int num = poller_fds_num > 0 ? poller_fds_num : 16;
+  while (num <= fd)
+    num *= 2;
+  PollFd** fds = realloc(poller_fds, num * sizeof(PollFd*));
+  if (fds == NULL)
+    return -1;
+  for (int i = poller_fds_num; i < num; i++)
+    fds[i] = NULL;
+  poller_fds = fds;
+  poller_fds_num = num;
+  return 0;
+}
+
+//****************************************************************************
+// poll.h Functions
+//****************************************************************************
+PollFd*
+Poller_Get(int fd)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  assert(fd >= 0);
+  if (fd >= poller_fds_num && Poller_Grow(fd))
+    return NULL;
+  if (poller_fds[fd] != NULL)
+    return poller_fds[fd];
+
+  PollFd* pfd = malloc(sizeof(PollFd));
+  if (pfd == NULL)
+    return NULL;
+  pfd->readers = CSC369_WaitQueueCreate();
+  pfd->writers = CSC369_WaitQueueCreate();
+  if (pfd->readers == NULL || pfd->writers == NULL) {
+    if (pfd->readers != NULL)
+      CSC369_WaitQueueDestroy(pfd->readers);
+    if (pfd->writers != NULL)
+      CSC369_WaitQueueDestroy(pfd->writers);
+    free(pfd);
+    return NULL;
+  }
+  pfd->events = 0;
+  pfd->waiting[CSC369_IO_READ] = 0;
+  pfd->waiting[CSC369_IO_WRITE] = 0;
+  poller_fds[fd] = pfd;
+  return pfd;
+}
+
+int
+Poller_Arm(int fd, PollFd* pfd, CSC369_IoEvent event)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (poller_epoll_fd < 0) {
+    poller_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poller_epoll_fd < 0)
+      return -1;
+  }
+  // Always tell epoll, in case fd was closed and reused since it was armed
+  unsigned int const events =
+    event == CSC369_IO_WRITE ? EPOLLOUT : CSC369_POLL_READ_EVENTS;
+  if (PollFd_Rearm(fd, pfd, pfd->events | events))
+    return -1;
+  pfd->waiting[event]++;
+  return 0;
+}
+
+void
+Poller_Leave(int fd, CSC369_IoEvent event)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  PollFd* pfd = poller_fds[fd];
+  pfd->waiting[event]--;
+  if (pfd->waiting[CSC369_IO_READ] > 0 || pfd->waiting[CSC369_IO_WRITE] > 0 ||
+      pfd->events == 0)
+    return;
+
+  // Nothing is left to wake up, so stop polling fd. It may have been closed,
+  // in which case epoll already forgot it and could never report it again.
+  epoll_ctl(poller_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  pfd->events = 0;
+  poller_armed--;
+}
+
+int
+Poller_IsArmed(void)
+{
+  return poller_armed > 0;
+}
+
+int
+Poller_Collect(struct epoll_event* events, int timeout)
+{
+  if (poller_epoll_fd < 0)
+    return 0;
+  int num = epoll_wait(poller_epoll_fd, events, CSC369_POLL_EVENTS, timeout);
+  return num < 0 ? 0 : num;
+}
+
+void
+Poller_Dispatch(struct epoll_event* events, int num)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  for (int i = 0; i < num; i++) {
+    int const fd = events[i].data.fd;
+    unsigned int const ready = events[i].events;
+    PollFd* pfd = poller_fds[fd];
+    if (pfd->events == 0) // reported twice in one batch
+      continue;
+    unsigned int armed = pfd->events;
+    pfd->events = 0;
+    poller_armed--;
+
+    if (ready & (EPOLLERR | EPOLLHUP)) {
+      // Every waiter sees the error or end of file
+      CSC369_ThreadWakeAll(pfd->readers);
+      CSC369_ThreadWakeAll(pfd->writers);
+      continue;
+    }
+    // Wake one thread at a time. While others still wait, stay armed to wake
+    // the next once the first has had its turn.
+    if (ready & CSC369_POLL_READ_EVENTS) {
+      CSC369_ThreadWakeNext(pfd->readers);
+      if (pfd->waiting[CSC369_IO_READ] == 0)
+        armed &= ~CSC369_POLL_READ_EVENTS;
+    }
+    if (ready & EPOLLOUT) {
+      CSC369_ThreadWakeNext(pfd->writers);
+      if (pfd->waiting[CSC369_IO_WRITE] == 0)
+        armed &= ~EPOLLOUT;
+    }
+    if (armed != 0 && PollFd_Rearm(fd, pfd, armed)) {
+      // The waiters find out what went wrong when they retry
+      CSC369_ThreadWakeAll(pfd->readers);
+      CSC369_ThreadWakeAll(pfd->writers);
+    }
+  }
+}
+
+int
+Poller_Poll(void)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  struct epoll_event events[CSC369_POLL_EVENTS];
+  int const num = Poller_Collect(events, 0);
+  Poller_Dispatch(events, num);
+  return num;
+}
@@ -0,0 +1,104 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines the poller that wakes up threads waiting on file descriptors.
+ *
+ * Each file descriptor that threads have waited on has a wait queue for readers
+ * and one for writers. The poller registers the events they wait for with
+ * epoll, one-shot, and when an event is reported wakes up the first thread of
+ * the matching queue (or every thread, on an error or hangup). Interest in an
+ * event is re-armed as long as threads still wait for it, and dropped as soon
+ * as none do, even if they left without an event (e.g., were killed). All
+ * functions here except Poller_Collect must be called with interrupts disabled.
+ */
+#ifndef CSC369_POLL_H
+#define CSC369_POLL_H
+
+#include <sys/epoll.h>
+
+#include "csc369_io.h"
+#include "csc369_thread.h"
+
+/**
+ * The most events collected by one call to epoll_wait.
+ */
+#define CSC369_POLL_EVENTS 64
+
+typedef struct
+{
+  CSC369_WaitQueue* readers;
+
+  CSC369_WaitQueue* writers;
+
+  /**
+   * The epoll events armed for this file descriptor, or 0.
+   */
+  unsigned int events;
+
+  /**
+   * The number of threads waiting for each CSC369_IoEvent.
+   */
+  int waiting[2];
+} PollFd;
+
+/**
+ * @return the state of fd, or NULL if there is no memory available.
+ */
+PollFd*
+Poller_Get(int fd);
+
+/**
+ * @return the queue that threads waiting for event on pfd sleep on.
+ */
+static inline CSC369_WaitQueue*
+PollFd_Queue(PollFd* pfd, CSC369_IoEvent event)
+{
+  return event == CSC369_IO_WRITE ? pfd->writers : pfd->readers;
+}
+
+/**
+ * Arm event for fd, in addition to the events already armed, and count the
+ * calling thread as waiting for it.
+ *
+ * @return 0 on success, -1 if epoll failed (and errno is set).
+ */
+int
+Poller_Arm(int fd, PollFd* pfd, CSC369_IoEvent event);
+
+/**
+ * Stop counting a thread, which was woken up or killed, as waiting for event
+ * on fd. Once no thread waits on fd, its events are disarmed.
+ */
+void
+Poller_Leave(int fd, CSC369_IoEvent event);
+
+/**
+ * @return whether events are armed on any file descriptor.
+ */
+int
+Poller_IsArmed(void);
+
+/**
+ * Wait up to timeout milliseconds (forever if negative) for armed events.
+ * Interrupts may be enabled.
+ *
+ * @return the number of events stored in events, at most CSC369_POLL_EVENTS.
+ */
+int
+Poller_Collect(struct epoll_event* events, int timeout);
+
+/**
+ * Wake up the threads waiting for the collected events.
+ */
+void
+Poller_Dispatch(struct epoll_event* events, int num);
+
+/**
+ * Collect events without waiting, and dispatch them.
+ *
+ * @return the number of events.
+ */
+int
+Poller_Poll(void);
+
+#endif // CSC369_POLL_H
@@ -0,0 +1,654 @@
+#include "csc369_sched.h"
+
+#include <stddef.h>
+#include <time.h>
+
+#include "csc369_interrupts.h"
+
+#ifdef NDEBUG
+#define assert(x) do { (void)sizeof(x);} while (0)
+#else
+#include <assert.h>
+#endif
+
+//****************************************************************************
+// Private Global Variables (Library State)
+//****************************************************************************
+/**
+ * The number of times a thread has been preempted by an interrupt.
+ */
+unsigned int sched_mlfq_ticks = 0;
+
+/**
+ * Incremented by every MLFQ priority boost. An entity or run queue that has
+ * seen an older epoch has not been boosted yet.
+ */
+unsigned int sched_mlfq_boost_epoch = 0;
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+void
+SchedList_Append(SchedList* list, SchedEntity* entity)
+{
+  assert(entity->list == NULL);
+  entity->prev = list->tail;
+  entity->next = NULL;
+  if (list->tail == NULL)
+    list->head = entity;
+  else
+    list->tail->next = entity;
+  list->tail = entity;
+  entity->list = list;
+}
+
+void
+SchedList_Unlink(SchedEntity* entity)
+{
+  SchedList* list = entity->list;
+  assert(list != NULL);
+  if (entity->prev == NULL)
+    list->head = entity->next;
+  else
+    entity->prev->next = entity->next;
+  if (entity->next == NULL)
+    list->tail = entity->prev;
+  else
+    entity->next->prev = entity->prev;
+  entity->next = NULL;
+  entity->prev = NULL;
+  entity->list = NULL;
+}
+
+/**
+ * @return the first entity in list that is not pinned, or NULL.
+ */
+SchedEntity*
+SchedList_FindStealable(SchedList* list)
+{
+  for (SchedEntity* entity = list->head; entity != NULL; entity = entity->next)
+    if (entity->pinned_worker < 0)
+      return entity;
+  return NULL;
+}
+
+//****************************************************************************
+// FIFO Policy
+//****************************************************************************
+void
+Fifo_Enqueue(RunQueue* rq, SchedEntity* entity, SchedReason reason)
+{
+  (void)reason;
+  SchedList_Append(&rq->lists[0], entity);
+}
+
+SchedEntity*
+Fifo_Dequeue(RunQueue* rq)
+{
+  SchedEntity* entity = rq->lists[0].head;
+  SchedList_Unlink(entity);
+  return entity;
+}
+
+SchedEntity*
+Fifo_Steal(RunQueue* rq)
+{
+  SchedEntity* entity = SchedList_FindStealable(&rq->lists[0]);
+  if (entity != NULL)
+    SchedList_Unlink(entity);
+  return entity;
+}
+
+void
+Fifo_Remove(RunQueue* rq, SchedEntity* entity)
+{
+  (void)rq;
+  SchedList_Unlink(entity);
+}
+
+SchedPolicy const sched_fifo = {
+  .enqueue = &Fifo_Enqueue,
+  .dequeue = &Fifo_Dequeue,
+  .steal = &Fifo_Steal,
+  .remove = &Fifo_Remove,
+};
+
+//****************************************************************************
+// Multi-Level Feedback Queue Policy
+//
+// A thread starts at the highest priority (level 0). Each interrupt that
+// preempts it counts against its allotment at its level, 2^level interrupts,
+// and a thread that uses up its allotment moves down a level. A thread that
+// blocks or yields before being preempted keeps its level. Every
+// CSC369_SCHED_MLFQ_BOOST_TICKS interrupts, all threads move back to level 0 so
+// that threads at low levels are not starved.
+//****************************************************************************
+/**
+ * Move every entity of rq to level 0, if rq has not seen the latest boost.
+ */
+void
+Mlfq_Boost(RunQueue* rq)
+{
+  if (rq->boost_epoch == sched_mlfq_boost_epoch)
+    return;
+  rq->boost_epoch = sched_mlfq_boost_epoch;
+  for (int level = 1; level < CSC369_SCHED_MLFQ_LEVELS; level++) {
+    while (rq->lists[level].head != NULL) {
+      SchedEntity* entity = rq->lists[level].head;
+      SchedList_Unlink(entity);
+      entity->level = 0;
+      entity->ticks = 0;
+      entity->boost_epoch = sched_mlfq_boost_epoch;
+      SchedList_Append(&rq->lists[0], entity);
+    }
+  }
+}
+
+void
+Mlfq_Enqueue(RunQueue* rq, SchedEntity* entity, SchedReason reason)
+{
+  if (reason == SCHED_REASON_PREEMPTED) {
+    if (++sched_mlfq_ticks % CSC369_SCHED_MLFQ_BOOST_TICKS == 0)
+      sched_mlfq_boost_epoch++;
+    if (++entity->ticks >= (1 << entity->level) &&
+        entity->level < CSC369_SCHED_MLFQ_LEVELS - 1) {
+      entity->level++;
+      entity->ticks = 0;
+    }
+  }
+  if (reason == SCHED_REASON_NEW || entity->boost_epoch != sched_mlfq_boost_epoch) {
+    entity->level = 0;
+    entity->ticks = 0;
+    entity->boost_epoch = sched_mlfq_boost_epoch;
+  }
+  Mlfq_Boost(rq);
+  SchedList_Append(&rq->lists[entity->level], entity);
+}
+
+SchedEntity*
+Mlfq_Dequeue(RunQueue* rq)
+{
+  Mlfq_Boost(rq);
+  for (int level = 0; level < CSC369_SCHED_MLFQ_LEVELS; level++) {
+    SchedEntity* entity = rq->lists[level].head;
+    if (entity != NULL) {
+      SchedList_Unlink(entity);
+      return entity;
+    }
+  }
+  assert(0);
+  return NULL;
+}
+
+SchedEntity*
+Mlfq_Steal(RunQueue* rq)
+{
+  for (int level = 0; level < CSC369_SCHED_MLFQ_LEVELS; level++) {
+    SchedEntity* entity = SchedList_FindStealable(&rq->lists[level]);
+    if (entity != NULL) {
+      SchedList_Unlink(entity);
+      return entity;
+    }
+  }
+  return NULL;
+}
+
+SchedPolicy const sched_mlfq = {
+  .enqueue = &Mlfq_Enqueue,
+  .dequeue = &Mlfq_Dequeue,
+  .steal = &Mlfq_Steal,
+  .remove = &Fifo_Remove,
+};
+
+//****************************************************************************
+// Red-Black Tree (ordered by vruntime, equal keys in insertion order)
+//****************************************************************************
+void
+Rb_RotateLeft(RunQueue* rq, SchedEntity* x)
+{
+  SchedEntity* y = x->rb_right;
+  x->rb_right = y->rb_left;
+  if (y->rb_left != NULL)
+    y->rb_left->rb_parent = x;
+  y->rb_parent = x->rb_parent;
+  if (x->rb_parent == NULL)
+    rq->root = y;
+  else if (x == x->rb_parent->rb_left)
+    x->rb_parent->rb_left = y;
+  else
+    x->rb_parent->rb_right = y;
+  y->rb_left = x;
+  x->rb_parent = y;
+}
+
+void
+Rb_RotateRight(RunQueue* rq, SchedEntity* x)
+{
+  SchedEntity* y = x->rb_left;
+  x->rb_left = y->rb_right;
+  if (y->rb_right != NULL)
+    y->rb_right->rb_parent = x;
+  y->rb_parent = x->rb_parent;
+  if (x->rb_parent == NULL)
+    rq->root = y;
+  else if (x == x->rb_parent->rb_right)
+    x->rb_parent->rb_right = y;
+  else
+    x->rb_parent->rb_left = y;
+  y->rb_right = x;
+  x->rb_parent = y;
+}
+
+int
+Rb_IsRed(SchedEntity* node)
+{
+  return node != NULL && node->rb_red;
+}
+
+/**
+ * @return the entity after node in vruntime order, or NULL.
+ */
+SchedEntity*
+Rb_Next(SchedEntity* node)
+{
+  if (node->rb_right != NULL) {
+    node = node->rb_right;
+    while (node->rb_left != NULL)
+      node = node->rb_left;
+    return node;
+  }
+  while (node->rb_parent != NULL && node == node->rb_parent->rb_right)
+    node = node->rb_parent;
+  return node->rb_parent;
+}
+
+/**
+ * @return the entity with the greatest vruntime, or NULL if rq is empty.
+ */
+SchedEntity*
+Rb_Last(RunQueue* rq)
+{
+  SchedEntity* node = rq->root;
+  while (node != NULL && node->rb_right != NULL)
+    node = node->rb_right;
+  return node;
+}
+
+void
+Rb_Insert(RunQueue* rq, SchedEntity* node)
+{
+  SchedEntity** link = &rq->root;
+  SchedEntity* parent = NULL;
+  int leftmost = 1;
+  while (*link != NULL) {
+    parent = *link;
+    if (node->vruntime < parent->vruntime) {
+      link = &parent->rb_left;
+    } else {
+      link = &parent->rb_right;
+      leftmost = 0;
+    }
+  }
+  node->rb_parent = parent;
+  node->rb_left = NULL;
+  node->rb_right = NULL;
+  node->rb_red = 1;
+  *link = node;
+  if (leftmost)
+    rq->leftmost = node;
+
+  while (Rb_IsRed(node->rb_parent)) {
+    parent = node->rb_parent;
+    SchedEntity* grandparent = parent->rb_parent;
+    if (parent == grandparent->rb_left) {
+      SchedEntity* uncle = grandparent->rb_right;
+      if (Rb_IsRed(uncle)) {
+        parent->rb_red = 0;
+        uncle->rb_red = 0;
+        grandparent->rb_red = 1;
+        node = grandparent;
+        continue;
+      }
+      if (node == parent->rb_right) {
+        Rb_RotateLeft(rq, parent);
+        node = parent;
+        parent = node->rb_parent;
+      }
+      parent->rb_red = 0;
+      grandparent->rb_red = 1;
+      Rb_RotateRight(rq, grandparent);
+    } else {
+      SchedEntity* uncle = grandparent->rb_left;
+      if (Rb_IsRed(uncle)) {
+        parent->rb_red = 0;
+        uncle->rb_red = 0;
+        grandparent->rb_red = 1;
+        node = grandparent;
+        continue;
+      }
+      if (node == parent->rb_left) {
+        Rb_RotateRight(rq, parent);
+        node = parent;
+        parent = node->rb_parent;
+      }
+      parent->rb_red = 0;
+      grandparent->rb_red = 1;
+      Rb_RotateLeft(rq, grandparent);
+    }
+  }
+  rq->root->rb_red = 0;
+}
+
+/**
+ * Put v (which may be NULL) where u is in the tree.
+ */
+void
+Rb_Transplant(RunQueue* rq, SchedEntity* u, SchedEntity* v)
+{
+  if (u->rb_parent == NULL)
+    rq->root = v;
+  else if (u == u->rb_parent->rb_left)
+    u->rb_parent->rb_left = v;
+  else
+    u->rb_parent->rb_right = v;
+  if (v != NULL)
+    v->rb_parent = u->rb_parent;
+}
+
+void
+Rb_Erase(RunQueue* rq, SchedEntity* node)
+{
+  if (rq->leftmost == node)
+    rq->leftmost = Rb_Next(node);
+
+  // x takes the place of a removed black node, which may unbalance the tree
+  SchedEntity* x;
+  SchedEntity* parent;
+  int removed_red = node->rb_red;
+  if (node->rb_left == NULL) {
+    x = node->rb_right;
+    parent = node->rb_parent;
+    Rb_Transplant(rq, node, node->rb_right);
+  } else if (node->rb_right == NULL) {
+    x = node->rb_left;
+    parent = node->rb_parent;
+    Rb_Transplant(rq, node, node->rb_left);
+  } else {
+    SchedEntity* next = node->rb_right;
+    while (next->rb_left != NULL)
+      next = next->rb_left;
+    removed_red = next->rb_red;
+    x = next->rb_right;
+    if (next->rb_parent == node) {
+      parent = next;
+    } else {
+      parent = next->rb_parent;
+      Rb_Transplant(rq, next, next->rb_right);
+      next->rb_right = node->rb_right;
+      next->rb_right->rb_parent = next;
+    }
+    Rb_Transplant(rq, node, next);
+    next->rb_left = node->rb_left;
+    next->rb_left->rb_parent = next;
+    next->rb_red = node->rb_red;
+  }
+
+  if (removed_red)
+    return;
+  while (x != rq->root && !Rb_IsRed(x)) {
+    if (x == parent->rb_left) {
+      SchedEntity* sibling = parent->rb_right;
+      if (sibling->rb_red) {
+        sibling->rb_red = 0;
+        parent->rb_red = 1;
+        Rb_RotateLeft(rq, parent);
+        sibling = parent->rb_right;
+      }
+      if (!Rb_IsRed(sibling->rb_left) && !Rb_IsRed(sibling->rb_right)) {
+        sibling->rb_red = 1;
+        x = parent;
+        parent = x->rb_parent;
+        continue;
+      }
+      if (!Rb_IsRed(sibling->rb_right)) {
+        sibling->rb_left->rb_red = 0;
+        sibling->rb_red = 1;
+        Rb_RotateRight(rq, sibling);
+        sibling = parent->rb_right;
+      }
+      sibling->rb_red = parent->rb_red;
+      parent->rb_red = 0;
+      sibling->rb_right->rb_red = 0;
+      Rb_RotateLeft(rq, parent);
+    } else {
+      SchedEntity* sibling = parent->rb_left;
+      if (sibling->rb_red) {
+        sibling->rb_red = 0;
+        parent->rb_red = 1;
+        Rb_RotateRight(rq, parent);
+        sibling = parent->rb_left;
+      }
+      if (!Rb_IsRed(sibling->rb_left) && !Rb_IsRed(sibling->rb_right)) {
+        sibling->rb_red = 1;
+        x = parent;
+        parent = x->rb_parent;
+        continue;
+      }
+      if (!Rb_IsRed(sibling->rb_left)) {
+        sibling->rb_right->rb_red = 0;
+        sibling->rb_red = 1;
+        Rb_RotateLeft(rq, sibling);
+        sibling = parent->rb_left;
+      }
+      sibling->rb_red = parent->rb_red;
+      parent->rb_red = 0;
+      sibling->rb_left->rb_red = 0;
+      Rb_RotateRight(rq, parent);
+    }
+    x = rq->root;
+  }
+  if (x != NULL)
+    x->rb_red = 0;
+}
+
+//****************************************************************************
+// Fair Policy
+//
+// Every thread accumulates virtual runtime: the time it has run, scaled down by
+// its weight. The ready thread with the least virtual runtime runs next, which
+// is the leftmost entity of the run queue's tree, so switching is O(log n).
+//****************************************************************************
+/**
+ * @return the current time in nanoseconds.
+ */
+uint64_t
+Sched_Now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void
+Fair_UpdateMin(RunQueue* rq, SchedEntity* running)
+{
+  uint64_t min = running != NULL ? running->vruntime : UINT64_MAX;
+  if (rq->leftmost != NULL && rq->leftmost->vruntime < min)
+    min = rq->leftmost->vruntime;
+  if (min != UINT64_MAX && min > rq->min_vruntime)
+    rq->min_vruntime = min;
+}
+
+void
+Fair_Enqueue(RunQueue* rq, SchedEntity* entity, SchedReason reason)
+{
+  if (reason == SCHED_REASON_NEW) {
+    entity->vruntime = rq->min_vruntime;
+  } else if (rq->min_vruntime > CSC369_SCHED_FAIR_WAKEUP_CREDIT &&
+             entity->vruntime < rq->min_vruntime - CSC369_SCHED_FAIR_WAKEUP_CREDIT) {
+    // It slept for a long time, or comes from another worker
+    entity->vruntime = rq->min_vruntime - CSC369_SCHED_FAIR_WAKEUP_CREDIT;
+  }
+
+  if (reason == SCHED_REASON_YIELDED) {
+    // A yielding thread runs again after all threads that are ready now
+    SchedEntity* last = Rb_Last(rq);
+    if (last != NULL && entity->vruntime < last->vruntime)
+      entity->vruntime = last->vruntime;
+  }
+  Rb_Insert(rq, entity);
+}
+
+SchedEntity*
+Fair_Dequeue(RunQueue* rq)
+{
+  SchedEntity* entity = rq->leftmost;
+  Rb_Erase(rq, entity);
+  Fair_UpdateMin(rq, entity);
+  return entity;
+}
+
+SchedEntity*
+Fair_Steal(RunQueue* rq)
+{
+  for (SchedEntity* entity = rq->leftmost; entity != NULL; entity = Rb_Next(entity)) {
+    if (entity->pinned_worker < 0) {
+      Rb_Erase(rq, entity);
+      return entity;
+    }
+  }
+  return NULL;
+}
+
+void
+Fair_Remove(RunQueue* rq, SchedEntity* entity)
+{
+  Rb_Erase(rq, entity);
+}
+
+void
+Fair_Start(RunQueue* rq, SchedEntity* entity)
+{
+  (void)rq;
+  entity->exec_start = Sched_Now();
+}
+
+void
+Fair_Stop(RunQueue* rq, SchedEntity* entity)
+{
+  uint64_t const now = Sched_Now();
+  if (now > entity->exec_start) {
+    entity->vruntime +=
+      (now - entity->exec_start) * CSC369_THREAD_DEFAULT_WEIGHT / entity->weight;
+  }
+  entity->exec_start = now;
+  Fair_UpdateMin(rq, entity);
+}
+
+SchedPolicy const sched_fair = {
+  .enqueue = &Fair_Enqueue,
+  .dequeue = &Fair_Dequeue,
+  .steal = &Fair_Steal,
+  .remove = &Fair_Remove,
+  .start = &Fair_Start,
+  .stop = &Fair_Stop,
+};
+
+//****************************************************************************
+// sched.h Functions
+//****************************************************************************
+SchedPolicy const*
+Sched_Policy(CSC369_SchedPolicy kind)
+{
+  switch (kind) {
+    case CSC369_SCHED_FIFO:
+      return &sched_fifo;
+    case CSC369_SCHED_MLFQ:
+      return &sched_mlfq;
+    case CSC369_SCHED_FAIR:
+      return &sched_fair;
+  }
+  return NULL;
+}
+
+void
+SchedEntity_Init(SchedEntity* entity)
+{
+  entity->next = NULL;
+  entity->prev = NULL;
+  entity->list = NULL;
+  entity->rq = NULL;
+  entity->pinned_worker = -1;
+  entity->level = 0;
+  entity->ticks = 0;
+  entity->boost_epoch = 0;
+  entity->rb_parent = NULL;
+  entity->rb_left = NULL;
+  entity->rb_right = NULL;
+  entity->rb_red = 0;
+  entity->vruntime = 0;
+  entity->exec_start = 0;
+  entity->weight = CSC369_THREAD_DEFAULT_WEIGHT;
+}
+
+void
+RunQueue_Init(RunQueue* rq, SchedPolicy const* policy)
+{
+  rq->policy = policy;
+  rq->num = 0;
+  for (int i = 0; i < CSC369_SCHED_MLFQ_LEVELS; i++) {
+    rq->lists[i].head = NULL;
+    rq->lists[i].tail = NULL;
+  }
+  rq->boost_epoch = 0;
+  rq->root = NULL;
+  rq->leftmost = NULL;
+  rq->min_vruntime = 0;
+}
+
+void
+RunQueue_Enqueue(RunQueue* rq, SchedEntity* entity, SchedReason reason)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  assert(entity->rq == NULL);
+  rq->policy->enqueue(rq, entity, reason);
+  entity->rq = rq;
+  rq->num++;
+}
+
+SchedEntity*
+RunQueue_Dequeue(RunQueue* rq)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (rq->num == 0)
+    return NULL;
+  SchedEntity* entity = rq->policy->dequeue(rq);
+  entity->rq = NULL;
+  rq->num--;
+  return entity;
+}
+
+SchedEntity*
+RunQueue_Steal(RunQueue* rq)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (rq->num == 0)
+    return NULL;
+  SchedEntity* entity = rq->policy->steal(rq);
+  if (entity != NULL) {
+    entity->rq = NULL;
+    rq->num--;
+  }
+  return entity;
+}
+
+void
+RunQueue_Remove(SchedEntity* entity)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  RunQueue* rq = entity->rq;
+  assert(rq != NULL);
+  rq->policy->remove(rq, entity);
+  entity->rq = NULL;
+  rq->num--;
+}
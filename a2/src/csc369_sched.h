@@ -0,0 +1,236 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines the scheduling policies that order ready threads.
+ *
+ * Each worker keeps its ready threads in a RunQueue. The policy of the run
+ * queue decides where a thread that becomes ready is placed, and which thread
+ * runs next. All functions here must be called with interrupts disabled.
+ */
+#ifndef CSC369_SCHED_H
+#define CSC369_SCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csc369_thread.h"
+
+/**
+ * The number of priority levels of the MLFQ policy.
+ */
+#define CSC369_SCHED_MLFQ_LEVELS 4
+
+/**
+ * How many interrupts (across all workers) pass between MLFQ priority boosts,
+ * which move every thread back to the highest priority.
+ */
+#define CSC369_SCHED_MLFQ_BOOST_TICKS 50
+
+/**
+ * How far behind the least virtual runtime of a run queue, in nanoseconds, a
+ * thread that wakes up may be placed. This gives threads that sleep often a
+ * small head start, without letting one monopolize the CPU after a long sleep.
+ */
+#define CSC369_SCHED_FAIR_WAKEUP_CREDIT 1000000
+
+/**
+ * Why a thread is being made ready.
+ */
+typedef enum
+{
+  SCHED_REASON_NEW = 0,
+  SCHED_REASON_WOKEN = 1,
+  SCHED_REASON_YIELDED = 2,
+  SCHED_REASON_PREEMPTED = 3
+} SchedReason;
+
+struct csc369_run_queue_t;
+
+/**
+ * The scheduling state of a thread, embedded in its TCB.
+ */
+typedef struct csc369_sched_entity_t
+{
+  struct csc369_sched_entity_t* next;
+
+  struct csc369_sched_entity_t* prev;
+
+  /**
+   * The list this entity is on, or NULL.
+   */
+  struct csc369_sched_list_t* list;
+
+  /**
+   * The run queue this entity is on, or NULL.
+   */
+  struct csc369_run_queue_t* rq;
+
+  /**
+   * The worker this thread must next run on, or -1 if it can run on any. A
+   * thread that is preempted by an interrupt may be in the middle of code that
+   * uses its worker's thread-local storage (e.g., errno or malloc state), so it
+   * is never stolen by another worker.
+   */
+  int pinned_worker;
+
+  /**
+   * The MLFQ priority level, 0 being the highest.
+   */
+  int level;
+
+  /**
+   * The number of interrupts taken at the current level.
+   */
+  int ticks;
+
+  unsigned int boost_epoch;
+
+  /**
+   * The fair policy's red-black tree links, ordered by vruntime.
+   */
+  struct csc369_sched_entity_t* rb_parent;
+
+  struct csc369_sched_entity_t* rb_left;
+
+  struct csc369_sched_entity_t* rb_right;
+
+  int rb_red;
+
+  /**
+   * The time this thread has run, in nanoseconds, scaled by
+   * CSC369_THREAD_DEFAULT_WEIGHT / weight.
+   */
+  uint64_t vruntime;
+
+  /**
+   * When the thread last started running, in nanoseconds.
+   */
+  uint64_t exec_start;
+
+  int weight;
+} SchedEntity;
+
+typedef struct csc369_sched_list_t
+{
+  SchedEntity* head;
+  SchedEntity* tail;
+} SchedList;
+
+/**
+ * A scheduling policy.
+ */
+typedef struct
+{
+  void (*enqueue)(struct csc369_run_queue_t* rq, SchedEntity* entity, SchedReason reason);
+
+  /**
+   * @return the entity to run next, which must be removed from rq.
+   */
+  SchedEntity* (*dequeue)(struct csc369_run_queue_t* rq);
+
+  /**
+   * @return an entity that is not pinned, which must be removed from rq, or
+   * NULL if there is none.
+   */
+  SchedEntity* (*steal)(struct csc369_run_queue_t* rq);
+
+  void (*remove)(struct csc369_run_queue_t* rq, SchedEntity* entity);
+
+  /**
+   * Called when the thread of entity starts running on the worker of rq, and
+   * when it stops, or NULL if the policy does not track running time.
+   */
+  void (*start)(struct csc369_run_queue_t* rq, SchedEntity* entity);
+
+  void (*stop)(struct csc369_run_queue_t* rq, SchedEntity* entity);
+} SchedPolicy;
+
+/**
+ * The ready threads of a worker.
+ */
+typedef struct csc369_run_queue_t
+{
+  SchedPolicy const* policy;
+
+  int num;
+
+  /**
+   * FIFO uses the first list only, MLFQ has a list per level.
+   */
+  SchedList lists[CSC369_SCHED_MLFQ_LEVELS];
+
+  unsigned int boost_epoch;
+
+  /**
+   * The fair policy's tree of entities, and its leftmost (least vruntime) one.
+   */
+  SchedEntity* root;
+
+  SchedEntity* leftmost;
+
+  /**
+   * A lower bound on the vruntime of the entities of rq that only increases.
+   */
+  uint64_t min_vruntime;
+} RunQueue;
+
+/**
+ * @return the policy implementing kind.
+ */
+SchedPolicy const*
+Sched_Policy(CSC369_SchedPolicy kind);
+
+void
+SchedEntity_Init(SchedEntity* entity);
+
+void
+RunQueue_Init(RunQueue* rq, SchedPolicy const* policy);
+
+static inline int
+RunQueue_IsEmpty(RunQueue* rq)
+{
+  return rq->num == 0;
+}
+
+void
+RunQueue_Enqueue(RunQueue* rq, SchedEntity* entity, SchedReason reason);
+
+/**
+ * @return the entity to run next, or NULL if rq is empty.
+ */
+SchedEntity*
+RunQueue_Dequeue(RunQueue* rq);
+
+/**
+ * @return an entity that another worker can run, or NULL if there is none.
+ */
+SchedEntity*
+RunQueue_Steal(RunQueue* rq);
+
+/**
+ * Remove entity from the run queue it is on.
+ */
+void
+RunQueue_Remove(SchedEntity* entity);
+
+/**
+ * The thread of entity starts running on the worker of rq.
+ */
+static inline void
+RunQueue_Start(RunQueue* rq, SchedEntity* entity)
+{
+  if (rq->policy->start != NULL)
+    rq->policy->start(rq, entity);
+}
+
+/**
+ * The thread of entity stops running on the worker of rq.
+ */
+static inline void
+RunQueue_Stop(RunQueue* rq, SchedEntity* entity)
+{
+  if (rq->policy->stop != NULL)
+    rq->policy->stop(rq, entity);
+}
+
+#endif // CSC369_SCHED_H
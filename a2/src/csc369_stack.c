@@ -0,0 +1,191 @@
+#include "csc369_stack.h"
+
+#include <stdlib.h>
+
+#ifdef CSC369_THREAD_STACK_POOL
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "csc369_interrupts.h"
+
+#ifdef NDEBUG
+#define assert(x) do { (void)sizeof(x);} while (0)
+#else
+#include <assert.h>
+#endif
+
+#ifdef CSC369_THREAD_STACK_POOL
+//****************************************************************************
+// Private Definitions
+//****************************************************************************
+
+/**
+ * The maximum number of distinct stack sizes that are pooled.
+ */
+#define CSC369_STACK_POOL_SIZES 8
+
+/**
+ * The header of a pooled stack, stored at the lowest address of the stack.
+ */
+typedef struct csc369_free_stack_t
+{
+  struct csc369_free_stack_t* next;
+} FreeStack;
+
+/**
+ * The free stacks of one size, in two lists, each most recently freed first:
+ * those whose memory is still resident, which are handed out first, and those
+ * whose memory was given back.
+ */
+typedef struct
+{
+  size_t size;
+
+  FreeStack* resident;
+
+  int resident_num;
+
+  FreeStack* cold;
+} StackPool;
+
+//****************************************************************************
+// Private Global Variables (Library State)
+//****************************************************************************
+StackPool stack_pools[CSC369_STACK_POOL_SIZES];
+
+int stack_pools_num = 0;
+
+int stack_pool_high_water = CSC369_STACK_POOL_HIGH_WATER;
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+size_t
+Stack_PageSize(void)
+{
+  static size_t page_size = 0;
+  if (page_size == 0)
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+/**
+ * @return the pool for stacks of size bytes, or NULL if there is none and
+ * create is 0 or there are no pools left.
+ */
+StackPool*
+StackPool_Find(size_t size, int create)
+{
+  for (int i = 0; i < stack_pools_num; i++)
+    if (stack_pools[i].size == size)
+      return &stack_pools[i];
+
+  if (!create || stack_pools_num == CSC369_STACK_POOL_SIZES)
+    return NULL;
+  StackPool* pool = &stack_pools[stack_pools_num++];
+  pool->size = size;
+  pool->resident = NULL;
+  pool->resident_num = 0;
+  pool->cold = NULL;
+  return pool;
+}
+
+//****************************************************************************
+// stack.h Functions
+//****************************************************************************
+void*
+Stack_Alloc(size_t size)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  size_t const page_size = Stack_PageSize();
+  size = (size + page_size - 1) & ~(page_size - 1);
+
+  StackPool* pool = StackPool_Find(size, 0);
+  if (pool != NULL && pool->resident != NULL) {
+    FreeStack* stack = pool->resident;
+    pool->resident = stack->next;
+    pool->resident_num--;
+    return stack;
+  }
+  if (pool != NULL && pool->cold != NULL) {
+    FreeStack* stack = pool->cold;
+    pool->cold = stack->next;
+    return stack;
+  }
+
+  // The guard page sits below the stack, since the stack grows down into it
+  char* mapping = mmap(NULL,
+                       size + page_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+                       -1,
+                       0);
+  if (mapping == MAP_FAILED)
+    return NULL;
+  if (mprotect(mapping, page_size, PROT_NONE)) {
+    munmap(mapping, size + page_size);
+    return NULL;
+  }
+  return mapping + page_size;
+}
+
+void
+Stack_Free(void* stack, size_t size)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (stack == NULL)
+    return;
+  size_t const page_size = Stack_PageSize();
+  size = (size + page_size - 1) & ~(page_size - 1);
+
+  StackPool* pool = StackPool_Find(size, 1);
+  if (pool == NULL) {
+    munmap((char*)stack - page_size, size + page_size);
+    return;
+  }
+
+  FreeStack* free_stack = stack;
+  if (pool->resident_num < stack_pool_high_water) {
+    free_stack->next = pool->resident;
+    pool->resident = free_stack;
+    pool->resident_num++;
+    return;
+  }
+  // Keep the page holding the header, give back the rest
+  if (size > page_size)
+    madvise((char*)stack + page_size, size - page_size, MADV_DONTNEED);
+  free_stack->next = pool->cold;
+  pool->cold = free_stack;
+}
+
+void
+CSC369_StackPoolSetHighWater(int count)
+{
+  stack_pool_high_water = count < 0 ? 0 : count;
+}
+
+#else
+
+void*
+Stack_Alloc(size_t size)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  return malloc(size);
+}
+
+void
+Stack_Free(void* stack, size_t size)
+{
+  (void)size;
+  assert(!CSC369_InterruptsAreEnabled());
+  free(stack);
+}
+
+void
+CSC369_StackPoolSetHighWater(int count)
+{
+  (void)count;
+}
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines the allocator for thread stacks.
+ *
+ * By default, stacks are allocated with malloc.
+ *
+ * When CSC369_THREAD_STACK_POOL is defined, stacks are instead mapped with mmap
+ * below a PROT_NONE guard page, so that an overflow faults instead of silently
+ * corrupting the heap. Freed stacks are kept in a pool per stack size and are
+ * handed out again, most recently freed first, while they are still hot. Stacks
+ * whose memory was given back are only handed out once no resident ones are
+ * left.
+ */
+#ifndef CSC369_STACK_H
+#define CSC369_STACK_H
+
+#include <stddef.h>
+
+/**
+ * The default number of free stacks of each size whose memory is kept resident.
+ */
+#define CSC369_STACK_POOL_HIGH_WATER 16
+
+/**
+ * Allocate a stack of at least size bytes.
+ *
+ * @return The lowest address of the stack on success, NULL otherwise.
+ *
+ * @pre Interrupts are disabled.
+ */
+void*
+Stack_Alloc(size_t size);
+
+/**
+ * Free a stack returned by Stack_Alloc(size).
+ *
+ * @pre Interrupts are disabled.
+ */
+void
+Stack_Free(void* stack, size_t size);
+
+/**
+ * Set how many free stacks of each size keep their memory. The memory of any
+ * further stacks freed into a pool is given back to the operating system (with
+ * MADV_DONTNEED) until they are reused.
+ *
+ * This has no effect unless the library is built with CSC369_THREAD_STACK_POOL.
+ *
+ * @param count The number of free stacks per size to keep resident.
+ */
+void
+CSC369_StackPoolSetHighWater(int count);
+
+#endif // CSC369_STACK_H
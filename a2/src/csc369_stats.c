@@ -0,0 +1,58 @@
+#include "csc369_stats.h"
+
+//****************************************************************************
+// Private Global Variables
+//****************************************************************************
+/**
+ * The time at Stats_InitClock, in cycles and in nanoseconds.
+ */
+uint64_t stats_start_cycles;
+
+uint64_t stats_start_nsec;
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+/**
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+uint64_t
+Stats_MonotonicNsec(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//****************************************************************************
+// stats.h Functions
+//****************************************************************************
+void
+Stats_InitClock(void)
+{
+  stats_start_nsec = Stats_MonotonicNsec();
+  stats_start_cycles = Stats_Now();
+}
+
+void
+Stats_Init(ThreadStats* stats, uint64_t now)
+{
+  stats->since = now;
+  stats->run = 0;
+  stats->ready = 0;
+  stats->blocked = 0;
+  stats->voluntary = 0;
+  stats->preempted = 0;
+  stats->wakeups = 0;
+}
+
+long long
+Stats_Nsec(uint64_t cycles)
+{
+  // The longer since initialization, the more precise the rate
+  uint64_t const elapsed_cycles = Stats_Now() - stats_start_cycles;
+  uint64_t const elapsed_nsec = Stats_MonotonicNsec() - stats_start_nsec;
+  if (elapsed_cycles == 0)
+    return 0;
+  return (long long)((double)cycles * elapsed_nsec / elapsed_cycles);
+}
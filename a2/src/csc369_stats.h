@@ -0,0 +1,84 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines the per-thread scheduler statistics kept in each TCB.
+ *
+ * Time is measured in cycles of the CPU's timestamp counter, which is read
+ * once per change of a thread's state, so that statistics are cheap enough to
+ * always keep. Cycles are converted to nanoseconds only when the statistics are
+ * read, by comparing the counter with CLOCK_MONOTONIC since initialization.
+ */
+#ifndef CSC369_STATS_H
+#define CSC369_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+typedef struct
+{
+  /**
+   * When the thread entered its current state.
+   */
+  uint64_t since;
+
+  /**
+   * The time spent running, ready, and blocked.
+   */
+  uint64_t run;
+
+  uint64_t ready;
+
+  uint64_t blocked;
+
+  /**
+   * The number of times the thread gave up the CPU itself (by yielding,
+   * sleeping, or blocking), and the number of times it was preempted.
+   */
+  long voluntary;
+
+  long preempted;
+
+  /**
+   * The number of times the thread was woken up after blocking.
+   */
+  long wakeups;
+} ThreadStats;
+
+/**
+ * @return the current time, in cycles.
+ */
+static inline uint64_t
+Stats_Now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/**
+ * Record the start of time, against which cycles are converted.
+ */
+void
+Stats_InitClock(void);
+
+/**
+ * Clear stats, starting in the current state now.
+ */
+void
+Stats_Init(ThreadStats* stats, uint64_t now);
+
+/**
+ * @return cycles in nanoseconds.
+ */
+long long
+Stats_Nsec(uint64_t cycles);
+
+#endif // CSC369_STATS_H
@@ -0,0 +1,635 @@
+#include "csc369_sync.h"
+
+#include <limits.h>
+
+#include "csc369_futex.h"
+#include "csc369_interrupts.h"
+
+#ifdef NDEBUG
+#define assert(x) do { (void)sizeof(x);} while (0)
+#else
+#include <assert.h>
+#endif
+
+// The bit of a reader-writer lock's state set while a writer holds it
+#define RWLOCK_WRITER (1 << 30)
+// The bit of a reader-writer lock's state set while threads may be waiting
+#define RWLOCK_CONTENDED (1 << 29)
+// The bits of a reader-writer lock's state that count the readers holding it
+#define RWLOCK_READERS (RWLOCK_CONTENDED - 1)
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+/**
+ * Atomically replace *ptr with desired if it equals expected.
+ *
+ * @return 1 if *ptr was replaced, 0 otherwise.
+ */
+static inline int
+Atomic_Swap(volatile int* ptr, int expected, int desired, int memorder)
+{
+  return __atomic_compare_exchange_n(
+    ptr, &expected, desired, 0, memorder, __ATOMIC_RELAXED);
+}
+
+/**
+ * Lock the mutex after the fast path failed, sleeping until it is handed over.
+ *
+ * @pre Interrupts are disabled.
+ */
+int
+Mutex_LockSlow(CSC369_Mutex* mutex)
+{
+  // Only this path moves the state to 2, and only the unlock slow path moves it
+  // away from 2, both with interrupts disabled. The fast paths only switch
+  // between 0 and 1, so the compare-and-swaps below retry if they race one.
+  while (1) {
+    if (Atomic_Swap(&mutex->state, 0, 1, __ATOMIC_ACQUIRE))
+      break;
+    if (mutex->state == 2 || Atomic_Swap(&mutex->state, 1, 2, __ATOMIC_RELAXED)) {
+      mutex->waiters++;
+      int ret = CSC369_ThreadSleep(mutex->queue);
+      if (ret < 0) {
+        // No other thread can run, so nothing can change the state meanwhile
+        if (--mutex->waiters == 0)
+          mutex->state = 1;
+        return ret;
+      }
+      // The unlocking thread handed the mutex over to us
+      break;
+    }
+  }
+
+  mutex->owner = CSC369_ThreadId();
+  return 0;
+}
+
+/**
+ * Unlock the mutex after the fast path failed, handing it to the first waiter.
+ *
+ * @pre Interrupts are disabled, and the state of the mutex is 2.
+ */
+void
+Mutex_UnlockSlow(CSC369_Mutex* mutex)
+{
+  if (CSC369_ThreadWakeNext(mutex->queue)) {
+    // The mutex stays locked, now on behalf of the woken thread
+    if (--mutex->waiters == 0)
+      __atomic_store_n(&mutex->state, 1, __ATOMIC_RELEASE);
+  } else {
+    // The waiters were killed
+    mutex->waiters = 0;
+    __atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+  }
+}
+
+/**
+ * Hand the reader-writer lock, which is being given up by its holders, to the
+ * waiting threads: all the waiting readers at once if readers_first and there
+ * are any, or else the first waiting writer, or else all the waiting readers.
+ *
+ * @pre Interrupts are disabled, and no thread holds the lock other than the
+ * caller, which is unlocking it.
+ */
+void
+RWLock_Grant(CSC369_RWLock* rwlock, int readers_first)
+{
+  int state = 0;
+  if (readers_first && rwlock->readers_waiting > 0) {
+    state = CSC369_FutexWake(&rwlock->readers_waiting, INT_MAX);
+    rwlock->readers_waiting = 0;
+  }
+  if (state == 0 && rwlock->writers_waiting > 0) {
+    if (CSC369_FutexWake(&rwlock->writers_waiting, 1)) {
+      rwlock->writers_waiting--;
+      state = RWLOCK_WRITER;
+    } else {
+      // The waiters were killed
+      rwlock->writers_waiting = 0;
+    }
+  }
+  if (state == 0 && rwlock->readers_waiting > 0) {
+    state = CSC369_FutexWake(&rwlock->readers_waiting, INT_MAX);
+    rwlock->readers_waiting = 0;
+  }
+
+  if (rwlock->readers_waiting > 0 || rwlock->writers_waiting > 0)
+    state |= RWLOCK_CONTENDED;
+  __atomic_store_n(&rwlock->state, state, __ATOMIC_RELEASE);
+}
+
+/**
+ * Mark the reader-writer lock contended, then count the calling thread in
+ * *waiting and sleep on waiting until the lock is handed over.
+ *
+ * @return 0 if the lock was handed over, a positive value to retry, or the
+ * error of CSC369_FutexWait.
+ *
+ * @pre Interrupts are disabled, and a writer holds the lock or threads wait.
+ */
+int
+RWLock_Wait(CSC369_RWLock* rwlock, int state, volatile int* waiting)
+{
+  if (!(state & RWLOCK_CONTENDED) &&
+      !Atomic_Swap(&rwlock->state, state, state | RWLOCK_CONTENDED, __ATOMIC_RELAXED))
+    return 1;
+
+  // *waiting only changes with interrupts disabled, so it is still as expected
+  int const ret = CSC369_FutexWait(waiting, ++(*waiting));
+  if (ret < 0) {
+    // No other thread can run, so nothing can change the state meanwhile
+    if (--(*waiting) == 0 && rwlock->readers_waiting + rwlock->writers_waiting == 0)
+      __atomic_fetch_and(&rwlock->state, ~RWLOCK_CONTENDED, __ATOMIC_RELAXED);
+    return ret;
+  }
+  // The unlocking thread handed the lock over to us
+  return 0;
+}
+
+/**
+ * Lock the reader-writer lock for reading after the fast path failed.
+ *
+ * @pre Interrupts are disabled.
+ */
+int
+RWLock_ReadLockSlow(CSC369_RWLock* rwlock)
+{
+  // Only the slow paths set the contended bit, and only RWLock_Grant clears it,
+  // all with interrupts disabled. The fast paths fail while it is set.
+  while (1) {
+    int const state = rwlock->state;
+    if (!(state & (RWLOCK_WRITER | RWLOCK_CONTENDED))) {
+      if (Atomic_Swap(&rwlock->state, state, state + 1, __ATOMIC_ACQUIRE))
+        return 0;
+      continue;
+    }
+    if (state == RWLOCK_CONTENDED) {
+      // The last holder unlocked it, but has not handed it over yet
+      RWLock_Grant(rwlock, 0);
+      continue;
+    }
+    int const ret = RWLock_Wait(rwlock, state, &rwlock->readers_waiting);
+    if (ret <= 0)
+      return ret;
+  }
+}
+
+/**
+ * Lock the reader-writer lock for writing after the fast path failed.
+ *
+ * @pre Interrupts are disabled.
+ */
+int
+RWLock_WriteLockSlow(CSC369_RWLock* rwlock)
+{
+  while (1) {
+    int const state = rwlock->state;
+    if (state == 0) {
+      if (Atomic_Swap(&rwlock->state, 0, RWLOCK_WRITER, __ATOMIC_ACQUIRE))
+        break;
+      continue;
+    }
+    if (state == RWLOCK_CONTENDED) {
+      RWLock_Grant(rwlock, 0);
+      continue;
+    }
+    int const ret = RWLock_Wait(rwlock, state, &rwlock->writers_waiting);
+    if (ret < 0)
+      return ret;
+    if (ret == 0)
+      break;
+  }
+
+  rwlock->writer = CSC369_ThreadId();
+  return 0;
+}
+
+//****************************************************************************
+// Mutex Definitions
+//****************************************************************************
+int
+CSC369_MutexInit(CSC369_Mutex* mutex)
+{
+  assert(mutex != NULL);
+  mutex->queue = CSC369_WaitQueueCreate();
+  if (mutex->queue == NULL)
+    return CSC369_ERROR_SYS_MEM;
+  mutex->state = 0;
+  mutex->owner = -1;
+  mutex->waiters = 0;
+  return 0;
+}
+
+int
+CSC369_MutexDestroy(CSC369_Mutex* mutex)
+{
+  assert(mutex != NULL);
+  if (mutex->state != 0)
+    return CSC369_ERROR_OTHER;
+  return CSC369_WaitQueueDestroy(mutex->queue);
+}
+
+int
+CSC369_MutexLock(CSC369_Mutex* mutex)
+{
+  assert(mutex != NULL);
+  if (Atomic_Swap(&mutex->state, 0, 1, __ATOMIC_ACQUIRE)) {
+    mutex->owner = CSC369_ThreadId();
+    return 0;
+  }
+  if (mutex->owner == CSC369_ThreadId())
+    return CSC369_ERROR_THREAD_BAD;
+
+  int prev_state = CSC369_InterruptsDisable();
+  int ret = Mutex_LockSlow(mutex);
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+int
+CSC369_MutexTryLock(CSC369_Mutex* mutex)
+{
+  assert(mutex != NULL);
+  if (!Atomic_Swap(&mutex->state, 0, 1, __ATOMIC_ACQUIRE))
+    return 0;
+  mutex->owner = CSC369_ThreadId();
+  return 1;
+}
+
+int
+CSC369_MutexUnlock(CSC369_Mutex* mutex)
+{
+  assert(mutex != NULL);
+  if (mutex->owner != CSC369_ThreadId())
+    return CSC369_ERROR_THREAD_BAD;
+
+  mutex->owner = -1;
+  if (Atomic_Swap(&mutex->state, 1, 0, __ATOMIC_RELEASE))
+    return 0;
+
+  int prev_state = CSC369_InterruptsDisable();
+  Mutex_UnlockSlow(mutex);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+//****************************************************************************
+// Condition Variable Definitions
+//****************************************************************************
+int
+CSC369_CondInit(CSC369_Cond* cond)
+{
+  assert(cond != NULL);
+  cond->queue = CSC369_WaitQueueCreate();
+  return cond->queue == NULL ? CSC369_ERROR_SYS_MEM : 0;
+}
+
+int
+CSC369_CondDestroy(CSC369_Cond* cond)
+{
+  assert(cond != NULL);
+  return CSC369_WaitQueueDestroy(cond->queue);
+}
+
+int
+CSC369_CondWait(CSC369_Cond* cond, CSC369_Mutex* mutex)
+{
+  assert(cond != NULL);
+  assert(mutex != NULL);
+
+  // A signal cannot be missed between unlocking and sleeping, as waking up
+  // threads also disables interrupts
+  int prev_state = CSC369_InterruptsDisable();
+  int ret = CSC369_MutexUnlock(mutex);
+  if (ret < 0) {
+    CSC369_InterruptsSet(prev_state);
+    return ret;
+  }
+  ret = CSC369_ThreadSleep(cond->queue);
+  CSC369_InterruptsSet(prev_state);
+
+  int lock_ret = CSC369_MutexLock(mutex);
+  return ret < 0 ? ret : lock_ret;
+}
+
+int
+CSC369_CondSignal(CSC369_Cond* cond)
+{
+  assert(cond != NULL);
+  return CSC369_ThreadWakeNext(cond->queue);
+}
+
+int
+CSC369_CondBroadcast(CSC369_Cond* cond)
+{
+  assert(cond != NULL);
+  return CSC369_ThreadWakeAll(cond->queue);
+}
+
+//****************************************************************************
+// Semaphore Definitions
+//****************************************************************************
+int
+CSC369_SemaInit(CSC369_Sema* sema, int value)
+{
+  assert(sema != NULL);
+  if (value < 0)
+    return CSC369_ERROR_OTHER;
+  sema->queue = CSC369_WaitQueueCreate();
+  if (sema->queue == NULL)
+    return CSC369_ERROR_SYS_MEM;
+  sema->value = value;
+  sema->wakeups = 0;
+  return 0;
+}
+
+int
+CSC369_SemaDestroy(CSC369_Sema* sema)
+{
+  assert(sema != NULL);
+  return CSC369_WaitQueueDestroy(sema->queue);
+}
+
+int
+CSC369_SemaWait(CSC369_Sema* sema)
+{
+  assert(sema != NULL);
+  if (__atomic_fetch_sub(&sema->value, 1, __ATOMIC_ACQUIRE) > 0)
+    return 0;
+
+  // We are counted as a waiter, so the next post hands its unit to us. If it
+  // came before we could sleep, it is left in wakeups instead.
+  int prev_state = CSC369_InterruptsDisable();
+  int ret = 0;
+  if (sema->wakeups > 0) {
+    sema->wakeups--;
+  } else {
+    ret = CSC369_ThreadSleep(sema->queue);
+    if (ret < 0) {
+      // No other thread can run, so nothing can post meanwhile
+      __atomic_fetch_add(&sema->value, 1, __ATOMIC_RELAXED);
+    } else {
+      ret = 0;
+    }
+  }
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+void
+CSC369_SemaPost(CSC369_Sema* sema)
+{
+  assert(sema != NULL);
+  if (__atomic_fetch_add(&sema->value, 1, __ATOMIC_RELEASE) >= 0)
+    return;
+
+  int prev_state = CSC369_InterruptsDisable();
+  if (!CSC369_ThreadWakeNext(sema->queue))
+    sema->wakeups++;
+  CSC369_InterruptsSet(prev_state);
+}
+
+//****************************************************************************
+// Reader-Writer Lock Definitions
+//****************************************************************************
+int
+CSC369_RWLockInit(CSC369_RWLock* rwlock)
+{
+  assert(rwlock != NULL);
+  rwlock->state = 0;
+  rwlock->writer = -1;
+  rwlock->readers_waiting = 0;
+  rwlock->writers_waiting = 0;
+  return 0;
+}
+
+int
+CSC369_RWLockDestroy(CSC369_RWLock* rwlock)
+{
+  assert(rwlock != NULL);
+  if (rwlock->state != 0)
+    return CSC369_ERROR_OTHER;
+  return 0;
+}
+
+int
+CSC369_RWLockReadLock(CSC369_RWLock* rwlock)
+{
+  assert(rwlock != NULL);
+  int const state = rwlock->state;
+  if (!(state & (RWLOCK_WRITER | RWLOCK_CONTENDED)) &&
+      Atomic_Swap(&rwlock->state, state, state + 1, __ATOMIC_ACQUIRE))
+    return 0;
+  if (rwlock->writer == CSC369_ThreadId())
+    return CSC369_ERROR_THREAD_BAD;
+
+  int prev_state = CSC369_InterruptsDisable();
+  int ret = RWLock_ReadLockSlow(rwlock);
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+int
+CSC369_RWLockTryReadLock(CSC369_RWLock* rwlock)
+{
+  assert(rwlock != NULL);
+  int state;
+  do {
+    state = rwlock->state;
+    if (state & (RWLOCK_WRITER | RWLOCK_CONTENDED))
+      return 0;
+  } while (!Atomic_Swap(&rwlock->state, state, state + 1, __ATOMIC_ACQUIRE));
+  return 1;
+}
+
+int
+CSC369_RWLockReadUnlock(CSC369_RWLock* rwlock)
+{
+  assert(rwlock != NULL);
+  if (!(rwlock->state & RWLOCK_READERS))
+    return CSC369_ERROR_THREAD_BAD;
+  if (__atomic_sub_fetch(&rwlock->state, 1, __ATOMIC_RELEASE) != RWLOCK_CONTENDED)
+    return 0;
+
+  // We were the last reader and threads wait, unless a slow path handed the
+  // lock over first
+  int prev_state = CSC369_InterruptsDisable();
+  if (rwlock->state == RWLOCK_CONTENDED)
+    RWLock_Grant(rwlock, 0);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+int
+CSC369_RWLockWriteLock(CSC369_RWLock* rwlock)
+{
+  assert(rwlock != NULL);
+  if (Atomic_Swap(&rwlock->state, 0, RWLOCK_WRITER, __ATOMIC_ACQUIRE)) {
+    rwlock->writer = CSC369_ThreadId();
+    return 0;
+  }
+  if (rwlock->writer == CSC369_ThreadId())
+    return CSC369_ERROR_THREAD_BAD;
+
+  int prev_state = CSC369_InterruptsDisable();
+  int ret = RWLock_WriteLockSlow(rwlock);
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+int
+CSC369_RWLockTryWriteLock(CSC369_RWLock* rwlock)
+{
+  assert(rwlock != NULL);
+  if (!Atomic_Swap(&rwlock->state, 0, RWLOCK_WRITER, __ATOMIC_ACQUIRE))
+    return 0;
+  rwlock->writer = CSC369_ThreadId();
+  return 1;
+}
+
+int
+CSC369_RWLockWriteUnlock(CSC369_RWLock* rwlock)
+{
+  assert(rwlock != NULL);
+  if (rwlock->writer != CSC369_ThreadId())
+    return CSC369_ERROR_THREAD_BAD;
+
+  rwlock->writer = -1;
+  if (Atomic_Swap(&rwlock->state, RWLOCK_WRITER, 0, __ATOMIC_RELEASE))
+    return 0;
+
+  // Admit the readers that waited for us before the next writer
+  int prev_state = CSC369_InterruptsDisable();
+  RWLock_Grant(rwlock, 1);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+//****************************************************************************
+// Barrier Definitions
+//****************************************************************************
+int
+CSC369_BarrierInit(CSC369_Barrier* barrier, int count)
+{
+  assert(barrier != NULL);
+  if (count <= 0)
+    return CSC369_ERROR_OTHER;
+  barrier->count = count;
+  barrier->arrived = 0;
+  barrier->sense = 0;
+  return 0;
+}
+
+int
+CSC369_BarrierDestroy(CSC369_Barrier* barrier)
+{
+  assert(barrier != NULL);
+  if (barrier->arrived != 0)
+    return CSC369_ERROR_OTHER;
+  return 0;
+}
+
+int
+CSC369_BarrierWait(CSC369_Barrier* barrier)
+{
+  assert(barrier != NULL);
+  // The sense cannot flip before we arrive, so this is the sense of our phase
+  int const sense = barrier->sense;
+  if (__atomic_add_fetch(&barrier->arrived, 1, __ATOMIC_ACQ_REL) == barrier->count) {
+    // No thread can arrive for the next phase until the sense flips
+    barrier->arrived = 0;
+    int prev_state = CSC369_InterruptsDisable();
+    __atomic_store_n(&barrier->sense, !sense, __ATOMIC_RELEASE);
+    CSC369_FutexWake(&barrier->sense, INT_MAX);
+    CSC369_InterruptsSet(prev_state);
+    return 1;
+  }
+
+  // The last thread flips the sense with interrupts disabled, so it cannot
+  // flip between checking it and going to sleep
+  int prev_state = CSC369_InterruptsDisable();
+  int ret = 0;
+  while (barrier->sense == sense) {
+    ret = CSC369_FutexWait(&barrier->sense, sense);
+    if (ret < 0) {
+      // No other thread can run, so nothing can arrive meanwhile
+      __atomic_fetch_sub(&barrier->arrived, 1, __ATOMIC_RELAXED);
+      break;
+    }
+    ret = 0;
+  }
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+//****************************************************************************
+// Latch Definitions
+//****************************************************************************
+int
+CSC369_LatchInit(CSC369_Latch* latch, int count)
+{
+  assert(latch != NULL);
+  if (count < 0)
+    return CSC369_ERROR_OTHER;
+  latch->count = count;
+  latch->waiters = 0;
+  return 0;
+}
+
+int
+CSC369_LatchDestroy(CSC369_Latch* latch)
+{
+  assert(latch != NULL);
+  // Threads woken by the latch opening may not have left CSC369_LatchWait yet
+  if (latch->count > 0 && latch->waiters > 0)
+    return CSC369_ERROR_OTHER;
+  return 0;
+}
+
+int
+CSC369_LatchCountDown(CSC369_Latch* latch, int n)
+{
+  assert(latch != NULL);
+  int count;
+  do {
+    count = latch->count;
+    if (n < 0 || n > count)
+      return CSC369_ERROR_OTHER;
+  } while (!Atomic_Swap(&latch->count, count, count - n, __ATOMIC_RELEASE));
+
+  if (n > 0 && count == n) {
+    // A waiter that has not gone to sleep yet sees the count changed
+    CSC369_FutexWake(&latch->count, INT_MAX);
+  }
+  return 0;
+}
+
+int
+CSC369_LatchWait(CSC369_Latch* latch)
+{
+  assert(latch != NULL);
+  if (__atomic_load_n(&latch->count, __ATOMIC_ACQUIRE) == 0)
+    return 0;
+
+  int prev_state = CSC369_InterruptsDisable();
+  int ret = 0;
+  latch->waiters++;
+  for (int count; (count = latch->count) > 0;) {
+    // The count may be lowered meanwhile without interrupts disabled
+    ret = CSC369_FutexWait(&latch->count, count);
+    if (ret < 0 && ret != CSC369_ERROR_WOULD_BLOCK)
+      break;
+    ret = 0;
+  }
+  latch->waiters--;
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+int
+CSC369_LatchTryWait(CSC369_Latch* latch)
+{
+  assert(latch != NULL);
+  return __atomic_load_n(&latch->count, __ATOMIC_ACQUIRE) == 0;
+}
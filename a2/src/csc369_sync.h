@@ -0,0 +1,472 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines blocking synchronization primitives for CSC369 threads.
+ *
+ * The mutex, condition variable and semaphore are each built on a
+ * CSC369_WaitQueue. The reader-writer lock, barrier and latch instead sleep on
+ * the addresses of their own fields (see csc369_futex.h), so they take no
+ * memory beyond their struct. Uncontended operations are a single atomic
+ * instruction and do not disable interrupts; only a thread that has to wait
+ * disables them and goes to sleep. When a mutex is unlocked
+ * or a semaphore is posted while threads are waiting, the lock or unit is
+ * handed directly to the first waiter, so woken threads never race for it.
+ * Likewise, a reader-writer lock is handed to the next writer or to all the
+ * waiting readers at once, and a barrier or latch that opens moves all its
+ * waiters to the ready queues in a single batch.
+ */
+#ifndef CSC369_SYNC_H
+#define CSC369_SYNC_H
+
+#include "csc369_thread.h"
+
+/**
+ * A mutual exclusion lock.
+ */
+typedef struct
+{
+  /**
+   * 0 if unlocked, 1 if locked, 2 if locked and threads may be waiting.
+   */
+  volatile int state;
+
+  /**
+   * The thread holding the lock, or -1.
+   */
+  Tid owner;
+
+  int waiters;
+
+  CSC369_WaitQueue* queue;
+} CSC369_Mutex;
+
+/**
+ * A condition variable.
+ */
+typedef struct
+{
+  CSC369_WaitQueue* queue;
+} CSC369_Cond;
+
+/**
+ * A counting semaphore.
+ */
+typedef struct
+{
+  /**
+   * The number of available units if non-negative, otherwise minus the number
+   * of waiting threads.
+   */
+  volatile int value;
+
+  /**
+   * Units posted to waiters that had not started sleeping yet.
+   */
+  int wakeups;
+
+  CSC369_WaitQueue* queue;
+} CSC369_Sema;
+
+/**
+ * A reader-writer lock, held either by any number of readers or by one writer.
+ *
+ * Writers are preferred: once a writer waits, new readers wait behind it
+ * rather than keep the lock read-held. When a writer unlocks, all the readers
+ * waiting at that point are admitted together, ahead of the next writer, so
+ * that readers do not starve either.
+ */
+typedef struct
+{
+  /**
+   * The number of readers holding the lock, with a bit set if a writer holds
+   * it, and another if threads may be waiting.
+   */
+  volatile int state;
+
+  /**
+   * The thread holding the lock for writing, or -1.
+   */
+  Tid writer;
+
+  /**
+   * The number of readers waiting, whose address they sleep on.
+   */
+  volatile int readers_waiting;
+
+  /**
+   * The number of writers waiting, whose address they sleep on.
+   */
+  volatile int writers_waiting;
+} CSC369_RWLock;
+
+/**
+ * A reusable barrier, at which a fixed number of threads wait for each other
+ * before moving on to the next phase of a computation.
+ *
+ * The barrier is sense-reversing: the last thread to arrive flips sense, which
+ * is what the waiters sleep on, so the same barrier is reused for every phase
+ * without being reset.
+ */
+typedef struct
+{
+  /**
+   * The number of threads that wait at the barrier in each phase.
+   */
+  int count;
+
+  /**
+   * The number of threads that arrived in the current phase.
+   */
+  volatile int arrived;
+
+  /**
+   * Flipped (between 0 and 1) whenever a phase completes. The waiters sleep on
+   * its address.
+   */
+  volatile int sense;
+} CSC369_Barrier;
+
+/**
+ * A single-use latch, which threads wait on until it has been counted down to
+ * 0, e.g., by the threads of a phase as each finishes its part.
+ */
+typedef struct
+{
+  /**
+   * The number of count downs left before the latch opens. The waiters sleep
+   * on its address.
+   */
+  volatile int count;
+
+  /**
+   * The number of threads sleeping until the latch opens.
+   */
+  int waiters;
+} CSC369_Latch;
+
+/**
+ * Initialize an unlocked mutex.
+ *
+ * @return 0 on success, CSC369_ERROR_SYS_MEM if there is no memory available.
+ */
+int
+CSC369_MutexInit(CSC369_Mutex* mutex);
+
+/**
+ * Free the resources of a mutex.
+ *
+ * This function may fail if:
+ *  - the mutex is locked (CSC369_ERROR_OTHER)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_MutexDestroy(CSC369_Mutex* mutex);
+
+/**
+ * Lock the mutex, sleeping until it is unlocked if necessary.
+ *
+ * This function may fail if:
+ *  - the calling thread already holds the mutex (CSC369_ERROR_THREAD_BAD), or
+ *  - there are no other threads that can run to unlock it
+ * (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_MutexLock(CSC369_Mutex* mutex);
+
+/**
+ * Lock the mutex if it is unlocked, without sleeping.
+ *
+ * @return 1 if the mutex was locked by this call, 0 otherwise.
+ */
+int
+CSC369_MutexTryLock(CSC369_Mutex* mutex);
+
+/**
+ * Unlock the mutex. If threads are waiting for it, the first one is woken up
+ * holding the mutex.
+ *
+ * This function may fail if:
+ *  - the calling thread does not hold the mutex (CSC369_ERROR_THREAD_BAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_MutexUnlock(CSC369_Mutex* mutex);
+
+/**
+ * Initialize a condition variable.
+ *
+ * @return 0 on success, CSC369_ERROR_SYS_MEM if there is no memory available.
+ */
+int
+CSC369_CondInit(CSC369_Cond* cond);
+
+/**
+ * Free the resources of a condition variable.
+ *
+ * This function may fail if:
+ *  - threads are waiting on the condition variable (CSC369_ERROR_OTHER)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_CondDestroy(CSC369_Cond* cond);
+
+/**
+ * Unlock the mutex and sleep until the condition variable is signalled, then
+ * lock the mutex again. Unlocking and starting to sleep happen atomically.
+ *
+ * This function may fail if:
+ *  - the calling thread does not hold the mutex (CSC369_ERROR_THREAD_BAD), or
+ *  - there are no other threads that can run to signal the condition variable
+ * (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code. The mutex is
+ * held when this function returns either way.
+ *
+ * @pre The calling thread holds mutex.
+ */
+int
+CSC369_CondWait(CSC369_Cond* cond, CSC369_Mutex* mutex);
+
+/**
+ * Wake up the first thread waiting on the condition variable.
+ *
+ * @return The number of threads woken up, which can be 0.
+ */
+int
+CSC369_CondSignal(CSC369_Cond* cond);
+
+/**
+ * Wake up all threads waiting on the condition variable.
+ *
+ * @return The number of threads woken up, which can be 0.
+ */
+int
+CSC369_CondBroadcast(CSC369_Cond* cond);
+
+/**
+ * Initialize a semaphore with value available units.
+ *
+ * @return 0 on success, CSC369_ERROR_SYS_MEM if there is no memory available,
+ * or CSC369_ERROR_OTHER if value is negative.
+ */
+int
+CSC369_SemaInit(CSC369_Sema* sema, int value);
+
+/**
+ * Free the resources of a semaphore.
+ *
+ * This function may fail if:
+ *  - threads are waiting on the semaphore (CSC369_ERROR_OTHER)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_SemaDestroy(CSC369_Sema* sema);
+
+/**
+ * Take a unit from the semaphore, sleeping until one is posted if none are
+ * available.
+ *
+ * This function may fail if:
+ *  - there are no other threads that can run to post a unit
+ * (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_SemaWait(CSC369_Sema* sema);
+
+/**
+ * Post a unit to the semaphore. If threads are waiting, the unit is handed to
+ * the first one, which is woken up.
+ */
+void
+CSC369_SemaPost(CSC369_Sema* sema);
+
+/**
+ * Initialize an unlocked reader-writer lock.
+ *
+ * @return 0, as the lock needs no memory of its own.
+ */
+int
+CSC369_RWLockInit(CSC369_RWLock* rwlock);
+
+/**
+ * Destroy a reader-writer lock, which can then no longer be used.
+ *
+ * This function may fail if:
+ *  - the lock is held (CSC369_ERROR_OTHER)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_RWLockDestroy(CSC369_RWLock* rwlock);
+
+/**
+ * Lock the reader-writer lock for reading, sleeping while a writer holds it or
+ * waits for it.
+ *
+ * This function may fail if:
+ *  - the calling thread holds the lock for writing (CSC369_ERROR_THREAD_BAD),
+ * or
+ *  - there are no other threads that can run to unlock it
+ * (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_RWLockReadLock(CSC369_RWLock* rwlock);
+
+/**
+ * Lock the reader-writer lock for reading if no writer holds it or waits for
+ * it, without sleeping.
+ *
+ * @return 1 if the lock was locked by this call, 0 otherwise.
+ */
+int
+CSC369_RWLockTryReadLock(CSC369_RWLock* rwlock);
+
+/**
+ * Unlock the reader-writer lock, which the calling thread holds for reading.
+ * If it was the last reader and a writer is waiting, the writer is woken up
+ * holding the lock.
+ *
+ * This function may fail if:
+ *  - the lock is not held for reading (CSC369_ERROR_THREAD_BAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_RWLockReadUnlock(CSC369_RWLock* rwlock);
+
+/**
+ * Lock the reader-writer lock for writing, sleeping until no other thread
+ * holds it.
+ *
+ * This function may fail if:
+ *  - the calling thread already holds the lock for writing
+ * (CSC369_ERROR_THREAD_BAD), or
+ *  - there are no other threads that can run to unlock it
+ * (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_RWLockWriteLock(CSC369_RWLock* rwlock);
+
+/**
+ * Lock the reader-writer lock for writing if no thread holds it or waits for
+ * it, without sleeping.
+ *
+ * @return 1 if the lock was locked by this call, 0 otherwise.
+ */
+int
+CSC369_RWLockTryWriteLock(CSC369_RWLock* rwlock);
+
+/**
+ * Unlock the reader-writer lock, which the calling thread holds for writing.
+ * If readers are waiting, all of them are woken up holding the lock; otherwise
+ * the first waiting writer is.
+ *
+ * This function may fail if:
+ *  - the calling thread does not hold the lock for writing
+ * (CSC369_ERROR_THREAD_BAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_RWLockWriteUnlock(CSC369_RWLock* rwlock);
+
+/**
+ * Initialize a barrier for count threads.
+ *
+ * @return 0 on success, or CSC369_ERROR_OTHER if count is not positive.
+ */
+int
+CSC369_BarrierInit(CSC369_Barrier* barrier, int count);
+
+/**
+ * Destroy a barrier, which can then no longer be used.
+ *
+ * This function may fail if:
+ *  - threads are waiting at the barrier (CSC369_ERROR_OTHER)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_BarrierDestroy(CSC369_Barrier* barrier);
+
+/**
+ * Arrive at the barrier and sleep until count threads have arrived in this
+ * phase. The last thread to arrive does not sleep, and wakes up all the others
+ * at once. The barrier is then ready for the next phase.
+ *
+ * This function may fail if:
+ *  - there are no other threads that can run to arrive at the barrier
+ * (CSC369_ERROR_SYS_THREAD), in which case the calling thread is no longer
+ * counted as arrived
+ *
+ * @return 1 for the thread that arrived last, 0 for the others, or the
+ * appropriate error code.
+ */
+int
+CSC369_BarrierWait(CSC369_Barrier* barrier);
+
+/**
+ * Initialize a latch that opens after count count downs, or is open already if
+ * count is 0.
+ *
+ * @return 0 on success, or CSC369_ERROR_OTHER if count is negative.
+ */
+int
+CSC369_LatchInit(CSC369_Latch* latch, int count);
+
+/**
+ * Destroy a latch, which can then no longer be used.
+ *
+ * This function may fail if:
+ *  - threads are waiting on the latch (CSC369_ERROR_OTHER)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_LatchDestroy(CSC369_Latch* latch);
+
+/**
+ * Count the latch down by n. If that opens it, all the threads waiting on it
+ * are woken up at once.
+ *
+ * The calling thread continues to execute (i.e., it is not suspended).
+ *
+ * This function may fail if:
+ *  - n is negative or more than the count left (CSC369_ERROR_OTHER)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_LatchCountDown(CSC369_Latch* latch, int n);
+
+/**
+ * Sleep until the latch is open, or return at once if it is.
+ *
+ * This function may fail if:
+ *  - there are no other threads that can run to count the latch down
+ * (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_LatchWait(CSC369_Latch* latch);
+
+/**
+ * @return whether the latch is open (1) or not (0), without sleeping.
+ */
+int
+CSC369_LatchTryWait(CSC369_Latch* latch);
+
+#endif // CSC369_SYNC_H
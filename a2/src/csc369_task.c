@@ -0,0 +1,509 @@
+#include "csc369_task.h"
+
+#include <stdlib.h>
+
+#include "csc369_futex.h"
+#include "csc369_interrupts.h"
+
+#ifdef NDEBUG
+#define assert(x) do { (void)sizeof(x);} while (0)
+#else
+#include <assert.h>
+#endif
+
+//****************************************************************************
+// Private Definitions
+//****************************************************************************
+/**
+ * What CSC369_ParallelFor calls, shared by all the tasks that run a subrange.
+ */
+typedef struct
+{
+  CSC369_TaskPool* pool;
+
+  long grain;
+
+  void (*fn)(long, long, void*);
+
+  void* arg;
+
+  /**
+   * The error a task ran into while waiting for its halves, or 0.
+   */
+  int status;
+} TaskRange;
+
+typedef struct csc369_task_t
+{
+  /**
+   * The next task towards the bottom of the deque, or the next free task.
+   */
+  struct csc369_task_t* next;
+
+  /**
+   * The next task towards the top of the deque.
+   */
+  struct csc369_task_t* prev;
+
+  CSC369_TaskGroup* group;
+
+  void (*fn)(void*);
+
+  void* arg;
+
+  /**
+   * If not NULL, the task runs [begin, end) of this range instead of fn.
+   */
+  TaskRange* range;
+
+  long begin;
+
+  long end;
+} CSC369_Task;
+
+/**
+ * The tasks spawned by one thread. The owner pushes and pops at the bottom,
+ * while other threads steal from the top.
+ */
+typedef struct
+{
+  CSC369_Task* top;
+  CSC369_Task* bottom;
+} TaskDeque;
+
+typedef struct csc369_task_slab_t
+{
+  struct csc369_task_slab_t* next;
+  CSC369_Task tasks[CSC369_TASK_SLAB_SIZE];
+} TaskSlab;
+
+struct csc369_task_pool_t
+{
+  /**
+   * The threads of the pool, or -1 for those that have stopped running tasks
+   * and will not be joined.
+   */
+  Tid* threads;
+
+  int threads_num;
+
+  /**
+   * The index of each thread's deque, by identifier, up to max_tid, the
+   * largest identifier of the pool's threads. Other threads use the shared
+   * deque.
+   */
+  int* deque_of;
+
+  Tid max_tid;
+
+  /**
+   * One deque per thread of the pool, then one shared by the threads outside
+   * the pool.
+   */
+  TaskDeque* deques;
+
+  CSC369_Task* free_tasks;
+
+  TaskSlab* slabs;
+
+  /**
+   * The number of tasks that have been spawned and have not finished.
+   */
+  int tasks_num;
+
+  /**
+   * The pool threads that found no task to run.
+   */
+  CSC369_WaitQueue* idle;
+
+  int stopping;
+};
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+/**
+ * @return a free task, or NULL if there is no memory available.
+ */
+CSC369_Task*
+Pool_AllocTask(CSC369_TaskPool* pool)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (pool->free_tasks == NULL) {
+    TaskSlab* slab = malloc(sizeof(TaskSlab));
+    if (slab == NULL)
+      return NULL;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    for (int i = 0; i < CSC369_TASK_SLAB_SIZE; i++) {
+      slab->tasks[i].next = pool->free_tasks;
+      pool->free_tasks = &slab->tasks[i];
+    }
+  }
+
+  CSC369_Task* task = pool->free_tasks;
+  pool->free_tasks = task->next;
+  return task;
+}
+
+/**
+ * @return the index of the calling thread's deque in pool.
+ */
+int
+Pool_DequeOf(CSC369_TaskPool* pool)
+{
+  Tid const tid = CSC369_ThreadId();
+  return tid <= pool->max_tid ? pool->deque_of[tid] : pool->threads_num;
+}
+
+/**
+ * Map the identifiers of the threads of pool to their deques.
+ *
+ * @return 0 on success, CSC369_ERROR_SYS_MEM if there is no memory available.
+ */
+int
+Pool_MapDeques(CSC369_TaskPool* pool)
+{
+  Tid max_tid = 0;
+  for (int i = 0; i < pool->threads_num; i++) {
+    if (pool->threads[i] > max_tid)
+      max_tid = pool->threads[i];
+  }
+  pool->deque_of = malloc((max_tid + 1) * sizeof(int));
+  if (pool->deque_of == NULL)
+    return CSC369_ERROR_SYS_MEM;
+  for (Tid tid = 0; tid <= max_tid; tid++)
+    pool->deque_of[tid] = pool->threads_num;
+  for (int i = 0; i < pool->threads_num; i++)
+    pool->deque_of[pool->threads[i]] = i;
+  pool->max_tid = max_tid;
+  return 0;
+}
+
+void
+Deque_PushBottom(TaskDeque* deque, CSC369_Task* task)
+{
+  task->next = NULL;
+  task->prev = deque->bottom;
+  if (deque->bottom == NULL)
+    deque->top = task;
+  else
+    deque->bottom->next = task;
+  deque->bottom = task;
+}
+
+CSC369_Task*
+Deque_PopBottom(TaskDeque* deque)
+{
+  CSC369_Task* task = deque->bottom;
+  if (task == NULL)
+    return NULL;
+  deque->bottom = task->prev;
+  if (deque->bottom == NULL)
+    deque->top = NULL;
+  else
+    deque->bottom->next = NULL;
+  return task;
+}
+
+CSC369_Task*
+Deque_PopTop(TaskDeque* deque)
+{
+  CSC369_Task* task = deque->top;
+  if (task == NULL)
+    return NULL;
+  deque->top = task->next;
+  if (deque->top == NULL)
+    deque->bottom = NULL;
+  else
+    deque->top->prev = NULL;
+  return task;
+}
+
+/**
+ * @return the newest task of the deque at index, or else the oldest task of
+ * another deque, or NULL if there are no tasks.
+ */
+CSC369_Task*
+Pool_TakeTask(CSC369_TaskPool* pool, int index)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  CSC369_Task* task = Deque_PopBottom(&pool->deques[index]);
+  int const deques_num = pool->threads_num + 1;
+  for (int i = 1; task == NULL && i < deques_num; i++)
+    task = Deque_PopTop(&pool->deques[(index + i) % deques_num]);
+  return task;
+}
+
+/**
+ * Spawn a task in group, which calls fn(arg), or runs [begin, end) of range if
+ * range is not NULL.
+ *
+ * @return 0 on success, CSC369_ERROR_SYS_MEM if there is no memory available.
+ */
+int
+Task_Spawn(CSC369_TaskGroup* group,
+           void (*fn)(void*),
+           void* arg,
+           TaskRange* range,
+           long begin,
+           long end)
+{
+  CSC369_TaskPool* pool = group->pool;
+  int prev_state = CSC369_InterruptsDisable();
+  CSC369_Task* task = Pool_AllocTask(pool);
+  if (task == NULL) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_MEM;
+  }
+  task->group = group;
+  task->fn = fn;
+  task->arg = arg;
+  task->range = range;
+  task->begin = begin;
+  task->end = end;
+  Deque_PushBottom(&pool->deques[group->deque], task);
+  group->pending++;
+  pool->tasks_num++;
+  CSC369_ThreadWakeNext(pool->idle);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+/**
+ * Run [begin, end) of range, spawning the upper halves until what is left is
+ * at most one grain, then wait for the halves.
+ */
+void
+Range_Run(TaskRange* range, long begin, long end)
+{
+  CSC369_TaskGroup group;
+  CSC369_TaskGroupInit(&group, range->pool);
+  while (end - begin > range->grain) {
+    long const mid = begin + (end - begin) / 2;
+    // Without memory for a task, the rest is run here in one piece
+    if (Task_Spawn(&group, NULL, NULL, range, mid, end))
+      break;
+    end = mid;
+  }
+  range->fn(begin, end, range->arg);
+
+  int const ret = CSC369_Sync(&group);
+  if (ret < 0)
+    range->status = ret;
+}
+
+/**
+ * Run task, which was taken off its deque, with interrupts in prev_state, then
+ * mark it finished.
+ */
+void
+Pool_RunTask(CSC369_TaskPool* pool, CSC369_Task* task, int prev_state)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  CSC369_Task const run = *task;
+  task->next = pool->free_tasks;
+  pool->free_tasks = task;
+
+  CSC369_InterruptsSet(prev_state);
+  if (run.range != NULL)
+    Range_Run(run.range, run.begin, run.end);
+  else
+    run.fn(run.arg);
+  CSC369_InterruptsDisable();
+
+  pool->tasks_num--;
+  if (--run.group->pending == 0 && run.group->waiting)
+    CSC369_FutexWake(&run.group->pending, 1);
+}
+
+/**
+ * Remove the calling thread from the threads of pool, which it no longer
+ * uses. Its identifier may be reused once it exits, so CSC369_TaskPoolDestroy
+ * must not join it after this point.
+ */
+void
+Pool_Leave(CSC369_TaskPool* pool)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  Tid const tid = CSC369_ThreadId();
+  for (int i = 0; i < pool->threads_num; i++) {
+    if (pool->threads[i] == tid) {
+      pool->threads[i] = -1;
+      break;
+    }
+  }
+  // Whether or not it is joined, the thread is cleaned up after it exits
+  CSC369_ThreadDetach(tid);
+}
+
+/**
+ * Run the tasks of the pool arg as they are spawned, until it is stopped.
+ */
+void
+Pool_Run(void* arg)
+{
+  CSC369_TaskPool* pool = arg;
+  int prev_state = CSC369_InterruptsDisable();
+  int const index = Pool_DequeOf(pool);
+  while (1) {
+    CSC369_Task* task = Pool_TakeTask(pool, index);
+    if (task != NULL) {
+      Pool_RunTask(pool, task, prev_state);
+      continue;
+    }
+    // A failed sleep means no thread is left that could spawn a task
+    if (pool->stopping || CSC369_ThreadSleep(pool->idle) < 0)
+      break;
+  }
+  Pool_Leave(pool);
+  CSC369_InterruptsSet(prev_state);
+}
+
+//****************************************************************************
+// task.h Functions
+//****************************************************************************
+CSC369_TaskPool*
+CSC369_TaskPoolCreate(int threads_num)
+{
+  if (threads_num < 0)
+    return NULL;
+  CSC369_TaskPool* pool = malloc(sizeof(CSC369_TaskPool));
+  if (pool == NULL)
+    return NULL;
+  pool->threads = malloc((threads_num + 1) * sizeof(Tid));
+  pool->deques = calloc(threads_num + 1, sizeof(TaskDeque));
+  pool->idle = CSC369_WaitQueueCreate();
+  if (pool->threads == NULL || pool->deques == NULL || pool->idle == NULL) {
+    free(pool->threads);
+    free(pool->deques);
+    if (pool->idle != NULL)
+      CSC369_WaitQueueDestroy(pool->idle);
+    free(pool);
+    return NULL;
+  }
+  pool->threads_num = 0;
+  pool->deque_of = NULL;
+  pool->max_tid = -1;
+  pool->free_tasks = NULL;
+  pool->slabs = NULL;
+  pool->tasks_num = 0;
+  pool->stopping = 0;
+
+  // The threads find their deques once all of them are created
+  int prev_state = CSC369_InterruptsDisable();
+  for (int i = 0; i < threads_num; i++) {
+    Tid const tid = CSC369_ThreadCreate(Pool_Run, pool);
+    if (tid < 0) {
+      CSC369_InterruptsSet(prev_state);
+      CSC369_TaskPoolDestroy(pool);
+      return NULL;
+    }
+    pool->threads[pool->threads_num++] = tid;
+  }
+  if (Pool_MapDeques(pool) < 0) {
+    CSC369_InterruptsSet(prev_state);
+    CSC369_TaskPoolDestroy(pool);
+    return NULL;
+  }
+  CSC369_InterruptsSet(prev_state);
+  return pool;
+}
+
+int
+CSC369_TaskPoolDestroy(CSC369_TaskPool* pool)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  if (pool->tasks_num > 0) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_OTHER;
+  }
+  pool->stopping = 1;
+  CSC369_ThreadWakeAll(pool->idle);
+
+  // As in CSC369_ExecutorDestroy, a thread cannot leave between being checked
+  // and joined
+  int ret = 0;
+  for (int i = 0; i < pool->threads_num; i++) {
+    Tid const tid = pool->threads[i];
+    int exit_code;
+    if (tid >= 0 && CSC369_ThreadJoin(tid, &exit_code) != tid)
+      ret = CSC369_ERROR_SYS_THREAD;
+  }
+  CSC369_InterruptsSet(prev_state);
+
+  while (pool->slabs != NULL) {
+    TaskSlab* slab = pool->slabs;
+    pool->slabs = slab->next;
+    free(slab);
+  }
+  CSC369_WaitQueueDestroy(pool->idle);
+  free(pool->deque_of);
+  free(pool->deques);
+  free(pool->threads);
+  free(pool);
+  return ret;
+}
+
+void
+CSC369_TaskGroupInit(CSC369_TaskGroup* group, CSC369_TaskPool* pool)
+{
+  assert(group != NULL && pool != NULL);
+  group->pool = pool;
+  group->deque = Pool_DequeOf(pool);
+  group->pending = 0;
+  group->waiting = 0;
+}
+
+int
+CSC369_Spawn(CSC369_TaskGroup* group, void (*fn)(void*), void* arg)
+{
+  assert(group != NULL && fn != NULL);
+  return Task_Spawn(group, fn, arg, NULL, 0, 0);
+}
+
+int
+CSC369_Sync(CSC369_TaskGroup* group)
+{
+  assert(group != NULL);
+  CSC369_TaskPool* pool = group->pool;
+  int prev_state = CSC369_InterruptsDisable();
+  while (group->pending > 0) {
+    // Help with any task while ours are unfinished, most likely with our own
+    CSC369_Task* task = Pool_TakeTask(pool, group->deque);
+    if (task != NULL) {
+      Pool_RunTask(pool, task, prev_state);
+      continue;
+    }
+    // Our remaining tasks are running on other threads, and only the last of
+    // them to finish wakes us
+    group->waiting = 1;
+    int const ret = CSC369_FutexWait(&group->pending, group->pending);
+    group->waiting = 0;
+    if (ret < 0 && ret != CSC369_ERROR_WOULD_BLOCK) {
+      CSC369_InterruptsSet(prev_state);
+      return ret;
+    }
+  }
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+int
+CSC369_ParallelFor(CSC369_TaskPool* pool,
+                   long begin,
+                   long end,
+                   long grain,
+                   void (*fn)(long, long, void*),
+                   void* arg)
+{
+  assert(pool != NULL && fn != NULL);
+  if (grain <= 0)
+    return CSC369_ERROR_OTHER;
+  if (begin >= end)
+    return 0;
+
+  TaskRange range = { pool, grain, fn, arg, 0 };
+  Range_Run(&range, begin, end);
+  return range.status;
+}
@@ -0,0 +1,127 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines fork-join tasks, which run on a pool of threads that steal
+ * work from each other.
+ *
+ * A task is only a function and its argument, taken from a slab, so spawning
+ * one costs far less than creating a thread. Each thread of a pool has a
+ * deque of tasks: it pushes the tasks it spawns at the bottom and runs them
+ * from the bottom (most recent first), while threads with nothing to do steal
+ * from the top of the other deques, where the oldest (and typically largest)
+ * tasks are. A thread that waits for its tasks to finish runs tasks meanwhile,
+ * so a pool with no threads at all still runs every task, on the waiter.
+ */
+#ifndef CSC369_TASK_H
+#define CSC369_TASK_H
+
+#include "csc369_thread.h"
+
+/**
+ * The number of tasks allocated together when a pool runs out of free tasks.
+ */
+#define CSC369_TASK_SLAB_SIZE 64
+
+typedef struct csc369_task_pool_t CSC369_TaskPool;
+
+/**
+ * A set of spawned tasks that a thread waits for together.
+ */
+typedef struct
+{
+  CSC369_TaskPool* pool;
+
+  /**
+   * The deque the tasks are spawned on: that of the pool thread that
+   * initialized the group, or the deque shared by threads outside the pool.
+   */
+  int deque;
+
+  /**
+   * The number of tasks spawned in the group that have not finished.
+   */
+  int pending;
+
+  /**
+   * Whether a thread sleeps until the group's tasks finish.
+   */
+  int waiting;
+} CSC369_TaskGroup;
+
+/**
+ * Create a pool that runs tasks on threads_num threads, in addition to the
+ * threads waiting for tasks, which can be 0.
+ *
+ * @return the pool, or NULL if threads_num is negative or the threads could
+ * not be created.
+ */
+CSC369_TaskPool*
+CSC369_TaskPoolCreate(int threads_num);
+
+/**
+ * Stop the threads of the pool and free it. Must not be called by one of those
+ * threads.
+ *
+ * This function may fail if:
+ *  - a task of the pool has not finished (CSC369_ERROR_OTHER), or
+ *  - one of the threads of the pool was killed (CSC369_ERROR_SYS_THREAD), in
+ * which case the pool is still freed
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_TaskPoolDestroy(CSC369_TaskPool* pool);
+
+/**
+ * Initialize an empty group of tasks run by pool. The group belongs to the
+ * calling thread: only it may spawn tasks in the group and wait for them.
+ */
+void
+CSC369_TaskGroupInit(CSC369_TaskGroup* group, CSC369_TaskPool* pool);
+
+/**
+ * Spawn a task in group that calls fn(arg).
+ *
+ * This function may fail if:
+ *  - there is no more memory available (CSC369_ERROR_SYS_MEM)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_Spawn(CSC369_TaskGroup* group, void (*fn)(void*), void* arg);
+
+/**
+ * Run tasks until every task spawned in group has finished, sleeping only
+ * when there is no task left to run or steal. The group can then be reused.
+ *
+ * This function may fail if:
+ *  - the tasks that are left are not running and there are no other threads
+ * that can run (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_Sync(CSC369_TaskGroup* group);
+
+/**
+ * Call fn(first, last, arg) on pool for subranges [first, last) that together
+ * cover [begin, end), and wait for them to finish. The range is split in half
+ * recursively, one half being spawned, until subranges have at most grain
+ * elements, so that idle threads steal large halves rather than single
+ * elements.
+ *
+ * This function may fail if:
+ *  - grain is not positive (CSC369_ERROR_OTHER), or
+ *  - as CSC369_Spawn or CSC369_Sync
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ParallelFor(CSC369_TaskPool* pool,
+                   long begin,
+                   long end,
+                   long grain,
+                   void (*fn)(long, long, void*),
+                   void* arg);
+
+#endif // CSC369_TASK_H
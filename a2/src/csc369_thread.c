@@ -1,16 +1,32 @@
 #include "csc369_thread.h"
 
-#include <ucontext.h>
+#include "csc369_context.h"
 
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 //#define DEBUG_USE_VALGRIND // uncomment to debug with valgrind
 #ifdef DEBUG_USE_VALGRIND
 #include <valgrind/valgrind.h>
 #endif
 
+#include "csc369_chan.h"
+#include "csc369_futex.h"
 #include "csc369_interrupts.h"
+#include "csc369_io.h"
+#include "csc369_poll.h"
+#include "csc369_sched.h"
+#include "csc369_stack.h"
+#include "csc369_stats.h"
+#include "csc369_timer.h"
+#include "csc369_trace.h"
 
 #ifdef NDEBUG
 #define assert(x) do { (void)sizeof(x);} while (0)
@@ -21,6 +37,17 @@
 // Private Definitions
 //****************************************************************************
 
+/**
+ * The number of TCBs allocated together when the thread table grows.
+ */
+#define CSC369_THREAD_CHUNK_SIZE 64
+
+/**
+ * How long an idle worker sleeps before it looks for threads to run again, in
+ * nanoseconds, in case it missed a wakeup.
+ */
+#define CSC369_WORKER_IDLE_TIMEOUT 1000000
+
 typedef enum
 {
   CSC369_THREAD_FREE = 0,
@@ -30,6 +57,41 @@ typedef enum
   CSC369_THREAD_BLOCKED = 4
 } CSC369_ThreadState;
 
+/**
+ * A registration of a thread in CSC369_ThreadJoinAny or CSC369_ThreadJoinAll
+ * for one of the threads it waits for.
+ */
+typedef struct join_node
+{
+  struct thread_control_block* waiter;
+
+  /**
+   * The thread waited for, on whose list of joins this node is, or NULL once
+   * the node is off the list.
+   */
+  struct thread_control_block* target;
+
+  struct join_node* next;
+
+  struct join_node* prev;
+
+  /**
+   * Whether the thread waited for has exited, and with what code.
+   */
+  int done;
+
+  int exit_code;
+} JoinNode;
+
+/**
+ * A wait queue.
+ */
+typedef struct csc369_wait_queue_t
+{ 
+  struct thread_control_block* head;
+  struct thread_control_block* tail;
+} CSC369_WaitQueue;
+
 /**
  * The Thread Control Block.
  */
@@ -48,7 +110,53 @@ typedef struct thread_control_block
   /**
    * The thread context.
    */
-  ucontext_t context;
+  CSC369_Context context;
+
+  /**
+   * The scheduling state, used while the thread is ready.
+   */
+  SchedEntity sched;
+
+  /**
+   * How long, in microseconds, the thread runs before it is preempted, or 0 for
+   * the default quantum (see CSC369_InterruptsSetQuantum).
+   */
+  int quantum;
+
+  /**
+   * How long the thread has spent in each state, and how often it switched.
+   */
+  ThreadStats stats;
+
+  /**
+   * Whether this thread was killed while running on another worker. It exits
+   * the next time it is switched out.
+   */
+  int kill_pending;
+
+  /**
+   * Wakes the thread up if it sleeps for a limited time.
+   */
+  Timer timer;
+
+  /**
+   * Whether the last timed sleep of this thread ended because the timer expired.
+   */
+  int timed_out;
+
+  /**
+   * The file descriptor this thread sleeps on until it is ready for io_event,
+   * or -1.
+   */
+  int io_fd;
+
+  CSC369_IoEvent io_event;
+
+  /**
+   * The address this thread waits on in CSC369_FutexWait, which tells it apart
+   * from the other threads in its bucket, or NULL.
+   */
+  volatile int* futex_addr;
 
   /**
    * What code the thread exited with.
@@ -58,43 +166,254 @@ typedef struct thread_control_block
   /**
    * The queue of threads that are waiting on this thread to finish.
    */
-  CSC369_WaitQueue* join_threads;
+  CSC369_WaitQueue join_threads;
 
   int join_threads_num;
 
+  /**
+   * Whether the exit code is kept once the thread exits, until the thread is
+   * detached (see CSC369_ThreadConfig.keep_exit_codes).
+   */
+  int retained;
+
+  /**
+   * The joins of threads waiting in CSC369_ThreadJoinAny or
+   * CSC369_ThreadJoinAll for this thread to exit.
+   */
+  JoinNode* joins;
+
+  /**
+   * While this thread is in CSC369_ThreadJoinAny or CSC369_ThreadJoinAll, its
+   * joins, and how many of them must complete before it is woken up. The joins
+   * are freed when the thread returns, or when it is killed.
+   */
+  JoinNode* join_nodes;
+
+  int join_nodes_num;
+
+  int join_pending;
+
   struct thread_control_block* next_in_queue;
+
+  struct thread_control_block* prev_in_queue;
+
+  /**
+   * The wait queue this thread is on, or NULL.
+   */
+  struct csc369_wait_queue_t* queue;
 } TCB;
 
+#define TCB_FromSched(entity) \
+  ((TCB*)((char*)(entity) - offsetof(TCB, sched)))
+
+#define TCB_FromTimer(timer) \
+  ((TCB*)((char*)(timer) - offsetof(TCB, timer)))
+
 /**
- * A wait queue.
+ * A kernel thread that runs user threads.
  */
-typedef struct csc369_wait_queue_t
-{ 
-  TCB* head;
-  TCB* tail;
-} CSC369_WaitQueue;
+typedef struct __attribute__((aligned(64)))
+{
+  int index;
+
+  pthread_t pthread;
+
+  /**
+   * The thread running on this worker, or -1 if the worker is idle.
+   */
+  Tid running;
+
+  /**
+   * Threads that are ready to run on this worker, ordered by the scheduling
+   * policy. Idle workers steal from other workers' queues.
+   */
+  RunQueue ready_threads;
+
+  /**
+   * Where the worker waits for threads to run, switched to when the running
+   * thread blocks or exits and no other thread is ready.
+   */
+  CSC369_Context idle_context;
+
+  void* idle_stack;
+
+  /**
+   * Whether this worker's interrupt timer is running.
+   */
+  int interrupts_started;
+
+  /**
+   * Whether interrupts are stopped because the running thread is the only one
+   * that can run, so that a tick could only preempt it to run it again.
+   */
+  int ticks_stopped;
+} Worker;
 //**************************************************************************************************
 // Private Global Variables (Library State)
 //**************************************************************************************************
 /**
- * All possible threads have their control blocks stored contiguously in memory.
+ * Thread control blocks are stored contiguously in chunks of
+ * CSC369_THREAD_CHUNK_SIZE, which are allocated as more threads are needed.
+ * The TCB of tid is at index (tid % CSC369_THREAD_CHUNK_SIZE) of chunk
+ * (tid / CSC369_THREAD_CHUNK_SIZE).
  */
-TCB threads[CSC369_MAX_THREADS]; 
+TCB** thread_chunks;
 
-Tid running_thread;
+int thread_chunks_num;
 
 /**
- * Threads that are ready to run in FIFO order.
+ * The maximum number of threads, set at initialization. Valid tids are
+ * non-negative and less than max_threads.
  */
-CSC369_WaitQueue ready_threads;
+int max_threads;
+
+/**
+ * Whether threads keep their exit codes after exiting, set at initialization.
+ */
+int keep_exit_codes;
+
+/**
+ * The workers. Worker 0 is the kernel thread that initialized the library.
+ *
+ * With more than one worker, all library state (including the ready queues) is
+ * protected by disabling interrupts, which then also takes a global lock (see
+ * CSC369_InterruptsInitSMP).
+ */
+Worker* workers;
+
+int workers_num;
+
+/**
+ * The worker of the calling kernel thread.
+ */
+__thread Worker* worker_self __attribute__((tls_model("initial-exec")));
+
+/**
+ * Incremented whenever a thread becomes ready while workers are idle. Idle
+ * workers wait on it with a futex.
+ */
+volatile unsigned int workers_seq;
+
+int workers_idle_num;
+
+/**
+ * The identifiers of free TCBs in allocated chunks, used as a LIFO stack so
+ * that the most recently freed (and most likely still cached) TCB is reused
+ * first.
+ */
+Tid* free_tids;
+
+int free_tids_num;
 
 /**
  * Threads that need to be cleaned up.
  */
 CSC369_WaitQueue zombie_threads;
+
+/**
+ * The timers of threads that sleep for a limited time.
+ */
+TimerWheel sleep_timers;
+
+/**
+ * The number of threads that sleep until a file descriptor is ready.
+ */
+int io_waiters;
+
+/**
+ * The tick of the last poll for ready file descriptors, which is done at most
+ * once per tick while threads run.
+ */
+uint64_t io_last_poll;
+
+/**
+ * Whether an idle worker is waiting for file descriptors to be ready.
+ */
+int io_polling;
+
+/**
+ * The threads waiting in CSC369_FutexWait, on the bucket their address hashes
+ * to. Threads waiting on different addresses may share a bucket.
+ */
+CSC369_WaitQueue futex_buckets[CSC369_FUTEX_BUCKETS];
 //**************************************************************************************************
 // Helper Functions
 //**************************************************************************************************
+/**
+ * @return the worker of the calling kernel thread.
+ *
+ * A thread may resume on another worker after it switches, but the compiler
+ * assumes the thread pointer never changes within a function. So the worker is
+ * always looked up through this (opaque) function rather than through
+ * worker_self.
+ */
+__attribute__((noinline)) Worker*
+Worker_Current(void)
+{
+  __asm__ volatile("");
+  return worker_self;
+}
+
+/**
+ * @return the tid of the running thread, or -1 if the worker is idle.
+ */
+Tid
+Thread_Running(void)
+{
+  return Worker_Current()->running;
+}
+
+/**
+ * @return the TCB of tid, or NULL if the chunk containing it was never allocated.
+ */
+TCB*
+ThreadList_Find(Tid tid)
+{
+  assert(tid >= 0 && tid < max_threads);
+  int chunk = tid / CSC369_THREAD_CHUNK_SIZE;
+  if (chunk >= thread_chunks_num)
+    return NULL;
+  return &thread_chunks[chunk][tid % CSC369_THREAD_CHUNK_SIZE];
+}
+
+/**
+ * @return the TCB of tid, which must be in an allocated chunk.
+ */
+TCB*
+ThreadList_Get(Tid tid)
+{
+  TCB* tcb = ThreadList_Find(tid);
+  assert(tcb != NULL);
+  return tcb;
+}
+
+/**
+ * Move tcb to state, charging the time since its last change of state to the
+ * state it leaves.
+ */
+void
+Thread_SetState(TCB* tcb, CSC369_ThreadState state)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  uint64_t const now = Stats_Now();
+  uint64_t const elapsed = now - tcb->stats.since;
+  if (tcb->state == CSC369_THREAD_RUNNING) {
+    tcb->stats.run += elapsed;
+  } else if (tcb->state == CSC369_THREAD_READY) {
+    tcb->stats.ready += elapsed;
+  } else if (tcb->state == CSC369_THREAD_BLOCKED) {
+    tcb->stats.blocked += elapsed;
+    if (state == CSC369_THREAD_READY) {
+      tcb->stats.wakeups++;
+      Trace_Record(TRACE_WAKE, tcb->tid, 0);
+    }
+  }
+  if (state == CSC369_THREAD_BLOCKED)
+    Trace_Record(TRACE_SLEEP, tcb->tid, 0);
+  tcb->stats.since = now;
+  tcb->state = state;
+}
+
 void
 Queue_Init(CSC369_WaitQueue* queue)
 {
@@ -112,14 +431,40 @@ void
 Queue_Enqueue(CSC369_WaitQueue* queue, Tid tid)
 {
   assert(!CSC369_InterruptsAreEnabled());
-  TCB* tcb = &threads[tid];
+  TCB* tcb = ThreadList_Get(tid);
+  assert(tcb->queue == NULL);
 
+  tcb->prev_in_queue = queue->tail;
+  tcb->next_in_queue = NULL;
   if (queue->tail == NULL)
     queue->head = tcb;
   else
     queue->tail->next_in_queue = tcb;
   queue->tail = tcb;
+  tcb->queue = queue;
+}
+
+/**
+ * Remove tcb from the queue it is on in O(1).
+ */
+void
+Queue_Unlink(TCB* tcb)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  CSC369_WaitQueue* queue = tcb->queue;
+  assert(queue != NULL);
+
+  if (tcb->prev_in_queue == NULL)
+    queue->head = tcb->next_in_queue;
+  else
+    tcb->prev_in_queue->next_in_queue = tcb->next_in_queue;
+  if (tcb->next_in_queue == NULL)
+    queue->tail = tcb->prev_in_queue;
+  else
+    tcb->next_in_queue->prev_in_queue = tcb->prev_in_queue;
   tcb->next_in_queue = NULL;
+  tcb->prev_in_queue = NULL;
+  tcb->queue = NULL;
 }
 
 /**
@@ -133,50 +478,44 @@ Queue_Dequeue(CSC369_WaitQueue* queue)
     return -1;
   
   TCB* tcb = queue->head;
-  queue->head = queue->head->next_in_queue;
-  if (queue->tail == tcb)
-    queue->tail = NULL;
-  tcb->next_in_queue = NULL;
+  Queue_Unlink(tcb);
   return tcb->tid;
 }
 
 /**
- * Remove tid from queue.
- *
- * @return 0 on success, -1 if tid not in queue;
+ * Make tid available to ThreadList_Avail again.
  */
-int
-Queue_Remove(CSC369_WaitQueue* queue, Tid tid)
-{
-  assert(!CSC369_InterruptsAreEnabled());
-  if (Queue_IsEmpty(queue))
-    return -1;
-
-  TCB* prev = NULL;
-  for (TCB* cur = queue->head; cur != NULL; prev = cur, cur = cur->next_in_queue) {
-    if (cur->tid != tid)
-      continue;
-    if (prev == NULL)
-      queue->head = cur->next_in_queue;
-    else
-      prev->next_in_queue = cur->next_in_queue;
-    if (queue->tail == cur)
-      queue->tail = NULL;
-    cur->next_in_queue = NULL;
-    return 0;
-  } 
-  return -1;
+void
+ThreadList_Release(Tid tid) {
+  assert(free_tids_num < thread_chunks_num * CSC369_THREAD_CHUNK_SIZE);
+  free_tids[free_tids_num++] = tid;
 }
 
-void 
+/**
+ * Initialize tcb as the free TCB of tid.
+ */
+void
 TCB_Init(TCB* tcb, Tid tid)
 {
   tcb->tid = tid;
   tcb->state = CSC369_THREAD_FREE;
-  tcb->join_threads = malloc(sizeof(CSC369_WaitQueue));
-  Queue_Init(tcb->join_threads);
+  Queue_Init(&tcb->join_threads);
   tcb->join_threads_num = 0;
+  tcb->retained = 0;
+  tcb->joins = NULL;
+  tcb->join_nodes = NULL;
+  tcb->join_nodes_num = 0;
+  tcb->join_pending = 0;
+  SchedEntity_Init(&tcb->sched);
+  tcb->quantum = 0;
+  tcb->kill_pending = 0;
+  Timer_Init(&tcb->timer);
+  tcb->timed_out = 0;
+  tcb->io_fd = -1;
+  tcb->futex_addr = NULL;
   tcb->next_in_queue = NULL;
+  tcb->prev_in_queue = NULL;
+  tcb->queue = NULL;
 }
 
 /*
@@ -186,28 +525,21 @@ TCB_Init(TCB* tcb, Tid tid)
  */
 int
 TCB_MainInit() {
-  TCB* tcb = &threads[0];
+  TCB* tcb = ThreadList_Get(0);
   assert(tcb->tid == 0);
-  running_thread = 0;
+  workers[0].running = 0;
+  tcb->retained = keep_exit_codes;
+  RunQueue_Start(&workers[0].ready_threads, &tcb->sched);
   tcb->state = CSC369_THREAD_RUNNING;
-  return getcontext(&tcb->context);
-}
-
-void
-TCB_Zombify(Tid tid, int exit_code) {
-  assert(!CSC369_InterruptsAreEnabled());
-  TCB* tcb = &threads[tid];
-  tcb->exit_code = exit_code;
-  tcb->state = CSC369_THREAD_ZOMBIE;
-  Queue_Enqueue(&zombie_threads, tcb->tid);
-  CSC369_ThreadWakeAll(tcb->join_threads);
+  Stats_Init(&tcb->stats, Stats_Now());
+  return Context_Get(&tcb->context);
 }
 
 int 
 TCB_CanFree(Tid tid) {
   assert(!CSC369_InterruptsAreEnabled());
-  TCB* tcb = &threads[tid];
-  return tcb->join_threads_num <= 0;
+  TCB* tcb = ThreadList_Get(tid);
+  return tcb->join_threads_num <= 0 && !tcb->retained;
 }
 
 /**
@@ -220,25 +552,32 @@ TCB_Free(Tid tid)
 {
   assert(!CSC369_InterruptsAreEnabled());
   assert(TCB_CanFree(tid));
-  assert(tid != running_thread);
-  TCB* tcb = &threads[tid]; 
+  assert(tid != Thread_Running());
+  TCB* tcb = ThreadList_Get(tid); 
   tcb->state = CSC369_THREAD_FREE;
-  tcb->context = (ucontext_t) {0};
+  tcb->context = (CSC369_Context) {0};
   tcb->exit_code = 0; 
-  Queue_Init(tcb->join_threads);
-  free(tcb->stack);
+  SchedEntity_Init(&tcb->sched);
+  tcb->quantum = 0;
+  tcb->kill_pending = 0;
+  assert(!Timer_IsPending(&tcb->timer));
+  Queue_Init(&tcb->join_threads);
+  Stack_Free(tcb->stack, CSC369_THREAD_STACK_SIZE + 16);
 #ifdef DEBUG_USE_VALGRIND
   VALGRIND_STACK_DEREGISTER(tcb->stack_id);
 #endif
+  ThreadList_Release(tid);
 }
 
 void
 Queue_FreeAll(CSC369_WaitQueue* queue) {
   int prev_state = CSC369_InterruptsDisable();
-  for (TCB* cur = queue->head; cur != NULL; cur = cur->next_in_queue) {
+  TCB* next;
+  for (TCB* cur = queue->head; cur != NULL; cur = next) {
+    next = cur->next_in_queue;
     if (TCB_CanFree(cur->tid)) {
+      Queue_Unlink(cur);
       TCB_Free(cur->tid);
-      Queue_Remove(queue, cur->tid);
     }
   }
   CSC369_InterruptsSet(prev_state);
@@ -246,22 +585,389 @@ Queue_FreeAll(CSC369_WaitQueue* queue) {
 
 void
 Free_Main() {
-  assert(Queue_IsEmpty(&ready_threads));
   Queue_FreeAll(&zombie_threads);
-  for (int i = 0; i < CSC369_MAX_THREADS; i++)
-    free(threads[i].join_threads);
+  for (int i = 0; i < thread_chunks_num; i++) {
+    free(thread_chunks[i]);
+  }
+  free(thread_chunks);
+  free(free_tids);
+  // Other workers may still be waiting for threads to run
+  if (workers_num == 1)
+    free(workers);
+}
+
+/**
+ * @return whether any thread sleeps for a limited time, or until a file
+ * descriptor is ready.
+ */
+int
+Events_Pending(void)
+{
+  return !TimerWheel_IsEmpty(&sleep_timers) || io_waiters > 0;
+}
+
+/**
+ * @return whether any thread is ready, running on another worker, or waiting
+ * for an event that will wake it.
+ */
+int
+Scheduler_HasWork(void)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (Events_Pending())
+    return 1;
+  Worker* self = Worker_Current();
+  for (int i = 0; i < workers_num; i++) {
+    if (!RunQueue_IsEmpty(&workers[i].ready_threads))
+      return 1;
+    if (&workers[i] != self && workers[i].running != -1)
+      return 1;
+  }
+  return 0;
 }
 
 void
 At_Exit() {
-  if (!running_thread)
+  int prev_state = CSC369_InterruptsDisable();
+  if (Thread_Running() == 0 && !Scheduler_HasWork()) {
+    // Interrupts stay disabled, as there are no threads left to switch to
     Free_Main();
+    return;
+  }
+  CSC369_InterruptsSet(prev_state);
+}
+
+/**
+ * Interrupt worker as often as the quantum of tcb, the thread it runs, asks, or
+ * not at all while tcb is the only thread that can run.
+ */
+void
+Worker_SetTicks(Worker* worker, TCB* tcb)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  worker->ticks_stopped = !Scheduler_HasWork();
+  // Only interrupts advance the timing wheel while a thread runs
+  assert(!worker->ticks_stopped || TimerWheel_IsEmpty(&sleep_timers));
+  if (worker->ticks_stopped)
+    CSC369_InterruptsSetPeriod(0);
+  else
+    CSC369_InterruptsSetPeriod(tcb->quantum > 0 ? tcb->quantum
+                                                : CSC369_InterruptsGetQuantum());
+}
+
+/**
+ * Wake up to num idle workers, if there are any, to run threads that became
+ * ready.
+ */
+void
+Workers_Notify(int num)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (workers_idle_num == 0 || num <= 0)
+    return;
+  __atomic_add_fetch(&workers_seq, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &workers_seq, FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+}
+
+/**
+ * Put tcb on a run queue, the calling worker's unless it is pinned to another,
+ * without notifying idle workers.
+ */
+void
+Ready_Place(TCB* tcb, SchedReason reason)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  Worker* worker = tcb->sched.pinned_worker >= 0
+                     ? &workers[tcb->sched.pinned_worker]
+                     : Worker_Current();
+  RunQueue_Enqueue(&worker->ready_threads, &tcb->sched, reason);
+  // Only the running thread could have made another ready while it ran alone
+  if (worker->ticks_stopped && worker->running != -1 &&
+      worker->running != tcb->tid && worker == Worker_Current())
+    Worker_SetTicks(worker, ThreadList_Get(worker->running));
+}
+
+/**
+ * Make tid ready to run, on the calling worker unless it is pinned to another.
+ */
+void
+Ready_Enqueue(Tid tid, SchedReason reason)
+{
+  Ready_Place(ThreadList_Get(tid), reason);
+  Workers_Notify(1);
+}
+
+/**
+ * @return the next thread the calling worker should run, taken from its own
+ * ready queue or else stolen from another worker, or -1 if there is none.
+ */
+Tid
+Ready_Dequeue(void)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  Worker* self = Worker_Current();
+  SchedEntity* entity = RunQueue_Dequeue(&self->ready_threads);
+  for (int i = 1; entity == NULL && i < workers_num; i++)
+    entity = RunQueue_Steal(&workers[(self->index + i) % workers_num].ready_threads);
+  return entity == NULL ? -1 : TCB_FromSched(entity)->tid;
+}
+
+/**
+ * Take node off the list of joins of the thread it waits for.
+ */
+void
+Join_Unlink(JoinNode* node)
+{
+  TCB* target = node->target;
+  if (node->prev == NULL)
+    target->joins = node->next;
+  else
+    node->prev->next = node->next;
+  if (node->next != NULL)
+    node->next->prev = node->prev;
+  node->target = NULL;
+}
+
+/**
+ * Take the joins of tcb, which waits for several threads, off the lists of the
+ * threads that have not exited. The joins themselves stay with tcb.
+ */
+void
+Join_Cancel(TCB* tcb)
+{
+  for (int i = 0; i < tcb->join_nodes_num; i++) {
+    if (tcb->join_nodes[i].target != NULL)
+      Join_Unlink(&tcb->join_nodes[i]);
+  }
+  tcb->join_pending = 0;
+}
+
+/**
+ * Cancel and free the joins of tcb, if any.
+ */
+void
+Join_Free(TCB* tcb)
+{
+  if (tcb->join_nodes == NULL)
+    return;
+  Join_Cancel(tcb);
+  free(tcb->join_nodes);
+  tcb->join_nodes = NULL;
+  tcb->join_nodes_num = 0;
+}
+
+/**
+ * Stop tcb from waiting: take it off the wait queue it sleeps on, if any, and
+ * cancel its timer and joins, if any.
+ */
+void
+Thread_Unblock(TCB* tcb)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (tcb->queue != NULL)
+    Queue_Unlink(tcb);
+  if (tcb->join_nodes != NULL)
+    Join_Cancel(tcb);
+  if (Timer_IsPending(&tcb->timer))
+    TimerWheel_Remove(&sleep_timers, &tcb->timer);
+  if (tcb->io_fd >= 0) {
+    Poller_Leave(tcb->io_fd, tcb->io_event);
+    tcb->io_fd = -1;
+    io_waiters--;
+  }
+}
+
+/**
+ * Wake up the first num threads of queue, or all of them if num is negative.
+ * The threads are detached from queue at once, then made ready in a single
+ * pass, and idle workers are notified once for the whole batch.
+ *
+ * @return the number of threads woken up.
+ */
+int
+Queue_WakeN(CSC369_WaitQueue* queue, int num)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (queue->head == NULL || num == 0)
+    return 0;
+
+  TCB* first = queue->head;
+  TCB* last = queue->tail;
+  if (num > 0) {
+    last = first;
+    for (int i = 1; i < num && last->next_in_queue != NULL; i++)
+      last = last->next_in_queue;
+  }
+  queue->head = last->next_in_queue;
+  if (queue->head == NULL)
+    queue->tail = NULL;
+  else
+    queue->head->prev_in_queue = NULL;
+  last->next_in_queue = NULL;
+
+  int woken = 0;
+  for (TCB* tcb = first; tcb != NULL; woken++) {
+    TCB* next = tcb->next_in_queue;
+    tcb->next_in_queue = NULL;
+    tcb->prev_in_queue = NULL;
+    tcb->queue = NULL;
+    Thread_Unblock(tcb);
+    Thread_SetState(tcb, CSC369_THREAD_READY);
+    Ready_Place(tcb, SCHED_REASON_WOKEN);
+    tcb = next;
+  }
+  Workers_Notify(woken);
+  return woken;
+}
+
+/**
+ * Make tid a zombie that exited with exit_code, and wake up the threads
+ * waiting for it. A thread waiting for several threads gets the exit code
+ * through its join, and is only woken up once all the joins it needs are done.
+ */
+void
+TCB_Zombify(Tid tid, int exit_code) {
+  assert(!CSC369_InterruptsAreEnabled());
+  TCB* tcb = ThreadList_Get(tid);
+  tcb->exit_code = exit_code;
+  Thread_SetState(tcb, CSC369_THREAD_ZOMBIE);
+  Trace_Record(TRACE_EXIT, tid, exit_code);
+  // A thread killed in CSC369_ThreadJoinAny or CSC369_ThreadJoinAll does not
+  // return to free its joins, nor one killed in CSC369_ChanSelect to leave
+  // its channels
+  Join_Free(tcb);
+  Chan_ThreadExit(tid);
+  Queue_Enqueue(&zombie_threads, tcb->tid);
+  CSC369_ThreadWakeAll(&tcb->join_threads);
+
+  while (tcb->joins != NULL) {
+    JoinNode* node = tcb->joins;
+    Join_Unlink(node);
+    node->done = 1;
+    node->exit_code = exit_code;
+    TCB* waiter = node->waiter;
+    if (--waiter->join_pending == 0) {
+      Thread_Unblock(waiter);
+      Thread_SetState(waiter, CSC369_THREAD_READY);
+      Ready_Enqueue(waiter->tid, SCHED_REASON_WOKEN);
+    }
+  }
+}
+
+/**
+ * Wake up the thread whose timed sleep expired.
+ */
+void
+Timers_Expire(Timer* timer)
+{
+  TCB* tcb = TCB_FromTimer(timer);
+  assert(tcb->state == CSC369_THREAD_BLOCKED);
+  Thread_Unblock(tcb);
+  tcb->timed_out = 1;
+  Thread_SetState(tcb, CSC369_THREAD_READY);
+  Ready_Enqueue(tcb->tid, SCHED_REASON_WOKEN);
+}
+
+/**
+ * Wake up the threads whose timed sleeps have expired, and, at most once per
+ * tick, those whose file descriptors are ready.
+ */
+void
+Events_Run(void)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  int const armed = Poller_IsArmed();
+  if (TimerWheel_IsEmpty(&sleep_timers) && !armed)
+    return;
+
+  uint64_t const now = Timer_Now();
+  if (!TimerWheel_IsEmpty(&sleep_timers))
+    TimerWheel_Advance(&sleep_timers, now, &Timers_Expire);
+  if (armed && now != io_last_poll && !io_polling) {
+    io_last_poll = now;
+    Poller_Poll();
+  }
 }
 
+/**
+ * Wait for a timer to expire or a file descriptor to be ready, when no thread
+ * is ready but some wait for either. Used by a single worker, which has no idle
+ * loop and keeps interrupts disabled.
+ */
 void
-ThreadList_Init() {
-  for (int i = 0; i < CSC369_MAX_THREADS; i++)
-    TCB_Init(&threads[i], i);
+Events_Wait(void)
+{
+  if (io_waiters > 0) {
+    // Block in epoll, unless a timer expires before a file descriptor is ready
+    struct epoll_event events[CSC369_POLL_EVENTS];
+    int const num = Poller_Collect(events, TimerWheel_IsEmpty(&sleep_timers) ? -1 : 0);
+    if (num > 0) {
+      Poller_Dispatch(events, num);
+      return;
+    }
+  }
+  if (!TimerWheel_IsEmpty(&sleep_timers)) {
+    struct timespec const tick = { 0, CSC369_TIMER_TICK };
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &tick, NULL);
+    Events_Run();
+  }
+}
+
+/**
+ * Allocate the next chunk of TCBs and make their tids available.
+ *
+ * @return 0 on success, -1 if there is no memory or the table is at its maximum.
+ */
+int
+ThreadList_Grow() {
+  Tid const first = thread_chunks_num * CSC369_THREAD_CHUNK_SIZE;
+  if (first >= max_threads)
+    return -1;
+
+  TCB* chunk = malloc(CSC369_THREAD_CHUNK_SIZE * sizeof(TCB));
+  if (chunk == NULL)
+    return -1;
+  Tid* tids = realloc(free_tids, (first + CSC369_THREAD_CHUNK_SIZE) * sizeof(Tid));
+  if (tids == NULL) {
+    free(chunk);
+    return -1;
+  }
+  free_tids = tids;
+
+  for (int i = 0; i < CSC369_THREAD_CHUNK_SIZE; i++)
+    TCB_Init(&chunk[i], first + i);
+  thread_chunks[thread_chunks_num++] = chunk;
+
+  // Lower tids are handed out first. Tids past the maximum are never used.
+  int const last = first + CSC369_THREAD_CHUNK_SIZE < max_threads
+                     ? first + CSC369_THREAD_CHUNK_SIZE
+                     : max_threads;
+  for (int i = last - 1; i >= first; i--)
+    ThreadList_Release(i);
+  return 0;
+}
+
+/**
+ * @return 0 on success, -1 on failure.
+ */
+int
+ThreadList_Init(int max) {
+  max_threads = max;
+  int const chunks = (max + CSC369_THREAD_CHUNK_SIZE - 1) / CSC369_THREAD_CHUNK_SIZE;
+  thread_chunks = malloc(chunks * sizeof(TCB*));
+  if (thread_chunks == NULL)
+    return -1;
+  thread_chunks_num = 0;
+  free_tids = NULL;
+  free_tids_num = 0;
+  if (ThreadList_Grow())
+    return -1;
+
+  // Tid 0 is taken by the main thread.
+  Tid const main_tid = free_tids[--free_tids_num];
+  assert(main_tid == 0);
+  (void)main_tid;
+  return 0;
 }
 
 /**
@@ -270,10 +976,12 @@ ThreadList_Init() {
 int 
 ThreadList_Avail() {
   assert(!CSC369_InterruptsAreEnabled());
-  for (int i = 0; i < CSC369_MAX_THREADS; i++)
-     if (threads[i].state == CSC369_THREAD_FREE)
-       return i;
-  return -1;
+  if (free_tids_num == 0 && ThreadList_Grow())
+    return -1;
+  Tid tid = free_tids[--free_tids_num];
+  assert(tid >= 0 && tid < max_threads);
+  assert(ThreadList_Get(tid)->state == CSC369_THREAD_FREE);
+  return tid;
 }
 
 /**
@@ -296,16 +1004,9 @@ Bit_Align(void* stack) {
  * @return 0 on success, -1 on failure.
  */
 int
-Context_Create(ucontext_t* context, void (*f)(void*), void* arg, void* stack) {
+Context_Create(CSC369_Context* context, void (*f)(void*), void* arg, void* stack) {
   assert(!CSC369_InterruptsAreEnabled());
-  int err = getcontext(context);
-  if (err)
-      return -1;
-  context->uc_mcontext.gregs[REG_RIP] = (greg_t) &ThreadStub;
-  context->uc_mcontext.gregs[REG_RDI] = (greg_t) f;
-  context->uc_mcontext.gregs[REG_RSI] = (greg_t) arg;
-  context->uc_mcontext.gregs[REG_RSP] = (greg_t) Bit_Align(stack);
-  return 0;
+  return Context_Make(context, &ThreadStub, f, arg, Bit_Align(stack));
 }
 
 /*
@@ -314,70 +1015,308 @@ Context_Create(ucontext_t* context, void (*f)(void*), void* arg, void* stack) {
 int
 TCB_Create(Tid tid, void (*f)(void*), void* arg) {
   assert(!CSC369_InterruptsAreEnabled());
-  assert(tid >= 0 && tid < CSC369_MAX_THREADS);
-  TCB* tcb = &threads[tid];
+  TCB* tcb = ThreadList_Get(tid);
   assert(tcb->state == CSC369_THREAD_FREE && tcb->tid == tid);
   tcb->state = CSC369_THREAD_READY;
-  tcb->stack = malloc(CSC369_THREAD_STACK_SIZE + 16);
-  if (tcb->stack == NULL)
+  Stats_Init(&tcb->stats, Stats_Now());
+  tcb->stack = Stack_Alloc(CSC369_THREAD_STACK_SIZE + 16);
+  if (tcb->stack == NULL) {
+    tcb->state = CSC369_THREAD_FREE;
     return CSC369_ERROR_SYS_MEM;
+  }
 
 #ifdef DEBUG_USE_VALGRIND
   tcb->stack_id = VALGRIND_STACK_REGISTER(Bit_Align(tcb->stack), Bit_Align(tcb->stack) - CSC369_THREAD_STACK_SIZE);
 #endif
 
+  tcb->retained = keep_exit_codes;
   int err = Context_Create(&tcb->context, f, arg, tcb->stack);
-  if (err)
+  if (err) {
+    tcb->state = CSC369_THREAD_FREE;
+    Stack_Free(tcb->stack, CSC369_THREAD_STACK_SIZE + 16);
     return CSC369_ERROR_OTHER;
+  }
 
-  Queue_Enqueue(&ready_threads, tid);
+  Trace_Record(TRACE_CREATE, tid, 0);
+  Ready_Enqueue(tid, SCHED_REASON_NEW);
   return tid;
 }
 
 /**
- * Switch to thread with tid.
- *
- * Assumes tid has already been removed from ready queue.
+ * Put the running thread of worker, whose context has been saved, wherever it
+ * goes next: back on a ready queue if it is still running, or with the zombies
+ * if it was killed while running.
+ */
+void
+Switch_Out(Worker* worker)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  if (worker->running == -1)
+    return;
+  TCB* running = ThreadList_Get(worker->running);
+  RunQueue_Stop(&worker->ready_threads, &running->sched);
+
+  if (running->kill_pending && running->state != CSC369_THREAD_ZOMBIE) {
+    running->kill_pending = 0;
+    Thread_Unblock(running);
+    TCB_Zombify(running->tid, CSC369_EXIT_CODE_KILL);
+  } else if (running->state == CSC369_THREAD_RUNNING) {
+    SchedReason reason = SCHED_REASON_YIELDED;
+    if (CSC369_InterruptsWasPreempted()) {
+      reason = SCHED_REASON_PREEMPTED;
+      running->stats.preempted++;
+      if (workers_num > 1)
+        running->sched.pinned_worker = worker->index;
+    } else {
+      running->stats.voluntary++;
+    }
+    Thread_SetState(running, CSC369_THREAD_READY);
+    Ready_Enqueue(running->tid, reason);
+  } else if (running->state == CSC369_THREAD_BLOCKED) {
+    running->stats.voluntary++;
+  }
+}
+
+/**
+ * Switch to thread with tid.
+ *
+ * Assumes tid has already been removed from ready queue, and that the running
+ * thread (if any) has been switched out with Switch_Out.
+ *
+ * @return Doesn't return if successful, returns -1 on failure.
+ */
+int Switch(Tid tid) {
+  assert(!CSC369_InterruptsAreEnabled());
+  TCB *tcb = ThreadList_Get(tid);
+  assert(tcb->state == CSC369_THREAD_READY && tcb->tid == tid);
+  Thread_SetState(tcb, CSC369_THREAD_RUNNING);
+  tcb->sched.pinned_worker = -1;
+
+  Worker* worker = Worker_Current();
+  if (!worker->interrupts_started && workers_num > 1)
+    worker->interrupts_started = !CSC369_InterruptsInitCPU();
+
+  worker->running = tid;
+  RunQueue_Start(&worker->ready_threads, &tcb->sched);
+  Worker_SetTicks(worker, tcb);
+  Trace_Record(TRACE_SWITCH, tid, 0);
+  Context_Set(&tcb->context);
+  return -1; // shouldn't get here.
+}
+
+/**
+ * Switch the calling worker to its idle loop, when the running thread, which
+ * has been switched out, cannot continue and no other thread is ready.
+ */
+void
+Switch_Idle(void)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  assert(workers_num > 1);
+  Worker* worker = Worker_Current();
+  worker->running = -1;
+  Trace_Record(TRACE_SWITCH, -1, 0);
+  Context_Set(&worker->idle_context);
+}
+
+/**
+ * Switch the running thread out and run tid, which was taken off its ready
+ * queue. Returns once the calling thread runs again.
+ */
+void
+Thread_HandOff(Tid tid)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  volatile int called = 0;
+  int err = Context_Get(&ThreadList_Get(Thread_Running())->context);
+  assert(!err);
+  if (!called) {
+    called = 1;
+    Switch_Out(Worker_Current());
+    Switch(tid);
+    assert(0); // should not get here.
+  }
+}
+
+/**
+ * Run threads on worker, waiting for more whenever there are none. Does not
+ * return.
+ */
+void
+Worker_Loop(Worker* worker)
+{
+  CSC369_InterruptsDisable();
+  while (1) {
+    if (!worker->interrupts_started)
+      worker->interrupts_started = !CSC369_InterruptsInitCPU();
+
+    Events_Run();
+    Tid tid = Ready_Dequeue();
+    if (tid != -1) {
+      volatile int called = 0;
+      Context_Get(&worker->idle_context);
+      if (!called) {
+        called = 1;
+        Switch(tid);
+      }
+      // A thread on this worker switched back to the idle loop
+      continue;
+    }
+
+    // There is nothing to preempt until the worker runs a thread again
+    CSC369_InterruptsSetPeriod(0);
+    if (io_waiters > 0 && !io_polling) {
+      // This worker waits for file descriptors, the others on the futex
+      io_polling = 1;
+      CSC369_InterruptsEnable();
+      struct epoll_event events[CSC369_POLL_EVENTS];
+      int const num = Poller_Collect(events, CSC369_WORKER_IDLE_TIMEOUT / 1000000);
+      CSC369_InterruptsDisable();
+      io_polling = 0;
+      Poller_Dispatch(events, num);
+      continue;
+    }
+
+    unsigned int const seq = workers_seq;
+    workers_idle_num++;
+    CSC369_InterruptsEnable();
+    // Poll every tick while threads sleep for a limited time
+    struct timespec timeout = { 0, TimerWheel_IsEmpty(&sleep_timers)
+                                     ? CSC369_WORKER_IDLE_TIMEOUT
+                                     : CSC369_TIMER_TICK };
+    syscall(SYS_futex, &workers_seq, FUTEX_WAIT_PRIVATE, seq, &timeout, NULL, 0);
+    CSC369_InterruptsDisable();
+    workers_idle_num--;
+  }
+}
+
+/**
+ * The entry point of worker 0's idle context.
+ */
+void
+Worker_Stub(void (*f)(void*), void* worker)
+{
+  (void)f;
+  Worker_Loop(worker);
+}
+
+/**
+ * The entry point of the pthreads of workers other than 0.
+ */
+void*
+Worker_Main(void* worker)
+{
+  worker_self = worker;
+  Trace_SetCpu(((Worker*)worker)->index);
+  Worker_Loop(worker);
+  return NULL;
+}
+
+/**
+ * Set up the workers. The calling kernel thread becomes worker 0, which runs
+ * the main thread, and the others are started by Workers_Start.
  *
- * @return Doesn't return if successful, returns -1 on failure.
+ * @return 0 on success, -1 on failure.
  */
-int Switch(Tid tid) {
-  assert(!CSC369_InterruptsAreEnabled());
-  assert(tid >= 0 && tid < CSC369_MAX_THREADS);
-  TCB *tcb = &threads[tid];
-  assert(tcb->state == CSC369_THREAD_READY && tcb->tid == tid);
-  tcb->state = CSC369_THREAD_RUNNING;
-
-  if (threads[running_thread].state == CSC369_THREAD_RUNNING) {
-    Queue_Enqueue(&ready_threads, running_thread);
-    threads[running_thread].state = CSC369_THREAD_READY;
+int
+Workers_Init(int num, CSC369_SchedPolicy policy)
+{
+  workers = calloc(num, sizeof(Worker));
+  if (workers == NULL)
+    return -1;
+  workers_num = num;
+  workers_seq = 0;
+  workers_idle_num = 0;
+  for (int i = 0; i < num; i++) {
+    workers[i].index = i;
+    workers[i].running = -1;
+    RunQueue_Init(&workers[i].ready_threads, Sched_Policy(policy));
   }
+  worker_self = &workers[0];
+  if (num == 1)
+    return 0;
 
-  running_thread = tid;
-  setcontext(&tcb->context);
-  return -1; // shouldn't get here.
+  CSC369_InterruptsInitSMP();
+  workers[0].pthread = pthread_self();
+  workers[0].idle_stack = malloc(CSC369_THREAD_STACK_SIZE + 16);
+  if (workers[0].idle_stack == NULL)
+    return -1;
+  // Made with interrupts disabled, as the idle loop starts with them disabled
+  int prev_state = CSC369_InterruptsDisable();
+  int err = Context_Make(&workers[0].idle_context,
+                         &Worker_Stub,
+                         NULL,
+                         &workers[0],
+                         Bit_Align(workers[0].idle_stack));
+  CSC369_InterruptsSet(prev_state);
+  return err;
+}
+
+/**
+ * @return 0 on success, -1 on failure.
+ */
+int
+Workers_Start(void)
+{
+  for (int i = 1; i < workers_num; i++) {
+    if (pthread_create(&workers[i].pthread, NULL, &Worker_Main, &workers[i]))
+      return -1;
+  }
+  return 0;
 }
 
 //**************************************************************************************************
 // thread.h Functions
 //**************************************************************************************************
+void
+CSC369_ThreadConfigInit(CSC369_ThreadConfig* config)
+{
+  config->max_threads = CSC369_MAX_THREADS;
+  config->workers = 1;
+  config->policy = CSC369_SCHED_FIFO;
+  config->keep_exit_codes = 0;
+}
+
 int
 CSC369_ThreadInit(void)
 {
-  Queue_Init(&ready_threads);
+  CSC369_ThreadConfig config;
+  CSC369_ThreadConfigInit(&config);
+  return CSC369_ThreadInitConfig(&config);
+}
+
+int
+CSC369_ThreadInitConfig(CSC369_ThreadConfig const* config)
+{
+  if (config->max_threads <= 0 || config->workers <= 0 ||
+      Sched_Policy(config->policy) == NULL)
+    return CSC369_ERROR_OTHER;
   Queue_Init(&zombie_threads);
-  ThreadList_Init();
+  for (int i = 0; i < CSC369_FUTEX_BUCKETS; i++)
+    Queue_Init(&futex_buckets[i]);
+  TimerWheel_Init(&sleep_timers);
+  io_waiters = 0;
+  io_last_poll = 0;
+  io_polling = 0;
+  keep_exit_codes = config->keep_exit_codes;
+  Stats_InitClock();
+  if (ThreadList_Init(config->max_threads))
+    return CSC369_ERROR_OTHER;
+  if (Workers_Init(config->workers, config->policy))
+    return CSC369_ERROR_OTHER;
   int err = TCB_MainInit();
   if (err)
     return CSC369_ERROR_OTHER;
   atexit(&At_Exit);
+  if (Workers_Start())
+    return CSC369_ERROR_OTHER;
   return 0;
 }
 
 Tid
 CSC369_ThreadId(void)
 {
-  return running_thread;
+  return Thread_Running();
 }
 
 Tid
@@ -387,9 +1326,13 @@ CSC369_ThreadCreate(void (*f)(void*), void* arg)
   
   int prev_state = CSC369_InterruptsDisable();
   Tid tid = ThreadList_Avail();
-  if (tid == -1)
+  if (tid == -1) {
+    CSC369_InterruptsSet(prev_state);
     return CSC369_ERROR_SYS_THREAD;
+  }
   int ret = TCB_Create(tid, f, arg);
+  if (ret < 0)
+    ThreadList_Release(tid);
   CSC369_InterruptsSet(prev_state);
 
   return ret;
@@ -400,8 +1343,8 @@ CSC369_ThreadExit(int exit_code)
 {
   // TODO tid 0
   int prev_state = CSC369_InterruptsDisable();
-  TCB_Zombify(running_thread, exit_code);
-  if (Queue_IsEmpty(&ready_threads))
+  TCB_Zombify(Thread_Running(), exit_code);
+  if (!Scheduler_HasWork())
      exit(exit_code);
   CSC369_ThreadYield();
   CSC369_InterruptsSet(prev_state);
@@ -412,18 +1355,31 @@ CSC369_ThreadExit(int exit_code)
 Tid
 CSC369_ThreadKill(Tid tid)
 {
-  if (tid == running_thread)
+  if (tid == Thread_Running())
     return CSC369_ERROR_THREAD_BAD;
-  else if (tid < 0 || tid >= CSC369_MAX_THREADS)
+  else if (tid < 0 || tid >= max_threads)
     return CSC369_ERROR_TID_INVALID;
 
   int prev_state = CSC369_InterruptsDisable();
-  TCB *tcb = &threads[tid]; 
-  if (tcb->state == CSC369_THREAD_FREE)
+  TCB *tcb = ThreadList_Find(tid); 
+  if (tcb == NULL || tcb->state == CSC369_THREAD_FREE) {
+    CSC369_InterruptsSet(prev_state);
     return CSC369_ERROR_SYS_THREAD;
-  else if (tcb->state == CSC369_THREAD_ZOMBIE)
+  } else if (tcb->state == CSC369_THREAD_ZOMBIE) {
+    CSC369_InterruptsSet(prev_state);
     return tcb->exit_code;
-  Queue_Remove(&ready_threads, tid); // it might or might not be in ready queue
+  } else if (tcb->state == CSC369_THREAD_RUNNING) {
+    // It is running on another worker, which will switch it out
+    Trace_Record(TRACE_KILL, tid, 0);
+    tcb->kill_pending = 1;
+    CSC369_InterruptsSet(prev_state);
+    return tid;
+  }
+  Trace_Record(TRACE_KILL, tid, 0);
+  if (tcb->state == CSC369_THREAD_READY)
+    RunQueue_Remove(&tcb->sched);
+  else // asleep on a wait queue, or for a limited time
+    Thread_Unblock(tcb);
  
   TCB_Zombify(tid, CSC369_EXIT_CODE_KILL); 
   Queue_FreeAll(&zombie_threads);
@@ -431,20 +1387,154 @@ CSC369_ThreadKill(Tid tid)
   return tid;
 }
 
+/**
+ * Copy the statistics of tcb, including the time in its current state so far,
+ * to stats.
+ */
+void
+Thread_GetStats(TCB* tcb, CSC369_ThreadStats* stats)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  ThreadStats current = tcb->stats;
+  uint64_t const elapsed = Stats_Now() - current.since;
+  if (tcb->state == CSC369_THREAD_RUNNING)
+    current.run += elapsed;
+  else if (tcb->state == CSC369_THREAD_READY)
+    current.ready += elapsed;
+  else if (tcb->state == CSC369_THREAD_BLOCKED)
+    current.blocked += elapsed;
+
+  stats->voluntary_switches = current.voluntary;
+  stats->preempted_switches = current.preempted;
+  stats->wakeups = current.wakeups;
+  stats->run_nsec = Stats_Nsec(current.run);
+  stats->ready_nsec = Stats_Nsec(current.ready);
+  stats->blocked_nsec = Stats_Nsec(current.blocked);
+}
+
+int
+CSC369_ThreadGetStats(Tid tid, CSC369_ThreadStats* stats)
+{
+  assert(stats != NULL);
+  if (tid < 0 || tid >= max_threads)
+    return CSC369_ERROR_TID_INVALID;
+
+  int prev_state = CSC369_InterruptsDisable();
+  TCB* tcb = ThreadList_Find(tid);
+  if (tcb == NULL || tcb->state == CSC369_THREAD_FREE) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_THREAD;
+  }
+  Thread_GetStats(tcb, stats);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+void
+CSC369_ThreadDumpStats(FILE* file)
+{
+  static char const* const state_names[] = { "free", "ready", "running", "zombie", "blocked" };
+
+  // Printing must not be interrupted by a thread that prints too
+  int prev_state = CSC369_InterruptsDisable();
+  fprintf(file, "%6s %-8s %10s %10s %10s %12s %12s %12s\n",
+          "tid", "state", "voluntary", "preempted", "wakeups",
+          "run_us", "ready_us", "blocked_us");
+  for (int i = 0; i < thread_chunks_num; i++) {
+    for (int j = 0; j < CSC369_THREAD_CHUNK_SIZE; j++) {
+      TCB* tcb = &thread_chunks[i][j];
+      if (tcb->state == CSC369_THREAD_FREE)
+        continue;
+      CSC369_ThreadStats stats;
+      Thread_GetStats(tcb, &stats);
+      fprintf(file, "%6d %-8s %10ld %10ld %10ld %12lld %12lld %12lld\n",
+              tcb->tid, state_names[tcb->state],
+              stats.voluntary_switches, stats.preempted_switches, stats.wakeups,
+              stats.run_nsec / 1000, stats.ready_nsec / 1000, stats.blocked_nsec / 1000);
+    }
+  }
+  fflush(file);
+  CSC369_InterruptsSet(prev_state);
+}
+
+int
+CSC369_ThreadSetWeight(Tid tid, int weight)
+{
+  if (tid < 0 || tid >= max_threads)
+    return CSC369_ERROR_TID_INVALID;
+  else if (weight <= 0)
+    return CSC369_ERROR_OTHER;
+
+  int prev_state = CSC369_InterruptsDisable();
+  TCB* tcb = ThreadList_Find(tid);
+  if (tcb == NULL || tcb->state == CSC369_THREAD_FREE || tcb->state == CSC369_THREAD_ZOMBIE) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_THREAD;
+  }
+  tcb->sched.weight = weight;
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+int
+CSC369_ThreadSetQuantum(Tid tid, int usec)
+{
+  if (tid < 0 || tid >= max_threads)
+    return CSC369_ERROR_TID_INVALID;
+  else if (usec < 0)
+    return CSC369_ERROR_OTHER;
+
+  int prev_state = CSC369_InterruptsDisable();
+  TCB* tcb = ThreadList_Find(tid);
+  if (tcb == NULL || tcb->state == CSC369_THREAD_FREE || tcb->state == CSC369_THREAD_ZOMBIE) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_THREAD;
+  }
+  tcb->quantum = usec;
+  // Threads running on other workers get their new quantum when next switched to
+  if (tid == Thread_Running())
+    Worker_SetTicks(Worker_Current(), tcb);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
 int
 CSC369_ThreadYield()
 {
   int prev_state = CSC369_InterruptsDisable();
+  if (Thread_Running() == -1) { // an idle worker has no thread to suspend
+    CSC369_InterruptsSet(prev_state);
+    return -1;
+  }
   volatile int called = 0;
-  int err = getcontext(&threads[running_thread].context); 
+  int err = Context_Get(&ThreadList_Get(Thread_Running())->context); 
   assert(!err); 
-  int tid;
+  volatile int tid;
   if (!called) {
-    tid = Queue_Dequeue(&ready_threads);
-    if (tid == -1) // empty ready queue
-      return running_thread;
-
     called = 1;
+    // The policy chooses between the ready threads and the caller
+    Worker* worker = Worker_Current();
+    TCB* running = ThreadList_Get(worker->running);
+    Switch_Out(worker);
+    Events_Run();
+    tid = Ready_Dequeue();
+    // A single worker has no idle loop, so it waits for sleepers here
+    while (tid == -1 && workers_num == 1 && Events_Pending()) {
+      Events_Wait();
+      tid = Ready_Dequeue();
+    }
+    if (tid == running->tid) { // it is still the thread to run
+      Thread_SetState(running, CSC369_THREAD_RUNNING);
+      running->sched.pinned_worker = -1;
+      RunQueue_Start(&worker->ready_threads, &running->sched);
+      Worker_SetTicks(worker, running);
+      CSC369_InterruptsSet(prev_state);
+      return tid;
+    } else if (tid == -1) {
+      // Sleeping or exiting, so wait on the idle loop for another worker
+      tid = running->tid;
+      Switch_Idle();
+    }
     Switch(tid);
     return CSC369_ERROR_OTHER; // should not get here.
   }
@@ -457,23 +1547,23 @@ int
 CSC369_ThreadYieldTo(Tid tid)
 {
   int prev_state = CSC369_InterruptsDisable();
-  if (tid == running_thread)
+  if (tid == Thread_Running()) {
+    CSC369_InterruptsSet(prev_state);
     return tid;
-  if (tid < 0 || tid >= CSC369_MAX_THREADS)
+  }
+  if (tid < 0 || tid >= max_threads) {
+    CSC369_InterruptsSet(prev_state);
     return CSC369_ERROR_TID_INVALID;
-  if (threads[tid].state != CSC369_THREAD_READY)
+  }
+  TCB* tcb = ThreadList_Find(tid);
+  if (tcb == NULL || tcb->state != CSC369_THREAD_READY ||
+      (tcb->sched.pinned_worker >= 0 &&
+       tcb->sched.pinned_worker != Worker_Current()->index)) {
+    CSC369_InterruptsSet(prev_state);
     return CSC369_ERROR_THREAD_BAD;
-  int err = Queue_Remove(&ready_threads, tid);
-  assert(!err);   
-
-  volatile int called = 0;
-  err = getcontext(&threads[running_thread].context); 
-  assert(!err); 
-  if (!called) {
-    called = 1;
-    Switch(tid);
-    return CSC369_ERROR_OTHER; // should not get here.
   }
+  RunQueue_Remove(&tcb->sched);
+  Thread_HandOff(tid);
   CSC369_InterruptsSet(prev_state);
   Queue_FreeAll(&zombie_threads);
   return tid;
@@ -524,21 +1614,72 @@ CSC369_ThreadSpin(int duration)
   }
 }
 
+/**
+ * Suspend the calling thread, on queue if it is not NULL, until it is woken up
+ * or (if usec is not negative) usec microseconds pass.
+ *
+ * @return CSC369_ERROR_TIMEOUT if the time passed first. Otherwise, as
+ * CSC369_ThreadYield.
+ */
+int
+Thread_SleepTimed(CSC369_WaitQueue* queue, int usec)
+{
+  assert(!CSC369_InterruptsAreEnabled());
+  TCB* tcb = ThreadList_Get(Thread_Running());
+  Thread_SetState(tcb, CSC369_THREAD_BLOCKED);
+  if (queue != NULL)
+    Queue_Enqueue(queue, tcb->tid);
+  tcb->timed_out = 0;
+  if (usec >= 0) {
+    // The current tick may be nearly over, so wait for one more
+    uint64_t const ticks = ((uint64_t)usec * 1000 + CSC369_TIMER_TICK - 1) / CSC369_TIMER_TICK;
+    TimerWheel_Add(&sleep_timers, &tcb->timer, Timer_Now() + ticks + 1);
+  }
+
+  int ret = CSC369_ThreadYield();
+  // We may resume on another worker, so look the thread up again
+  tcb = ThreadList_Get(Thread_Running());
+  return tcb->timed_out ? CSC369_ERROR_TIMEOUT : ret;
+}
+
 int
 CSC369_ThreadSleep(CSC369_WaitQueue* queue)
 {
   assert(queue != NULL);
   
   int prev_state = CSC369_InterruptsDisable();  
-  if (Queue_IsEmpty(&ready_threads))
+  if (!Scheduler_HasWork()) {
+    CSC369_InterruptsSet(prev_state);
     return CSC369_ERROR_SYS_THREAD;
+  }
 
-  TCB* tcb = &threads[running_thread];
-  tcb->state = CSC369_THREAD_BLOCKED; 
-  Queue_Enqueue(queue, tcb->tid); 
- 
+  int ret = Thread_SleepTimed(queue, -1);
   CSC369_InterruptsSet(prev_state);
-  int ret = CSC369_ThreadYield();
+  return ret;
+}
+
+int
+CSC369_ThreadSleepFor(int usec)
+{
+  if (usec < 0)
+    return CSC369_ERROR_OTHER;
+
+  int prev_state = CSC369_InterruptsDisable();
+  Thread_SleepTimed(NULL, usec);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+int
+CSC369_ThreadSleepTimeout(CSC369_WaitQueue* queue, int usec)
+{
+  assert(queue != NULL);
+  if (usec < 0)
+    return CSC369_ERROR_OTHER;
+
+  // The timer always wakes us, so there is no need to check for other threads
+  int prev_state = CSC369_InterruptsDisable();
+  int ret = Thread_SleepTimed(queue, usec);
   CSC369_InterruptsSet(prev_state);
   return ret;
 }
@@ -547,16 +1688,8 @@ int
 CSC369_ThreadWakeNext(CSC369_WaitQueue* queue)
 {
   assert(queue != NULL);
-  int ret = 1;
   int prev_state = CSC369_InterruptsDisable();
-  Tid tid = Queue_Dequeue(queue);
-  if (tid == -1) {
-    ret = 0;
-  } else {
-    TCB* tcb = &threads[tid];
-    tcb->state = CSC369_THREAD_READY;
-    Queue_Enqueue(&ready_threads, tid);
-  }
+  int const ret = Queue_WakeN(queue, 1);
   CSC369_InterruptsSet(prev_state);
   return ret;
 }
@@ -564,32 +1697,170 @@ CSC369_ThreadWakeNext(CSC369_WaitQueue* queue)
 int
 CSC369_ThreadWakeAll(CSC369_WaitQueue* queue)
 {
+  assert(queue != NULL);
   int prev_state = CSC369_InterruptsDisable();
-  int ret = 0;
-  while (!Queue_IsEmpty(queue))
-    ret += CSC369_ThreadWakeNext(queue);
+  int const ret = Queue_WakeN(queue, -1);
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+int
+CSC369_ThreadWakeAndYield(CSC369_WaitQueue* queue)
+{
+  assert(queue != NULL);
+  int prev_state = CSC369_InterruptsDisable();
+  if (Queue_IsEmpty(queue)) {
+    CSC369_InterruptsSet(prev_state);
+    return 0;
+  }
+  TCB* tcb = queue->head;
+  Tid const tid = tcb->tid;
+  Thread_Unblock(tcb);
+  Thread_SetState(tcb, CSC369_THREAD_READY);
+  // Let the policy account for the wakeup, as if it were chosen to run next
+  Ready_Place(tcb, SCHED_REASON_WOKEN);
+  if (Thread_Running() == -1 || (tcb->sched.pinned_worker >= 0 &&
+                                 tcb->sched.pinned_worker != Worker_Current()->index)) {
+    // There is no thread to hand off from, or it must run elsewhere
+    Workers_Notify(1);
+    CSC369_InterruptsSet(prev_state);
+    return 1;
+  }
+  RunQueue_Remove(&tcb->sched);
+  Thread_HandOff(tid);
+  CSC369_InterruptsSet(prev_state);
+  Queue_FreeAll(&zombie_threads);
+  return 1;
+}
+
+int
+CSC369_ThreadWakeN(CSC369_WaitQueue* queue, int n)
+{
+  assert(queue != NULL);
+  if (n < 0)
+    return CSC369_ERROR_OTHER;
+  int prev_state = CSC369_InterruptsDisable();
+  int const ret = Queue_WakeN(queue, n);
   CSC369_InterruptsSet(prev_state);
   return ret;
 }
 
+//****************************************************************************
+// io.h Functions
+//****************************************************************************
+int
+CSC369_WaitFd(int fd, CSC369_IoEvent event)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  PollFd* pfd = Poller_Get(fd);
+  if (pfd == NULL) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_MEM;
+  }
+  if (Poller_Arm(fd, pfd, event)) {
+    // Enabling interrupts may run other threads, which may change errno
+    int const error = errno;
+    CSC369_InterruptsSet(prev_state);
+    errno = error;
+    return CSC369_ERROR_OTHER;
+  }
+
+  // The poller always wakes us, so there is no need to check for other threads
+  TCB* tcb = ThreadList_Get(Thread_Running());
+  tcb->io_fd = fd;
+  tcb->io_event = event;
+  io_waiters++;
+  Thread_SleepTimed(PollFd_Queue(pfd, event), -1);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
+
+//****************************************************************************
+// futex.h Functions
+//****************************************************************************
+/**
+ * @return the bucket of threads waiting on addr.
+ */
+CSC369_WaitQueue*
+Futex_Bucket(volatile int* addr)
+{
+  // Fibonacci hashing, as ints are aligned and the low bits are always 0
+  uint64_t const key = (uintptr_t)addr * 0x9E3779B97F4A7C15ULL;
+  return &futex_buckets[(key >> 32) % CSC369_FUTEX_BUCKETS];
+}
+
+int
+CSC369_FutexWait(volatile int* addr, int expected)
+{
+  assert(addr != NULL);
+  int prev_state = CSC369_InterruptsDisable();
+  // A thread changing *addr before waking us cannot run until we are asleep
+  if (*addr != expected) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_WOULD_BLOCK;
+  }
+  if (!Scheduler_HasWork()) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_THREAD;
+  }
+
+  TCB* tcb = ThreadList_Get(Thread_Running());
+  tcb->futex_addr = addr;
+  int const ret = Thread_SleepTimed(Futex_Bucket(addr), -1);
+  tcb->futex_addr = NULL;
+  CSC369_InterruptsSet(prev_state);
+  return ret < 0 ? ret : 0;
+}
+
+int
+CSC369_FutexWake(volatile int* addr, int n)
+{
+  assert(addr != NULL);
+  if (n < 0)
+    return CSC369_ERROR_OTHER;
+
+  int prev_state = CSC369_InterruptsDisable();
+  CSC369_WaitQueue* bucket = Futex_Bucket(addr);
+  int woken = 0;
+  TCB* next;
+  for (TCB* tcb = bucket->head; tcb != NULL && woken < n; tcb = next) {
+    next = tcb->next_in_queue;
+    if (tcb->futex_addr != addr)
+      continue;
+    Thread_Unblock(tcb);
+    Thread_SetState(tcb, CSC369_THREAD_READY);
+    Ready_Place(tcb, SCHED_REASON_WOKEN);
+    woken++;
+  }
+  Workers_Notify(woken);
+  CSC369_InterruptsSet(prev_state);
+  return woken;
+}
+
 //****************************************************************************
 // New Assignment 2 Definitions - Task 3
 //****************************************************************************
 int
 CSC369_ThreadJoin(Tid tid, int* exit_code)
 {
-  if (tid == running_thread)
+  if (tid == Thread_Running())
     return CSC369_ERROR_THREAD_BAD;
-  else if (tid < 0 || tid >= CSC369_MAX_THREADS)
+  else if (tid < 0 || tid >= max_threads)
     return CSC369_ERROR_TID_INVALID;
 
   int prev_state = CSC369_InterruptsDisable();
-  TCB* tcb = &threads[tid];
-  if (tcb->state == CSC369_THREAD_FREE || tcb->state == CSC369_THREAD_ZOMBIE)
+  TCB* tcb = ThreadList_Find(tid);
+  if (tcb != NULL && tcb->state == CSC369_THREAD_ZOMBIE && tcb->retained) {
+    *exit_code = tcb->exit_code;
+    CSC369_InterruptsSet(prev_state);
+    return tid;
+  } else if (tcb == NULL || tcb->state == CSC369_THREAD_FREE || tcb->state == CSC369_THREAD_ZOMBIE) {
+    CSC369_InterruptsSet(prev_state);
     return CSC369_ERROR_SYS_THREAD;
+  }
   
   tcb->join_threads_num++;
-  int ret = CSC369_ThreadSleep(tcb->join_threads);
+  int ret = CSC369_ThreadSleep(&tcb->join_threads);
   assert(ret >= 0);
   *exit_code = tcb->exit_code;
   tcb->join_threads_num--;
@@ -597,3 +1868,131 @@ CSC369_ThreadJoin(Tid tid, int* exit_code)
   CSC369_InterruptsSet(prev_state);
   return tid;
 }
+
+/**
+ * Wait for the first (or, if wait_all, every) thread of tids to exit, with a
+ * single join registered on each of them.
+ *
+ * @return the index in tids of a thread that exited (or 0, if wait_all), or
+ * the appropriate error code.
+ */
+int
+Thread_JoinMany(Tid const tids[], int n, int wait_all, int exit_codes[])
+{
+  if (n <= 0)
+    return CSC369_ERROR_OTHER;
+  for (int i = 0; i < n; i++) {
+    if (tids[i] == Thread_Running())
+      return CSC369_ERROR_THREAD_BAD;
+    else if (tids[i] < 0 || tids[i] >= max_threads)
+      return CSC369_ERROR_TID_INVALID;
+  }
+
+  // Allocate the joins with interrupts disabled, so that they are ours to free
+  // if we are killed from then on
+  int prev_state = CSC369_InterruptsDisable();
+  JoinNode* nodes = malloc(n * sizeof(JoinNode));
+  if (nodes == NULL) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_MEM;
+  }
+  TCB* self = ThreadList_Get(Thread_Running());
+  for (int i = 0; i < n; i++) {
+    nodes[i].waiter = self;
+    nodes[i].target = NULL;
+    nodes[i].done = 0;
+  }
+  self->join_nodes = nodes;
+  self->join_nodes_num = n;
+  int registered = 0, done = 0, ret = 0;
+  for (int i = 0; i < n; i++) {
+    JoinNode* node = &nodes[i];
+    TCB* tcb = ThreadList_Find(tids[i]);
+    if (tcb != NULL && tcb->state == CSC369_THREAD_ZOMBIE && tcb->retained) {
+      node->done = 1;
+      node->exit_code = tcb->exit_code;
+      done++;
+    } else if (tcb == NULL || tcb->state == CSC369_THREAD_FREE ||
+               tcb->state == CSC369_THREAD_ZOMBIE) {
+      // Every thread must be valid to wait for all of them
+      if (wait_all) {
+        ret = CSC369_ERROR_SYS_THREAD;
+        break;
+      }
+      continue;
+    } else {
+      node->target = tcb;
+      node->prev = NULL;
+      node->next = tcb->joins;
+      if (tcb->joins != NULL)
+        tcb->joins->prev = node;
+      tcb->joins = node;
+    }
+    registered++;
+  }
+  if (ret == 0 && registered == 0)
+    ret = CSC369_ERROR_SYS_THREAD;
+
+  self->join_pending = wait_all ? registered - done : !done;
+  if (ret == 0 && self->join_pending > 0) {
+    if (!Scheduler_HasWork())
+      ret = CSC369_ERROR_SYS_THREAD;
+    else
+      Thread_SleepTimed(NULL, -1);
+  }
+
+  if (ret == 0) {
+    for (int i = 0; i < n; i++) {
+      if (wait_all) {
+        exit_codes[i] = nodes[i].exit_code;
+      } else if (nodes[i].done) {
+        exit_codes[0] = nodes[i].exit_code;
+        ret = i;
+        break;
+      }
+    }
+  }
+  // We may resume on another worker, but this is still our TCB
+  Join_Free(self);
+  Queue_FreeAll(&zombie_threads);
+  CSC369_InterruptsSet(prev_state);
+  return ret;
+}
+
+int
+CSC369_ThreadJoinAny(Tid const tids[], int n, Tid* which, int* exit_code)
+{
+  assert(tids != NULL && which != NULL && exit_code != NULL);
+  int const ret = Thread_JoinMany(tids, n, 0, exit_code);
+  if (ret < 0)
+    return ret;
+  *which = tids[ret];
+  return tids[ret];
+}
+
+int
+CSC369_ThreadJoinAll(Tid const tids[], int n, int exit_codes[])
+{
+  assert(tids != NULL && exit_codes != NULL);
+  return Thread_JoinMany(tids, n, 1, exit_codes);
+}
+
+int
+CSC369_ThreadDetach(Tid tid)
+{
+  if (tid < 0 || tid >= max_threads)
+    return CSC369_ERROR_TID_INVALID;
+
+  int prev_state = CSC369_InterruptsDisable();
+  TCB* tcb = ThreadList_Find(tid);
+  if (tcb == NULL || tcb->state == CSC369_THREAD_FREE ||
+      (tcb->state == CSC369_THREAD_ZOMBIE && !tcb->retained)) {
+    CSC369_InterruptsSet(prev_state);
+    return CSC369_ERROR_SYS_THREAD;
+  }
+  tcb->retained = 0;
+  if (tcb->state == CSC369_THREAD_ZOMBIE)
+    Queue_FreeAll(&zombie_threads);
+  CSC369_InterruptsSet(prev_state);
+  return 0;
+}
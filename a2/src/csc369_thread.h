@@ -6,6 +6,8 @@
 #ifndef CSC369_THREAD_H
 #define CSC369_THREAD_H
 
+#include <stdio.h>
+
 /**
  * Error codes for the CSC369 Thread Library
  */
@@ -15,7 +17,10 @@ typedef enum
   CSC369_ERROR_THREAD_BAD = -2,
   CSC369_ERROR_SYS_THREAD = -3,
   CSC369_ERROR_SYS_MEM = -4,
-  CSC369_ERROR_OTHER = -5
+  CSC369_ERROR_OTHER = -5,
+  CSC369_ERROR_TIMEOUT = -6,
+  CSC369_ERROR_WOULD_BLOCK = -7,
+  CSC369_ERROR_CLOSED = -8
 } CSC369_ThreadError;
 
 /**
@@ -29,7 +34,7 @@ typedef enum
 } CSC369_ExitCode;
 
 /**
- * The maximum number of threads supported by the library.
+ * The default maximum number of threads supported by the library.
  */
 #define CSC369_MAX_THREADS 256
 
@@ -39,13 +44,83 @@ typedef enum
 #define CSC369_THREAD_STACK_SIZE 32768
 
 /**
- * The identifier for a thread. Valid ids are non-negative and less than
- * CSC369_MAX_THREADS.
+ * The identifier for a thread. Valid ids are non-negative and less than the
+ * maximum number of threads (CSC369_MAX_THREADS unless configured otherwise).
  */
 typedef int Tid;
 
 /**
- * Initialize the CSC369 user-level thread library.
+ * The policies for choosing which ready thread runs next.
+ */
+typedef enum
+{
+  /**
+   * Ready threads run in the order they became ready.
+   */
+  CSC369_SCHED_FIFO = 0,
+
+  /**
+   * A multi-level feedback queue: threads that keep being preempted by
+   * interrupts move to lower priorities, while threads that block or yield
+   * early stay at high priority. All threads are periodically moved back to
+   * the highest priority, so that none starve.
+   */
+  CSC369_SCHED_MLFQ = 1,
+
+  /**
+   * Fair sharing: the thread that has run the least, relative to its weight
+   * (see CSC369_ThreadSetWeight), runs next. A thread with twice the weight of
+   * another gets twice as much CPU time when both are ready.
+   */
+  CSC369_SCHED_FAIR = 2,
+} CSC369_SchedPolicy;
+
+/**
+ * The weight threads are created with.
+ */
+#define CSC369_THREAD_DEFAULT_WEIGHT 1024
+
+/**
+ * Options for initializing the CSC369 user-level thread library.
+ */
+typedef struct
+{
+  /**
+   * The maximum number of threads that can exist at once. Memory for threads
+   * is only allocated as they are created, so this can be large.
+   */
+  int max_threads;
+
+  /**
+   * The number of kernel threads (workers) that run threads. With one worker,
+   * all threads run on the kernel thread that initialized the library.
+   * Otherwise, each worker has its own ready queue, and workers with nothing to
+   * run steal ready threads from the others.
+   */
+  int workers;
+
+  /**
+   * How each worker chooses the next ready thread to run.
+   */
+  CSC369_SchedPolicy policy;
+
+  /**
+   * Whether threads keep their exit codes after exiting, so that they can be
+   * joined any number of times, until they are detached with
+   * CSC369_ThreadDetach. Such threads keep their identifiers until then.
+   * Otherwise, a thread is cleaned up as soon as no thread is joining it.
+   */
+  int keep_exit_codes;
+} CSC369_ThreadConfig;
+
+/**
+ * Fill config with the default options.
+ */
+void
+CSC369_ThreadConfigInit(CSC369_ThreadConfig* config);
+
+/**
+ * Initialize the CSC369 user-level thread library with the default options.
  *
  * This must be called before using other functions in this library.
  *
@@ -54,6 +129,20 @@ typedef int Tid;
 int
 CSC369_ThreadInit(void);
 
+/**
+ * Initialize the CSC369 user-level thread library with the given options.
+ *
+ * This (or CSC369_ThreadInit) must be called before using other functions in
+ * this library.
+ *
+ * @param config The options, typically filled by CSC369_ThreadConfigInit and
+ * then modified.
+ *
+ * @return 0 on success, CSC369_ERROR_OTHER otherwise.
+ */
+int
+CSC369_ThreadInitConfig(CSC369_ThreadConfig const* config);
+
 /**
  * Get the identifier of the calling thread.
  *
@@ -147,6 +236,101 @@ CSC369_ThreadExit(int exit_code);
 int
 CSC369_ThreadKill(Tid tid);
 
+/**
+ * Set the weight of the thread whose identifier is tid, which is its share of
+ * the CPU relative to other threads under the CSC369_SCHED_FAIR policy. Other
+ * policies ignore weights.
+ *
+ * This function may fail if:
+ *  - the identifier is invalid (CSC369_ERROR_TID_INVALID), or
+ *  - the thread is invalid or a zombie (CSC369_ERROR_SYS_THREAD), or
+ *  - the weight is not positive (CSC369_ERROR_OTHER)
+ *
+ * @param tid The identifier of the thread.
+ * @param weight The new weight. Threads are created with
+ * CSC369_THREAD_DEFAULT_WEIGHT.
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ThreadSetWeight(Tid tid, int weight);
+
+/**
+ * Set how long the thread whose identifier is tid runs before it is preempted
+ * by an interrupt, so that threads that compute for long can be switched less
+ * often, while latency-sensitive threads are preempted sooner. A thread that is
+ * the only one that can run is not interrupted at all. Timed sleeps are woken up
+ * when a CPU is interrupted, so while a thread with a longer quantum than
+ * CSC369_INTERRUPTS_SIGNAL_INTERVAL runs, they may wake up that much later.
+ *
+ * This function may fail if:
+ *  - the identifier is invalid (CSC369_ERROR_TID_INVALID), or
+ *  - the thread is invalid or a zombie (CSC369_ERROR_SYS_THREAD), or
+ *  - usec is negative (CSC369_ERROR_OTHER)
+ *
+ * @param tid The identifier of the thread.
+ * @param usec The time slice in microseconds, or 0 for the default quantum
+ * (see CSC369_InterruptsSetQuantum), which threads are created with.
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ThreadSetQuantum(Tid tid, int usec);
+
+/**
+ * Scheduler statistics of a thread, since it was created.
+ */
+typedef struct
+{
+  /**
+   * The number of times the thread gave up the CPU itself, by yielding,
+   * sleeping, or blocking.
+   */
+  long voluntary_switches;
+
+  /**
+   * The number of times the thread was preempted by an interrupt.
+   */
+  long preempted_switches;
+
+  /**
+   * The number of times the thread was woken up after sleeping or blocking.
+   */
+  long wakeups;
+
+  /**
+   * The time the thread spent running, ready to run, and sleeping or blocked,
+   * in nanoseconds.
+   */
+  long long run_nsec;
+
+  long long ready_nsec;
+
+  long long blocked_nsec;
+} CSC369_ThreadStats;
+
+/**
+ * Copy the scheduler statistics of the thread whose identifier is tid to stats.
+ * The statistics of a zombie are kept until it is cleaned up.
+ *
+ * This function may fail if:
+ *  - the identifier is invalid (CSC369_ERROR_TID_INVALID), or
+ *  - the thread is invalid (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ *
+ * @pre stats is not NULL
+ */
+int
+CSC369_ThreadGetStats(Tid tid, CSC369_ThreadStats* stats);
+
+/**
+ * Print a table of the scheduler statistics of every thread that is not
+ * cleaned up to file, one line per thread, with times in microseconds.
+ */
+void
+CSC369_ThreadDumpStats(FILE* file);
+
 //****************************************************************************
 // New Assignment 2 Definitions - Task 2
 //****************************************************************************
@@ -208,6 +392,40 @@ CSC369_ThreadSpin(int duration);
 int
 CSC369_ThreadSleep(CSC369_WaitQueue* queue);
 
+/**
+ * Suspend the calling thread for at least usec microseconds, running other
+ * threads (or leaving the CPU idle) in the meantime.
+ *
+ * This function may fail if:
+ *  - usec is negative (CSC369_ERROR_OTHER)
+ *
+ * @param usec The time to sleep in microseconds.
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ThreadSleepFor(int usec);
+
+/**
+ * Like CSC369_ThreadSleep, but the calling thread is also woken up (and taken
+ * off queue) once usec microseconds have passed. Unlike CSC369_ThreadSleep, it
+ * may be called when no other thread can run.
+ *
+ * This function may fail if:
+ *  - the time passed before the thread was woken up (CSC369_ERROR_TIMEOUT), or
+ *  - usec is negative (CSC369_ERROR_OTHER)
+ *
+ * @param queue The wait queue that the calling thread should be added to.
+ * @param usec The longest time to sleep in microseconds.
+ *
+ * @return If successful, the identifier of the thread that ran. Otherwise, the
+ * appropriate error code.
+ *
+ * @pre queue is not NULL
+ */
+int
+CSC369_ThreadSleepTimeout(CSC369_WaitQueue* queue, int usec);
+
 /**
  * Wake up the first thread in queue (and move it to the ready queue).
  *
@@ -237,6 +455,42 @@ CSC369_ThreadWakeNext(CSC369_WaitQueue* queue);
 int
 CSC369_ThreadWakeAll(CSC369_WaitQueue* queue);
 
+/**
+ * Wake up the first thread in queue and run it immediately, instead of after
+ * the threads that are already ready. The calling thread is suspended and made
+ * ready as if it had called CSC369_ThreadYield.
+ *
+ * When queue is empty, the calling thread continues to execute.
+ *
+ * @param queue The wait queue to dequeue.
+ *
+ * @return The number of threads woken up, which can be 0.
+ *
+ * @pre queue is not NULL
+ */
+int
+CSC369_ThreadWakeAndYield(CSC369_WaitQueue* queue);
+
+/**
+ * Wake up the first n threads in queue, or all of them if there are fewer, in
+ * FIFO order (and move them to the ready queue). Waking a batch at once is
+ * cheaper than calling CSC369_ThreadWakeNext n times.
+ *
+ * The calling thread continues to execute (i.e., it is not suspended).
+ *
+ * This function may fail if:
+ *  - n is negative (CSC369_ERROR_OTHER)
+ *
+ * @param queue The wait queue to dequeue.
+ *
+ * @return The number of threads woken up, which can be 0, or the appropriate
+ * error code.
+ *
+ * @pre queue is not NULL
+ */
+int
+CSC369_ThreadWakeN(CSC369_WaitQueue* queue, int n);
+
 //****************************************************************************
 // New Assignment 2 Definitions - Task 3
 //****************************************************************************
@@ -247,7 +501,9 @@ CSC369_ThreadWakeAll(CSC369_WaitQueue* queue);
  * The thread being waited for may be invalid. An invalid thread (not to be
  * confused with an invalid identifier) is a thread that is currently being
  * cleaned up (e.g., a zombie) or a thread that is inactive (e.g., the thread
- * was never created or the thread was cleaned up already).
+ * was never created or the thread was cleaned up already). A thread that
+ * exited but keeps its exit code (see CSC369_ThreadConfig.keep_exit_codes) is
+ * valid until it is detached.
  *
  * This function also copies the exit status of the target thread (tid) to
  * exit_code.
@@ -268,4 +524,60 @@ CSC369_ThreadWakeAll(CSC369_WaitQueue* queue);
 int
 CSC369_ThreadJoin(Tid tid, int* exit_code);
 
+/**
+ * Suspend the calling thread until any of the n threads in tids exits, and
+ * copy the identifier and exit status of that thread to which and exit_code.
+ * If one of the threads has already exited and keeps its exit code, this
+ * function returns immediately. Invalid threads in tids are ignored.
+ *
+ * The calling thread is registered with every thread at once and woken up a
+ * single time, by the first one to exit.
+ *
+ * This function may fail if:
+ *  - n is not positive (CSC369_ERROR_OTHER), or
+ *  - an identifier is invalid (CSC369_ERROR_TID_INVALID), or
+ *  - an identifier is of the calling thread (CSC369_ERROR_THREAD_BAD), or
+ *  - none of the threads is valid, or no other thread can run
+ * (CSC369_ERROR_SYS_THREAD), or
+ *  - there is no more memory available (CSC369_ERROR_SYS_MEM)
+ *
+ * @return If successful, the identifier of the thread that exited. Otherwise,
+ * the appropriate error code.
+ *
+ * @pre tids, which and exit_code are not NULL
+ */
+int
+CSC369_ThreadJoinAny(Tid const tids[], int n, Tid* which, int* exit_code);
+
+/**
+ * Suspend the calling thread until all n threads in tids have exited, and copy
+ * the exit status of tids[i] to exit_codes[i].
+ *
+ * The calling thread is registered with every thread at once and woken up a
+ * single time, by the last one to exit.
+ *
+ * This function may fail as CSC369_ThreadJoinAny, and also if:
+ *  - any of the threads is invalid (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ *
+ * @pre tids and exit_codes are not NULL
+ */
+int
+CSC369_ThreadJoinAll(Tid const tids[], int n, int exit_codes[]);
+
+/**
+ * Stop keeping the exit code of the thread whose identifier is tid (see
+ * CSC369_ThreadConfig.keep_exit_codes). If it has exited, it is cleaned up
+ * once no thread is joining it. Otherwise, it will be when it exits.
+ *
+ * This function may fail if:
+ *  - the identifier is invalid (CSC369_ERROR_TID_INVALID), or
+ *  - the thread is invalid (CSC369_ERROR_SYS_THREAD)
+ *
+ * @return If successful, 0. Otherwise, the appropriate error code.
+ */
+int
+CSC369_ThreadDetach(Tid tid);
+
 #endif /* CSC369_THREAD_H */
@@ -0,0 +1,162 @@
+#include "csc369_timer.h"
+
+#include <stddef.h>
+#include <time.h>
+
+#ifdef NDEBUG
+#define assert(x) do { (void)sizeof(x);} while (0)
+#else
+#include <assert.h>
+#endif
+
+#define CSC369_TIMER_SLOT_MASK (CSC369_TIMER_SLOTS - 1)
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+void
+TimerSlot_Push(Timer** slot, Timer* timer)
+{
+  timer->prev = NULL;
+  timer->next = *slot;
+  if (*slot != NULL)
+    (*slot)->prev = timer;
+  *slot = timer;
+  timer->slot = slot;
+}
+
+void
+TimerSlot_Unlink(Timer* timer)
+{
+  assert(timer->slot != NULL);
+  if (timer->prev == NULL)
+    *timer->slot = timer->next;
+  else
+    timer->prev->next = timer->next;
+  if (timer->next != NULL)
+    timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->slot = NULL;
+}
+
+/**
+ * Put timer in the slot that the wheel reaches when, or shortly before, it
+ * expires.
+ */
+void
+TimerWheel_Place(TimerWheel* wheel, Timer* timer)
+{
+  uint64_t expires = timer->expires < wheel->now ? wheel->now : timer->expires;
+  uint64_t const delta = expires - wheel->now;
+
+  int level = 0;
+  while (level < CSC369_TIMER_LEVELS - 1 &&
+         delta >= (uint64_t)1 << (CSC369_TIMER_SLOT_BITS * (level + 1)))
+    level++;
+  // Timers past the end of the wheel wait in its last slot, and are placed
+  // again when that slot is cascaded
+  uint64_t const span = (uint64_t)1 << (CSC369_TIMER_SLOT_BITS * CSC369_TIMER_LEVELS);
+  if (delta >= span)
+    expires = wheel->now + span - 1;
+
+  int const index = (expires >> (CSC369_TIMER_SLOT_BITS * level)) & CSC369_TIMER_SLOT_MASK;
+  TimerSlot_Push(&wheel->slots[level][index], timer);
+}
+
+/**
+ * Move the timers of the current slot of level down to the levels below.
+ *
+ * @return the index of that slot.
+ */
+int
+TimerWheel_Cascade(TimerWheel* wheel, int level)
+{
+  int const index =
+    (wheel->now >> (CSC369_TIMER_SLOT_BITS * level)) & CSC369_TIMER_SLOT_MASK;
+  Timer* timer = wheel->slots[level][index];
+  wheel->slots[level][index] = NULL;
+  while (timer != NULL) {
+    Timer* next = timer->next;
+    timer->slot = NULL;
+    TimerWheel_Place(wheel, timer);
+    timer = next;
+  }
+  return index;
+}
+
+//****************************************************************************
+// timer.h Functions
+//****************************************************************************
+uint64_t
+Timer_Now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) / CSC369_TIMER_TICK;
+}
+
+void
+Timer_Init(Timer* timer)
+{
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->slot = NULL;
+  timer->expires = 0;
+}
+
+void
+TimerWheel_Init(TimerWheel* wheel)
+{
+  wheel->now = Timer_Now();
+  wheel->num = 0;
+  for (int i = 0; i < CSC369_TIMER_LEVELS; i++) {
+    for (int j = 0; j < CSC369_TIMER_SLOTS; j++)
+      wheel->slots[i][j] = NULL;
+  }
+}
+
+void
+TimerWheel_Add(TimerWheel* wheel, Timer* timer, uint64_t expires)
+{
+  assert(!Timer_IsPending(timer));
+  timer->expires = expires;
+  TimerWheel_Place(wheel, timer);
+  wheel->num++;
+}
+
+void
+TimerWheel_Remove(TimerWheel* wheel, Timer* timer)
+{
+  TimerSlot_Unlink(timer);
+  wheel->num--;
+}
+
+void
+TimerWheel_Advance(TimerWheel* wheel, uint64_t now, void (*expire)(Timer* timer))
+{
+  while (wheel->now <= now) {
+    if (wheel->num == 0) {
+      // Nothing to expire or cascade on the way
+      wheel->now = now + 1;
+      return;
+    }
+
+    if ((wheel->now & CSC369_TIMER_SLOT_MASK) == 0) {
+      // A level wrapped around, so the next slot of the level above is due
+      for (int level = 1; level < CSC369_TIMER_LEVELS; level++) {
+        if (TimerWheel_Cascade(wheel, level) != 0)
+          break;
+      }
+    }
+
+    // Expiring a timer may add others that expire now, which go in this slot
+    Timer** slot = &wheel->slots[0][wheel->now & CSC369_TIMER_SLOT_MASK];
+    while (*slot != NULL) {
+      Timer* timer = *slot;
+      TimerWheel_Remove(wheel, timer);
+      expire(timer);
+    }
+    wheel->now++;
+  }
+}
@@ -0,0 +1,112 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines the hierarchical timing wheel that wakes up timed sleepers.
+ *
+ * Time is measured in ticks of CSC369_TIMER_TICK nanoseconds. Level 0 of the
+ * wheel has a slot for each of the next CSC369_TIMER_SLOTS ticks, and each
+ * level above covers CSC369_TIMER_SLOTS times as long as the one below. As the
+ * wheel advances, the timers in a slot of a higher level are cascaded down to
+ * the level below, so adding, removing, and expiring a timer take O(1) time.
+ * All functions here must be called with interrupts disabled.
+ */
+#ifndef CSC369_TIMER_H
+#define CSC369_TIMER_H
+
+#include <stdint.h>
+
+#include "csc369_interrupts.h"
+
+/**
+ * The length of a tick, in nanoseconds: the default interrupt interval.
+ *
+ * The wheel is only advanced when a CPU is interrupted, yields or idles, so a
+ * finer tick would not wake sleepers any sooner. The interrupt period is not
+ * fixed, though (see CSC369_InterruptsSetQuantum and CSC369_ThreadSetQuantum):
+ * a CPU running a thread with a longer quantum advances the wheel less often,
+ * and its sleepers may wake up as late as the end of that quantum. Idle CPUs
+ * still advance it every tick.
+ */
+#define CSC369_TIMER_TICK (CSC369_INTERRUPTS_SIGNAL_INTERVAL * 1000)
+
+_Static_assert(CSC369_TIMER_TICK < 1000000000,
+               "Idle CPUs sleep for one tick, which must be less than a second");
+
+#define CSC369_TIMER_LEVELS 4
+
+#define CSC369_TIMER_SLOT_BITS 6
+
+#define CSC369_TIMER_SLOTS (1 << CSC369_TIMER_SLOT_BITS)
+
+typedef struct csc369_timer_t
+{
+  struct csc369_timer_t* next;
+
+  struct csc369_timer_t* prev;
+
+  /**
+   * The slot this timer is in, or NULL if it is not pending.
+   */
+  struct csc369_timer_t** slot;
+
+  /**
+   * The tick at which the timer expires.
+   */
+  uint64_t expires;
+} Timer;
+
+typedef struct
+{
+  /**
+   * The next tick to expire timers for.
+   */
+  uint64_t now;
+
+  /**
+   * The number of pending timers.
+   */
+  int num;
+
+  Timer* slots[CSC369_TIMER_LEVELS][CSC369_TIMER_SLOTS];
+} TimerWheel;
+
+/**
+ * @return the current tick.
+ */
+uint64_t
+Timer_Now(void);
+
+void
+Timer_Init(Timer* timer);
+
+static inline int
+Timer_IsPending(Timer* timer)
+{
+  return timer->slot != NULL;
+}
+
+void
+TimerWheel_Init(TimerWheel* wheel);
+
+static inline int
+TimerWheel_IsEmpty(TimerWheel* wheel)
+{
+  return wheel->num == 0;
+}
+
+/**
+ * Make timer expire at tick expires, or at the next advance if that has passed.
+ */
+void
+TimerWheel_Add(TimerWheel* wheel, Timer* timer, uint64_t expires);
+
+void
+TimerWheel_Remove(TimerWheel* wheel, Timer* timer);
+
+/**
+ * Remove every timer that expires at or before tick now, calling expire on each.
+ */
+void
+TimerWheel_Advance(TimerWheel* wheel, uint64_t now, void (*expire)(Timer* timer));
+
+#endif // CSC369_TIMER_H
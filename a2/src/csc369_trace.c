@@ -0,0 +1,197 @@
+#include "csc369_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "csc369_stats.h"
+#include "csc369_thread.h"
+
+//****************************************************************************
+// Private Definitions
+//****************************************************************************
+typedef struct
+{
+  /**
+   * When the event happened, in cycles (see Stats_Now).
+   */
+  uint64_t time;
+
+  /**
+   * One more than the index of the event (modulo 2^32), stored last, so that a
+   * record being overwritten is recognized.
+   */
+  uint32_t seq;
+
+  int16_t type;
+
+  int16_t cpu;
+
+  int32_t tid;
+
+  int32_t arg;
+} TraceRecord;
+
+//****************************************************************************
+// Private Global Variables
+//****************************************************************************
+volatile int trace_enabled = 0;
+
+TraceRecord trace_ring[CSC369_TRACE_RECORDS];
+
+/**
+ * The index of the next event.
+ */
+uint64_t trace_head = 0;
+
+__thread int trace_cpu __attribute__((tls_model("initial-exec"))) = 0;
+
+//****************************************************************************
+// Helper Functions
+//****************************************************************************
+static char const* const trace_names[] = { "switch", "sleep", "wake",   "create",
+                                           "exit",   "kill",  "preempt" };
+
+/**
+ * @return the time of record since start, in microseconds.
+ */
+double
+Trace_Usec(TraceRecord const* record, uint64_t start)
+{
+  return Stats_Nsec(record->time - start) / 1000.0;
+}
+
+/**
+ * Write a slice of cpu running tid from start to end, or of no time if the
+ * records of the switches came out of order.
+ */
+void
+Trace_WriteSlice(FILE* file, int cpu, int tid, double start, double end)
+{
+  fprintf(file,
+          ",\n{\"name\":\"thread %d\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+          "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"tid\":%d}}",
+          tid, cpu, start, end > start ? end - start : 0, tid);
+}
+
+//****************************************************************************
+// trace.h Functions
+//****************************************************************************
+void
+Trace_Write(TraceType type, int tid, int arg)
+{
+  uint64_t const index = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+  TraceRecord* record = &trace_ring[index & (CSC369_TRACE_RECORDS - 1)];
+  __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  record->time = Stats_Now();
+  record->type = type;
+  record->cpu = trace_cpu;
+  record->tid = tid;
+  record->arg = arg;
+  __atomic_store_n(&record->seq, (uint32_t)(index + 1), __ATOMIC_RELEASE);
+}
+
+void
+Trace_SetCpu(int cpu)
+{
+  trace_cpu = cpu;
+}
+
+int
+CSC369_TraceEnable(int enabled)
+{
+  int const prev = __atomic_exchange_n(&trace_enabled, enabled != 0, __ATOMIC_SEQ_CST);
+  // The calling thread has been running on this worker all along
+  if (enabled && !prev)
+    Trace_Write(TRACE_SWITCH, CSC369_ThreadId(), 0);
+  return prev;
+}
+
+int
+CSC369_TraceDump(char const* path)
+{
+  FILE* file = fopen(path, "w");
+  if (file == NULL)
+    return CSC369_ERROR_OTHER;
+
+  uint64_t const head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  uint64_t const first = head > CSC369_TRACE_RECORDS ? head - CSC369_TRACE_RECORDS : 0;
+  TraceRecord* records = malloc((head - first + 1) * sizeof(TraceRecord));
+  if (records == NULL) {
+    fclose(file);
+    return CSC369_ERROR_SYS_MEM;
+  }
+
+  // Copy the events out first, skipping those being overwritten
+  int num = 0, cpus = 1;
+  for (uint64_t i = first; i < head; i++) {
+    TraceRecord* record = &trace_ring[i & (CSC369_TRACE_RECORDS - 1)];
+    records[num] = *record;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (records[num].seq != (uint32_t)(i + 1) ||
+        __atomic_load_n(&record->seq, __ATOMIC_RELAXED) != (uint32_t)(i + 1))
+      continue;
+    if (records[num].cpu >= cpus)
+      cpus = records[num].cpu + 1;
+    num++;
+  }
+
+  // Which thread each worker has been running since when, or -1
+  int* running = malloc(cpus * sizeof(int));
+  double* since = malloc(cpus * sizeof(double));
+  if (running == NULL || since == NULL) {
+    free(running);
+    free(since);
+    free(records);
+    fclose(file);
+    return CSC369_ERROR_SYS_MEM;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"csc369\"}}");
+  for (int cpu = 0; cpu < cpus; cpu++) {
+    running[cpu] = -1;
+    fprintf(file,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+            "\"args\":{\"name\":\"worker %d\"}}",
+            cpu, cpu);
+  }
+
+  // Indices are claimed before the time is read, so a later record (from
+  // another worker, or an interrupt in between) can have an earlier time
+  uint64_t start = num > 0 ? records[0].time : 0;
+  for (int i = 1; i < num; i++) {
+    if (records[i].time < start)
+      start = records[i].time;
+  }
+  double end = 0;
+  for (int i = 0; i < num; i++) {
+    TraceRecord const* record = &records[i];
+    double const time = Trace_Usec(record, start);
+    end = time > end ? time : end;
+    if (record->type == TRACE_SWITCH) {
+      if (running[record->cpu] >= 0)
+        Trace_WriteSlice(file, record->cpu, running[record->cpu], since[record->cpu], time);
+      running[record->cpu] = record->tid;
+      since[record->cpu] = time;
+      continue;
+    }
+    fprintf(file,
+            ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,"
+            "\"ts\":%.3f,\"args\":{\"tid\":%d,\"arg\":%d}}",
+            trace_names[record->type], record->cpu, time, record->tid, record->arg);
+  }
+  // Close the slices of threads that are still running
+  for (int cpu = 0; cpu < cpus; cpu++) {
+    if (running[cpu] >= 0)
+      Trace_WriteSlice(file, cpu, running[cpu], since[cpu], end);
+  }
+  fprintf(file, "\n]}\n");
+
+  free(running);
+  free(since);
+  free(records);
+  if (fclose(file))
+    return CSC369_ERROR_OTHER;
+  return num;
+}
@@ -0,0 +1,87 @@
+/**
+ * CSC369 Assignment 2
+ *
+ * @file Defines the scheduler event trace.
+ *
+ * While tracing is enabled, every switch, sleep, wakeup, creation, exit, kill
+ * and preemption is recorded in a fixed-size ring of compact records, which
+ * keeps the most recent CSC369_TRACE_RECORDS events. Recording allocates
+ * nothing and takes no lock, so it is safe in the interrupt handler and on
+ * several workers at once. The ring can be written out as a Chrome trace
+ * (chrome://tracing or https://ui.perfetto.dev), with one row per worker
+ * showing which thread it ran when.
+ */
+#ifndef CSC369_TRACE_H
+#define CSC369_TRACE_H
+
+#include <stdint.h>
+
+/**
+ * The number of events the ring keeps, a power of two.
+ */
+#define CSC369_TRACE_RECORDS (1 << 16)
+
+/**
+ * Start (if enabled is not 0) or stop recording events.
+ *
+ * @return whether recording was enabled (1) or not (0) before the call.
+ */
+int
+CSC369_TraceEnable(int enabled);
+
+/**
+ * Write the recorded events to the file at path, in the Chrome trace event
+ * JSON format. Events keep being recorded meanwhile.
+ *
+ * This function may fail if:
+ *  - the file cannot be written (CSC369_ERROR_OTHER), or
+ *  - there is no more memory available (CSC369_ERROR_SYS_MEM)
+ *
+ * @return If successful, the number of events written. Otherwise, the
+ * appropriate error code.
+ */
+int
+CSC369_TraceDump(char const* path);
+
+//****************************************************************************
+// Library-internal Definitions
+//****************************************************************************
+typedef enum
+{
+  /**
+   * The worker started running the thread, or became idle if the thread is -1.
+   */
+  TRACE_SWITCH = 0,
+  TRACE_SLEEP = 1,
+  TRACE_WAKE = 2,
+  TRACE_CREATE = 3,
+  /**
+   * The argument is the exit code.
+   */
+  TRACE_EXIT = 4,
+  TRACE_KILL = 5,
+  TRACE_PREEMPT = 6
+} TraceType;
+
+extern volatile int trace_enabled;
+
+/**
+ * Record an event of type for thread tid, on the calling worker.
+ */
+void
+Trace_Write(TraceType type, int tid, int arg);
+
+static inline void
+Trace_Record(TraceType type, int tid, int arg)
+{
+  if (__builtin_expect(trace_enabled, 0))
+    Trace_Write(type, tid, arg);
+}
+
+/**
+ * Set the worker index that the calling kernel thread records events with.
+ */
+void
+Trace_SetCpu(int cpu);
+
+#endif // CSC369_TRACE_H
@@ -1,18 +1,70 @@
 #include "check.h"
 
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include <unistd.h>
 
+#include "csc369_chan.h"
+#include "csc369_executor.h"
+#include "csc369_futex.h"
 #include "csc369_interrupts.h"
+#include "csc369_io.h"
+#include "csc369_sync.h"
+#include "csc369_task.h"
+#include "csc369_trace.h"
 #include "csc369_thread.h"
 
 #include "check_thread_util.h"
 
 #define THREAD_COUNT 128
 #define EXIT_CODE_1 42
+#define LARGE_MAX_THREADS 4000
+#define WORKERS 4
+#define WORKER_THREAD_COUNT 16
+#define MUTEX_ITERATIONS 200
+#define SLEEP_DURATION 5000
+#define CHAN_ELEMENTS 1000
+#define EXECUTOR_TASKS 200
+#define TASK_POOL_THREADS 3
+#define FIB_N 12
+#define FIB_RESULT 144
+#define PARALLEL_FOR_END 10000
+#define BARRIER_PHASES 50
 
 int shared_integer = 0;
 
+// The kernel threads that user threads were seen running on
+pthread_t worker_pthreads[WORKERS];
+int worker_pthreads_num = 0;
+
+// Progress made by a thread that never blocks, and when to stop it
+volatile long hog_progress = 0;
+volatile int hog_stop = 0;
+long hog_progress_seen = -1;
+
+// Shared by the synchronization tests
+CSC369_Mutex mutex;
+CSC369_Cond cond;
+CSC369_Sema sema;
+CSC369_RWLock rwlock;
+volatile int rwlock_writing = 0;
+CSC369_Barrier barrier;
+CSC369_Latch latch;
+int barrier_arrivals[BARRIER_PHASES];
+int cond_ready = 0;
+
+// Shared by the handoff tests
+#define HANDOFF_ROUNDS 1000
+CSC369_WaitQueue* handoff_queue;
+int handoff_request = 0;
+int handoff_response = 0;
+
 //****************************************************************************
 // Functions to pass to CSC369_ThreadCreate
 //****************************************************************************
@@ -71,6 +123,244 @@ f_sleep(void *arg)
   CSC369_ThreadSleep(queue);
 }
 
+/**
+ * Sleep on handoff_queue, then claim shared_integer with mark, unless another
+ * thread claimed it first.
+ */
+void
+f_sleep_then_mark(int mark)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  CSC369_ThreadSleep(handoff_queue);
+  if (shared_integer == 0)
+    shared_integer = mark;
+  CSC369_InterruptsSet(prev_state);
+}
+
+void
+f_mark(int mark)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  if (shared_integer == 0)
+    shared_integer = mark;
+  CSC369_InterruptsSet(prev_state);
+}
+
+/**
+ * Answer each request handed off to us, until a request of -1.
+ */
+void
+f_serve_handoff(void)
+{
+  int prev_state = CSC369_InterruptsDisable();
+  while (1) {
+    CSC369_ThreadSleep(handoff_queue);
+    if (handoff_request < 0)
+      break;
+    handoff_response = handoff_request * 2;
+  }
+  CSC369_InterruptsSet(prev_state);
+}
+
+void
+f_sleep_for(int usec)
+{
+  ck_assert_int_eq(CSC369_ThreadSleepFor(usec), 0);
+  __sync_fetch_and_add(&shared_integer, 1);
+}
+
+void
+f_sleep_for_then_exit(int usec)
+{
+  ck_assert_int_eq(CSC369_ThreadSleepFor(usec), 0);
+  CSC369_ThreadExit(usec);
+}
+
+Tid join_targets[2];
+
+/**
+ * Wait for both join_targets, with CSC369_ThreadJoinAll if all or else
+ * CSC369_ThreadJoinAny, until killed.
+ */
+void
+f_join_targets(long all)
+{
+  Tid which;
+  int exit_codes[2];
+  if (all)
+    CSC369_ThreadJoinAll(join_targets, 2, exit_codes);
+  else
+    CSC369_ThreadJoinAny(join_targets, 2, &which, exit_codes);
+  ck_abort_msg("Joined threads that had not exited");
+}
+
+void
+f_sleep_for_then_wake(CSC369_WaitQueue* queue)
+{
+  ck_assert_int_eq(CSC369_ThreadSleepFor(SLEEP_DURATION), 0);
+  ck_assert_int_eq(CSC369_ThreadWakeNext(queue), 1);
+}
+
+void
+f_read_pipe(int fd)
+{
+  char buf[16] = { 0 };
+  ck_assert_int_eq(CSC369_Read(fd, buf, sizeof(buf)), 5);
+  ck_assert_str_eq(buf, "hello");
+  __sync_fetch_and_add(&shared_integer, 1);
+}
+
+/**
+ * Keep errno at value while being preempted by threads with other values.
+ */
+void
+f_keep_errno(long value)
+{
+  for (int i = 0; i < 10; i++) {
+    errno = (int)value;
+    CSC369_ThreadSpin(2 * CSC369_INTERRUPTS_SIGNAL_INTERVAL);
+    int const error = errno;
+    ck_assert_int_eq(error, value);
+  }
+}
+
+void
+f_accept_echo(int fd)
+{
+  int const conn = CSC369_Accept(fd, NULL, NULL);
+  ck_assert_int_ge(conn, 0);
+  char buf[16];
+  ssize_t const len = CSC369_Read(conn, buf, sizeof(buf));
+  ck_assert_int_gt(len, 0);
+  ck_assert_int_eq(CSC369_Write(conn, buf, len), len);
+  close(conn);
+}
+
+void
+f_chan_produce(CSC369_Chan* chan)
+{
+  for (long i = 1; i <= CHAN_ELEMENTS; i++)
+    ck_assert_int_eq(CSC369_ChanSend(chan, &i), 0);
+  ck_assert_int_eq(CSC369_ChanClose(chan), 0);
+}
+
+/**
+ * Double every element received from the first channel and send it on the
+ * second, until the first is closed.
+ */
+void
+f_chan_double(CSC369_Chan** chans)
+{
+  long value;
+  while (CSC369_ChanRecv(chans[0], &value) == 0) {
+    value *= 2;
+    ck_assert_int_eq(CSC369_ChanSend(chans[1], &value), 0);
+  }
+  ck_assert_int_eq(CSC369_ChanClose(chans[1]), 0);
+}
+
+/**
+ * Receive from either of two channels, which nothing sends to.
+ */
+void
+f_chan_select_forever(CSC369_Chan** chans)
+{
+  long values[2];
+  CSC369_SelectCase cases[2] = { { chans[0], CSC369_SELECT_RECV, &values[0], 0 },
+                                 { chans[1], CSC369_SELECT_RECV, &values[1], 0 } };
+  CSC369_ChanSelect(cases, 2, 1);
+  ck_abort_msg("select returned");
+}
+
+void*
+f_square(long n)
+{
+  // Give the other tasks a chance to run meanwhile
+  CSC369_ThreadYield();
+  return (void*)(n * n);
+}
+
+/**
+ * A Fibonacci number to compute with fork-join tasks.
+ */
+typedef struct
+{
+  CSC369_TaskPool* pool;
+  long n;
+  long result;
+} FibTask;
+
+void
+f_fib(FibTask* task)
+{
+  if (task->n < 2) {
+    task->result = task->n;
+    return;
+  }
+  FibTask children[2] = { { task->pool, task->n - 1, 0 },
+                          { task->pool, task->n - 2, 0 } };
+  CSC369_TaskGroup group;
+  CSC369_TaskGroupInit(&group, task->pool);
+  ck_assert_int_eq(CSC369_Spawn(&group, (void (*)(void*))f_fib, &children[0]), 0);
+  f_fib(&children[1]);
+  ck_assert_int_eq(CSC369_Sync(&group), 0);
+  task->result = children[0].result + children[1].result;
+}
+
+/**
+ * Add first, ..., last - 1 to *sum, and mark them visited.
+ */
+void
+f_add_range(long first, long last, long* sum)
+{
+  static char visited[PARALLEL_FOR_END];
+  long local = 0;
+  for (long i = first; i < last; i++) {
+    ck_assert(!visited[i]);
+    visited[i] = 1;
+    local += i;
+  }
+  __sync_fetch_and_add(sum, local);
+}
+
+/**
+ * @return the sum of the elements received from chan until it is closed.
+ */
+long
+chan_sum(CSC369_Chan* chan)
+{
+  long sum = 0, value;
+  int ret;
+  while ((ret = CSC369_ChanRecv(chan, &value)) == 0)
+    sum += value;
+  ck_assert_int_eq(ret, CSC369_ERROR_CLOSED);
+  return sum;
+}
+
+/**
+ * Write "hello" to the pipe in arg after a while, from a kernel thread.
+ */
+void*
+pthread_write_pipe(void* arg)
+{
+  usleep(SLEEP_DURATION);
+  int const ret = write(*(int*)arg, "hello", 5);
+  (void)ret;
+  return NULL;
+}
+
+/**
+ * @return the microseconds since start.
+ */
+long
+elapsed_usec(struct timeval const* start)
+{
+  struct timeval end, diff;
+  gettimeofday(&end, NULL);
+  timersub(&end, start, &diff);
+  return diff.tv_sec * 1000000 + diff.tv_usec;
+}
+
 void
 f_kill(int tid)
 {
@@ -85,6 +375,170 @@ f_kill(int tid)
   _exit(CSC369_TESTS_EXIT_SUCCESS);
 }
 
+void
+f_record_worker(int iterations)
+{
+  for (int i = 0; i < iterations; i++) {
+    CSC369_ThreadSpin(100);
+
+    int const prev_state = CSC369_InterruptsDisable();
+    pthread_t const self = pthread_self();
+    int seen = 0;
+    for (int j = 0; j < worker_pthreads_num; j++)
+      seen |= pthread_equal(worker_pthreads[j], self);
+    if (!seen) {
+      ck_assert_int_lt(worker_pthreads_num, WORKERS);
+      worker_pthreads[worker_pthreads_num++] = self;
+    }
+    shared_integer++;
+    CSC369_InterruptsSet(prev_state);
+
+    if (i % 8 == 0)
+      CSC369_ThreadYield();
+  }
+  CSC369_ThreadExit(iterations);
+}
+
+void
+f_hog(void)
+{
+  while (!hog_stop)
+    hog_progress++;
+}
+
+void
+f_see_hog(void)
+{
+  hog_progress_seen = hog_progress;
+}
+
+void
+f_count(volatile long* counter)
+{
+  while (!hog_stop)
+    (*counter)++;
+}
+
+/**
+ * A lock made of a single int: 0 if unlocked, 1 if locked, 2 if locked and
+ * threads may be waiting.
+ */
+volatile int futex_lock = 0;
+
+void
+f_futex_increment(void)
+{
+  for (int i = 0; i < MUTEX_ITERATIONS; i++) {
+    int state = __sync_val_compare_and_swap(&futex_lock, 0, 1);
+    if (state != 0) {
+      if (state != 2)
+        state = __atomic_exchange_n(&futex_lock, 2, __ATOMIC_ACQUIRE);
+      while (state != 0) {
+        int const ret = CSC369_FutexWait(&futex_lock, 2);
+        ck_assert(ret == 0 || ret == CSC369_ERROR_WOULD_BLOCK);
+        state = __atomic_exchange_n(&futex_lock, 2, __ATOMIC_ACQUIRE);
+      }
+    }
+    int const value = shared_integer;
+    CSC369_ThreadSpin(i % 10 == 0 ? CSC369_INTERRUPTS_SIGNAL_INTERVAL : 1);
+    shared_integer = value + 1;
+    if (__sync_fetch_and_sub(&futex_lock, 1) != 1) {
+      futex_lock = 0;
+      CSC369_FutexWake(&futex_lock, 1);
+    }
+  }
+}
+
+void
+f_futex_wait(volatile int* flag)
+{
+  while (*flag == 0)
+    ck_assert_int_eq(CSC369_FutexWait(flag, 0), 0);
+  __sync_fetch_and_add(&shared_integer, 1);
+}
+
+void
+f_mutex_increment(void)
+{
+  for (int i = 0; i < MUTEX_ITERATIONS; i++) {
+    ck_assert_int_eq(CSC369_MutexLock(&mutex), 0);
+    int const value = shared_integer;
+    // Hold the mutex long enough to be preempted in the critical section
+    CSC369_ThreadSpin(i % 10 == 0 ? CSC369_INTERRUPTS_SIGNAL_INTERVAL : 1);
+    shared_integer = value + 1;
+    ck_assert_int_eq(CSC369_MutexUnlock(&mutex), 0);
+  }
+}
+
+void
+f_rwlock_access(long writer)
+{
+  for (int i = 0; i < MUTEX_ITERATIONS; i++) {
+    if (writer) {
+      ck_assert_int_eq(CSC369_RWLockWriteLock(&rwlock), 0);
+      rwlock_writing = 1;
+      int const value = shared_integer;
+      CSC369_ThreadSpin(i % 10 == 0 ? CSC369_INTERRUPTS_SIGNAL_INTERVAL : 1);
+      shared_integer = value + 1;
+      rwlock_writing = 0;
+      ck_assert_int_eq(CSC369_RWLockWriteUnlock(&rwlock), 0);
+    } else {
+      ck_assert_int_eq(CSC369_RWLockReadLock(&rwlock), 0);
+      ck_assert_int_eq(rwlock_writing, 0);
+      CSC369_ThreadSpin(i % 10 == 0 ? CSC369_INTERRUPTS_SIGNAL_INTERVAL : 1);
+      ck_assert_int_eq(rwlock_writing, 0);
+      ck_assert_int_eq(CSC369_RWLockReadUnlock(&rwlock), 0);
+    }
+  }
+}
+
+void
+f_rwlock_read(void)
+{
+  ck_assert_int_eq(CSC369_RWLockReadLock(&rwlock), 0);
+  __sync_fetch_and_add(&shared_integer, 1);
+  ck_assert_int_eq(CSC369_RWLockReadUnlock(&rwlock), 0);
+}
+
+void
+f_barrier_phases(void)
+{
+  for (int i = 0; i < BARRIER_PHASES; i++) {
+    __sync_fetch_and_add(&barrier_arrivals[i], 1);
+    int const ret = CSC369_BarrierWait(&barrier);
+    ck_assert(ret == 0 || ret == 1);
+    if (ret == 1)
+      __sync_fetch_and_add(&shared_integer, 1);
+    // Every thread arrived in this phase before any left it
+    ck_assert_int_eq(barrier_arrivals[i], WORKER_THREAD_COUNT);
+  }
+}
+
+void
+f_latch_wait(void)
+{
+  ck_assert_int_eq(CSC369_LatchWait(&latch), 0);
+  ck_assert_int_eq(CSC369_LatchTryWait(&latch), 1);
+  __sync_fetch_and_add(&shared_integer, 1);
+}
+
+void
+f_cond_wait(void)
+{
+  ck_assert_int_eq(CSC369_MutexLock(&mutex), 0);
+  while (!cond_ready)
+    ck_assert_int_eq(CSC369_CondWait(&cond, &mutex), 0);
+  shared_integer++;
+  ck_assert_int_eq(CSC369_MutexUnlock(&mutex), 0);
+}
+
+void
+f_sema_wait(void)
+{
+  ck_assert_int_eq(CSC369_SemaWait(&sema), 0);
+  __sync_fetch_and_add(&shared_integer, 1);
+}
+
 //****************************************************************************
 // Functions to run before/after every test
 //****************************************************************************
@@ -154,6 +608,94 @@ START_TEST(test_wakenext_f_sleep)
 }
 END_TEST
 
+START_TEST(test_sleep_for_only_thread)
+{
+  ck_assert_int_eq(CSC369_ThreadSleepFor(-1), CSC369_ERROR_OTHER);
+
+  // No other thread can run, but the timer still wakes us
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  ck_assert_int_eq(CSC369_ThreadSleepFor(SLEEP_DURATION), 0);
+  ck_assert_int_ge(elapsed_usec(&start), SLEEP_DURATION);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_sleep_for_runs_others)
+{
+  static volatile long count = 0;
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_count, (void*)&count);
+  ck_assert_int_gt(tid, 0);
+
+  // The counting thread runs while we sleep
+  ck_assert_int_eq(CSC369_ThreadSleepFor(SLEEP_DURATION), 0);
+  ck_assert_int_gt(count, 0);
+  hog_stop = 1;
+  int exit_code;
+  ck_assert_int_eq(CSC369_ThreadJoin(tid, &exit_code), tid);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_sleep_for_f_sleep_for)
+{
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_sleep_for, (void*)(long)(i * 100));
+    ck_assert_int_gt(tid, 0);
+  }
+
+  // The sleepers finish in about THREAD_COUNT * 100 microseconds
+  while (shared_integer < THREAD_COUNT)
+    ck_assert_int_eq(CSC369_ThreadSleepFor(1000), 0);
+  yield_till_main_thread();
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_sleep_timeout)
+{
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  ck_assert(queue != NULL);
+  ck_assert_int_eq(CSC369_ThreadSleepTimeout(queue, -1), CSC369_ERROR_OTHER);
+
+  // Nothing wakes us, so we time out and leave the queue
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  ck_assert_int_eq(CSC369_ThreadSleepTimeout(queue, SLEEP_DURATION), CSC369_ERROR_TIMEOUT);
+  ck_assert_int_ge(elapsed_usec(&start), SLEEP_DURATION);
+  ck_assert_int_eq(CSC369_ThreadWakeNext(queue), 0);
+
+  // Woken up before the timeout
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_sleep_for_then_wake, queue);
+  ck_assert_int_gt(tid, 0);
+  ck_assert_int_ge(CSC369_ThreadSleepTimeout(queue, 100 * SLEEP_DURATION), 0);
+  ck_assert_int_lt(elapsed_usec(&start), 100 * SLEEP_DURATION);
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_kill_sleep_for)
+{
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_sleep_for, (void*)100000000);
+  ck_assert_int_gt(tid, 0);
+  yield_till_main_thread();
+
+  // Its timer is cancelled, so no thread is left that could wake us
+  ck_assert_int_eq(CSC369_ThreadKill(tid), tid);
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  ck_assert_int_eq(CSC369_ThreadSleep(queue), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+  ck_assert_int_eq(shared_integer, 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
 START_TEST(test_wakeall_f_sleep)
 {
   CSC369_WaitQueue *queue = CSC369_WaitQueueCreate();
@@ -202,6 +744,79 @@ START_TEST(test_wakeall_f_sleep_max)
 }
 END_TEST
 
+START_TEST(test_waken_f_sleep)
+{
+  CSC369_WaitQueue *queue = CSC369_WaitQueueCreate();
+  ck_assert(queue != NULL);
+
+  for (int i = 0; i < 5; i++)
+    ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_sleep, (void*)queue), 0);
+  yield_till_main_thread();
+
+  ck_assert_int_eq(CSC369_ThreadWakeN(queue, -1), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_ThreadWakeN(queue, 0), 0);
+  ck_assert_int_eq(CSC369_ThreadWakeN(queue, 2), 2);
+  // The woken threads exit, the others keep sleeping
+  yield_till_main_thread();
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_ThreadWakeN(queue, 10), 3);
+  ck_assert_int_eq(CSC369_ThreadWakeN(queue, 1), 0);
+  yield_till_main_thread();
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_wake_and_yield)
+{
+  handoff_queue = CSC369_WaitQueueCreate();
+  ck_assert(handoff_queue != NULL);
+  ck_assert_int_eq(CSC369_ThreadWakeAndYield(handoff_queue), 0);
+
+  ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_sleep_then_mark, (void*)1), 0);
+  yield_till_main_thread();
+  int prev_state = CSC369_InterruptsDisable();
+  ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_mark, (void*)2), 0);
+
+  // The woken thread runs before the thread that was already ready
+  ck_assert_int_eq(CSC369_ThreadWakeAndYield(handoff_queue), 1);
+  ck_assert_int_eq(shared_integer, 1);
+  CSC369_InterruptsSet(prev_state);
+
+  yield_till_main_thread();
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(handoff_queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_wake_and_yield_round_trip)
+{
+  handoff_queue = CSC369_WaitQueueCreate();
+  ck_assert(handoff_queue != NULL);
+  ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_serve_handoff, NULL), 0);
+  while (CSC369_ThreadWakeAndYield(handoff_queue) == 0)
+    CSC369_ThreadYield();
+
+  int prev_state = CSC369_InterruptsDisable();
+  for (int i = 1; i <= HANDOFF_ROUNDS; i++) {
+    handoff_request = i;
+    // The server answers and sleeps again before we run
+    ck_assert_int_eq(CSC369_ThreadWakeAndYield(handoff_queue), 1);
+    ck_assert_int_eq(handoff_response, i * 2);
+  }
+  handoff_request = -1;
+  ck_assert_int_eq(CSC369_ThreadWakeAndYield(handoff_queue), 1);
+  CSC369_InterruptsSet(prev_state);
+
+  yield_till_main_thread();
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(handoff_queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
 //****************************************************************************
 // Testing join behaviour
 //****************************************************************************
@@ -288,6 +903,1214 @@ START_TEST(test_join_main_is_killed)
 }
 END_TEST
 
+START_TEST(test_join_any_all)
+{
+  Tid tids[3];
+  int const durations[3] = { 3 * SLEEP_DURATION, SLEEP_DURATION, 2 * SLEEP_DURATION };
+  for (int i = 0; i < 3; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_sleep_for_then_exit,
+                                  (void*)(long)durations[i]);
+    ck_assert_int_gt(tids[i], 0);
+  }
+  Tid which;
+  int exit_code;
+  ck_assert_int_eq(CSC369_ThreadJoinAny(tids, 0, &which, &exit_code), CSC369_ERROR_OTHER);
+  Tid const self = 0;
+  ck_assert_int_eq(CSC369_ThreadJoinAny(&self, 1, &which, &exit_code), CSC369_ERROR_THREAD_BAD);
+
+  // The shortest sleeper exits first
+  ck_assert_int_eq(CSC369_ThreadJoinAny(tids, 3, &which, &exit_code), tids[1]);
+  ck_assert_int_eq(which, tids[1]);
+  ck_assert_int_eq(exit_code, SLEEP_DURATION);
+
+  // The others, in one wait
+  Tid const rest[2] = { tids[0], tids[2] };
+  int exit_codes[2];
+  ck_assert_int_eq(CSC369_ThreadJoinAll(rest, 2, exit_codes), 0);
+  ck_assert_int_eq(exit_codes[0], 3 * SLEEP_DURATION);
+  ck_assert_int_eq(exit_codes[1], 2 * SLEEP_DURATION);
+
+  // Their exit codes are gone
+  ck_assert_int_eq(CSC369_ThreadJoinAny(tids, 3, &which, &exit_code), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_ThreadJoinAll(tids, 3, exit_codes), CSC369_ERROR_SYS_THREAD);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_join_any_all_killed)
+{
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  ck_assert(queue != NULL);
+  Tid tids[4];
+  for (int i = 0; i < 2; i++) {
+    join_targets[i] = tids[i] = CSC369_ThreadCreate(f_sleep, queue);
+    ck_assert_int_gt(tids[i], 0);
+  }
+  for (int i = 2; i < 4; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_join_targets, (void*)(long)(i == 2));
+    ck_assert_int_gt(tids[i], 0);
+  }
+  // Until all of them wait
+  for (int i = 0; i < 4; i++) {
+    CSC369_ThreadStats stats;
+    do {
+      CSC369_ThreadYield();
+      ck_assert_int_eq(CSC369_ThreadGetStats(tids[i], &stats), 0);
+    } while (stats.voluntary_switches == 0);
+  }
+
+  // The joins of the killed threads are taken off the targets, which then exit
+  ck_assert_int_eq(CSC369_ThreadKill(tids[2]), tids[2]);
+  ck_assert_int_eq(CSC369_ThreadKill(tids[3]), tids[3]);
+  ck_assert_int_eq(CSC369_ThreadWakeAll(queue), 2);
+  int exit_codes[2];
+  ck_assert_int_eq(CSC369_ThreadJoinAll(join_targets, 2, exit_codes), 0);
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+void
+set_up_with_kept_exit_codes(void)
+{
+  CSC369_ThreadConfig config;
+  CSC369_ThreadConfigInit(&config);
+  config.keep_exit_codes = 1;
+  ck_assert_int_eq(CSC369_ThreadInitConfig(&config), 0);
+  CSC369_InterruptsInit();
+}
+
+START_TEST(test_join_kept_exit_code)
+{
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_yield_explicit_exit, (void*)EXIT_CODE_1);
+  ck_assert_int_gt(tid, 0);
+  int exit_code = 0;
+  ck_assert_int_eq(CSC369_ThreadJoin(tid, &exit_code), tid);
+  ck_assert_int_eq(exit_code, EXIT_CODE_1);
+
+  // The exit code can still be read, until the thread is detached
+  exit_code = 0;
+  ck_assert_int_eq(CSC369_ThreadJoin(tid, &exit_code), tid);
+  ck_assert_int_eq(exit_code, EXIT_CODE_1);
+  Tid which;
+  ck_assert_int_eq(CSC369_ThreadJoinAny(&tid, 1, &which, &exit_code), tid);
+
+  ck_assert_int_eq(CSC369_ThreadDetach(tid), 0);
+  ck_assert_int_eq(CSC369_ThreadJoin(tid, &exit_code), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_ThreadDetach(tid), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_ThreadDetach(-1), CSC369_ERROR_TID_INVALID);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing a configured maximum number of threads
+//****************************************************************************
+START_TEST(test_create_large_max)
+{
+  CSC369_ThreadConfig config;
+  CSC369_ThreadConfigInit(&config);
+  config.max_threads = LARGE_MAX_THREADS;
+  ck_assert_int_eq(CSC369_ThreadInitConfig(&config), 0);
+
+  for (int i = 0; i < LARGE_MAX_THREADS - 1; i++) {
+    Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_do_nothing, NULL);
+    ck_assert_int_gt(tid, 0);
+    ck_assert_int_lt(tid, LARGE_MAX_THREADS);
+  }
+
+  // Now we are out of threads. Next create should fail.
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_do_nothing, NULL);
+  ck_assert_int_eq(tid, CSC369_ERROR_SYS_THREAD);
+
+  // Let every thread run and exit, then check their tids are reused
+  yield_till_main_thread();
+  for (int i = 0; i < LARGE_MAX_THREADS - 1; i++) {
+    Tid const new_tid = CSC369_ThreadCreate((void (*)(void*))f_do_nothing, NULL);
+    ck_assert_int_gt(new_tid, 0);
+    ck_assert_int_lt(new_tid, LARGE_MAX_THREADS);
+  }
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_create_small_max)
+{
+  CSC369_ThreadConfig config;
+  CSC369_ThreadConfigInit(&config);
+  config.max_threads = 2;
+  ck_assert_int_eq(CSC369_ThreadInitConfig(&config), 0);
+
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_do_nothing, NULL);
+  ck_assert_int_eq(tid, 1);
+  ck_assert_int_eq(CSC369_ThreadCreate((void (*)(void*))f_do_nothing, NULL), CSC369_ERROR_SYS_THREAD);
+
+  // Identifiers past the maximum are invalid
+  ck_assert_int_eq(CSC369_ThreadKill(2), CSC369_ERROR_TID_INVALID);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing several workers
+//****************************************************************************
+void
+set_up_with_workers(void)
+{
+  CSC369_ThreadConfig config;
+  CSC369_ThreadConfigInit(&config);
+  config.workers = WORKERS;
+  ck_assert_int_eq(CSC369_ThreadInitConfig(&config), 0);
+  CSC369_InterruptsInit();
+}
+
+START_TEST(test_workers_run_threads)
+{
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_record_worker, (void*)100);
+    ck_assert_int_gt(tids[i], 0);
+  }
+
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    int exit_code;
+    int const ret = CSC369_ThreadJoin(tids[i], &exit_code);
+    if (ret == tids[i]) {
+      ck_assert_int_eq(exit_code, 100);
+    } else {
+      // It exited before we could join it
+      ck_assert_int_eq(ret, CSC369_ERROR_SYS_THREAD);
+    }
+  }
+
+  int const prev_state = CSC369_InterruptsDisable();
+  ck_assert_int_eq(shared_integer, WORKER_THREAD_COUNT * 100);
+  // Idle workers should have stolen some of the threads
+  ck_assert_int_gt(worker_pthreads_num, 1);
+  CSC369_InterruptsSet(prev_state);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_workers_sleep_no_work)
+{
+  // No other thread exists, on any worker, that could wake us
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  ck_assert_int_eq(CSC369_ThreadSleep(queue), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_workers_wakeall_f_sleep)
+{
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate(f_sleep, queue);
+    ck_assert_int_gt(tids[i], 0);
+  }
+
+  // Wake the sleepers as they arrive, wherever they run
+  int woken = 0;
+  while (woken < WORKER_THREAD_COUNT) {
+    woken += CSC369_ThreadWakeAll(queue);
+    CSC369_ThreadYield();
+  }
+
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    int exit_code;
+    int const ret = CSC369_ThreadJoin(tids[i], &exit_code);
+    ck_assert(ret == tids[i] || ret == CSC369_ERROR_SYS_THREAD);
+  }
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing scheduling policies
+//****************************************************************************
+void
+set_up_with_mlfq(void)
+{
+  CSC369_ThreadConfig config;
+  CSC369_ThreadConfigInit(&config);
+  config.policy = CSC369_SCHED_MLFQ;
+  ck_assert_int_eq(CSC369_ThreadInitConfig(&config), 0);
+  CSC369_InterruptsInit();
+}
+
+START_TEST(test_mlfq_new_thread_before_hog)
+{
+  Tid const hog = CSC369_ThreadCreate((void (*)(void*))f_hog, NULL);
+  ck_assert_int_gt(hog, 0);
+
+  // Let interrupts switch between us and the hog a few times, demoting it
+  for (int switches = 0; switches < 4;) {
+    long const before = hog_progress;
+    CSC369_ThreadSpin(50);
+    if (hog_progress != before)
+      switches++;
+  }
+
+  // The hog is ready before the new thread is, but has a lower priority
+  int const prev_state = CSC369_InterruptsDisable();
+  long const progress = hog_progress;
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_see_hog, NULL);
+  ck_assert_int_gt(tid, 0);
+  CSC369_ThreadYield();
+  CSC369_InterruptsSet(prev_state);
+
+  while (hog_progress_seen == -1)
+    CSC369_ThreadYield();
+  ck_assert_int_eq(hog_progress_seen, progress);
+
+  hog_stop = 1;
+  int exit_code;
+  ck_assert_int_eq(CSC369_ThreadJoin(hog, &exit_code), hog);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_mlfq_wakeall_f_sleep)
+{
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    ck_assert_int_gt(CSC369_ThreadCreate(f_sleep, queue), 0);
+  }
+
+  while (CSC369_ThreadYield() != CSC369_ThreadId());
+  ck_assert_int_eq(CSC369_ThreadWakeAll(queue), THREAD_COUNT);
+  yield_till_main_thread();
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+void
+set_up_with_fair(void)
+{
+  CSC369_ThreadConfig config;
+  CSC369_ThreadConfigInit(&config);
+  config.policy = CSC369_SCHED_FAIR;
+  ck_assert_int_eq(CSC369_ThreadInitConfig(&config), 0);
+  CSC369_InterruptsInit();
+}
+
+START_TEST(test_fair_weights)
+{
+  static volatile long heavy_count = 0;
+  static volatile long light_count = 0;
+  Tid const heavy = CSC369_ThreadCreate((void (*)(void*))f_count, (void*)&heavy_count);
+  Tid const light = CSC369_ThreadCreate((void (*)(void*))f_count, (void*)&light_count);
+  ck_assert_int_gt(heavy, 0);
+  ck_assert_int_gt(light, 0);
+  ck_assert_int_eq(CSC369_ThreadSetWeight(heavy, 3 * CSC369_THREAD_DEFAULT_WEIGHT), 0);
+
+  // Both compete with us for a while
+  CSC369_ThreadSpin(200000);
+  hog_stop = 1;
+  int exit_code;
+  CSC369_ThreadJoin(heavy, &exit_code);
+  CSC369_ThreadJoin(light, &exit_code);
+
+  // The heavy thread should have run about 3 times as long
+  ck_assert_int_gt(light_count, 0);
+  ck_assert_int_gt(heavy_count, 2 * light_count);
+  ck_assert_int_lt(heavy_count, 5 * light_count);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_fair_set_weight_errors)
+{
+  ck_assert_int_eq(CSC369_ThreadSetWeight(-1, 1), CSC369_ERROR_TID_INVALID);
+  ck_assert_int_eq(CSC369_ThreadSetWeight(CSC369_MAX_THREADS, 1), CSC369_ERROR_TID_INVALID);
+  ck_assert_int_eq(CSC369_ThreadSetWeight(1, 1), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_ThreadSetWeight(0, 0), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_ThreadSetWeight(0, 1), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing time slices
+//****************************************************************************
+START_TEST(test_quantum_errors)
+{
+  ck_assert_int_eq(CSC369_ThreadSetQuantum(-1, 1000), CSC369_ERROR_TID_INVALID);
+  ck_assert_int_eq(CSC369_ThreadSetQuantum(CSC369_MAX_THREADS, 1000), CSC369_ERROR_TID_INVALID);
+  ck_assert_int_eq(CSC369_ThreadSetQuantum(1, 1000), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_ThreadSetQuantum(0, -1), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_ThreadSetQuantum(0, 1000), 0);
+  ck_assert_int_eq(CSC369_ThreadSetQuantum(0, 0), 0);
+  ck_assert_int_eq(CSC369_InterruptsSetQuantum(0), -1);
+  ck_assert_int_eq(CSC369_InterruptsSetQuantum(500), 0);
+  ck_assert_int_eq(CSC369_InterruptsGetQuantum(), 500);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_quantum_long_slice)
+{
+  static volatile long long_count = 0;
+  static volatile long short_count = 0;
+  Tid const long_tid = CSC369_ThreadCreate((void (*)(void*))f_count, (void*)&long_count);
+  Tid const short_tid = CSC369_ThreadCreate((void (*)(void*))f_count, (void*)&short_count);
+  ck_assert_int_gt(long_tid, 0);
+  ck_assert_int_gt(short_tid, 0);
+  ck_assert_int_eq(CSC369_ThreadSetQuantum(long_tid, 25 * CSC369_INTERRUPTS_SIGNAL_INTERVAL), 0);
+
+  // Each thread is preempted once per round, after its own slice
+  CSC369_ThreadSpin(200000);
+  hog_stop = 1;
+  int exit_code;
+  CSC369_ThreadJoin(long_tid, &exit_code);
+  CSC369_ThreadJoin(short_tid, &exit_code);
+
+  ck_assert_int_gt(short_count, 0);
+  ck_assert_int_gt(long_count, 5 * short_count);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_quantum_deferred_preemption)
+{
+  static volatile long count = 0;
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_count, (void*)&count);
+  ck_assert_int_gt(tid, 0);
+  CSC369_ThreadYield();
+
+  // The interrupts that arrive while they are disabled preempt us once they
+  // are enabled again, which counts as a preemption rather than a yield
+  CSC369_ThreadStats before, after;
+  ck_assert_int_eq(CSC369_ThreadGetStats(0, &before), 0);
+  int const prev_state = CSC369_InterruptsDisable();
+  CSC369_ThreadSpin(3 * CSC369_INTERRUPTS_SIGNAL_INTERVAL);
+  CSC369_InterruptsSet(prev_state);
+  ck_assert_int_eq(CSC369_ThreadGetStats(0, &after), 0);
+  ck_assert_int_gt(after.preempted_switches, before.preempted_switches);
+  ck_assert_int_eq(after.voluntary_switches, before.voluntary_switches);
+  hog_stop = 1;
+  int exit_code;
+  CSC369_ThreadJoin(tid, &exit_code);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_quantum_only_thread)
+{
+  static volatile long count = 0;
+  // Once switched, the only thread is no longer interrupted
+  CSC369_ThreadYield();
+  CSC369_ThreadStats before, after;
+  ck_assert_int_eq(CSC369_ThreadGetStats(0, &before), 0);
+  CSC369_ThreadSpin(20 * CSC369_INTERRUPTS_SIGNAL_INTERVAL);
+  ck_assert_int_eq(CSC369_ThreadGetStats(0, &after), 0);
+  ck_assert_int_eq(after.preempted_switches, before.preempted_switches);
+
+  // Until another thread can run
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_count, (void*)&count);
+  ck_assert_int_gt(tid, 0);
+  CSC369_ThreadSpin(20 * CSC369_INTERRUPTS_SIGNAL_INTERVAL);
+  ck_assert_int_eq(CSC369_ThreadGetStats(0, &after), 0);
+  ck_assert_int_gt(after.preempted_switches, before.preempted_switches);
+  hog_stop = 1;
+  int exit_code;
+  CSC369_ThreadJoin(tid, &exit_code);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_fair_wakeall_f_sleep)
+{
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    ck_assert_int_gt(CSC369_ThreadCreate(f_sleep, queue), 0);
+  }
+
+  while (CSC369_ThreadYield() != CSC369_ThreadId());
+  ck_assert_int_eq(CSC369_ThreadWakeAll(queue), THREAD_COUNT);
+  yield_till_main_thread();
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing synchronization primitives
+//****************************************************************************
+START_TEST(test_mutex_errors)
+{
+  ck_assert_int_eq(CSC369_MutexInit(&mutex), 0);
+  ck_assert_int_eq(CSC369_MutexUnlock(&mutex), CSC369_ERROR_THREAD_BAD);
+  ck_assert_int_eq(CSC369_MutexLock(&mutex), 0);
+  ck_assert_int_eq(CSC369_MutexLock(&mutex), CSC369_ERROR_THREAD_BAD);
+  ck_assert_int_eq(CSC369_MutexTryLock(&mutex), 0);
+  ck_assert_int_eq(CSC369_MutexDestroy(&mutex), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_MutexUnlock(&mutex), 0);
+  ck_assert_int_eq(CSC369_MutexTryLock(&mutex), 1);
+  ck_assert_int_eq(CSC369_MutexUnlock(&mutex), 0);
+  ck_assert_int_eq(CSC369_MutexDestroy(&mutex), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_mutex_contended)
+{
+  ck_assert_int_eq(CSC369_MutexInit(&mutex), 0);
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_mutex_increment, NULL);
+    ck_assert_int_gt(tids[i], 0);
+  }
+
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    int exit_code;
+    int const ret = CSC369_ThreadJoin(tids[i], &exit_code);
+    ck_assert(ret == tids[i] || ret == CSC369_ERROR_SYS_THREAD);
+  }
+  ck_assert_int_eq(shared_integer, WORKER_THREAD_COUNT * MUTEX_ITERATIONS);
+  ck_assert_int_eq(CSC369_MutexDestroy(&mutex), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_futex_wait_wake)
+{
+  static volatile int flags[2] = { 0, 0 };
+  ck_assert_int_eq(CSC369_FutexWait(&flags[0], 1), CSC369_ERROR_WOULD_BLOCK);
+  ck_assert_int_eq(CSC369_FutexWait(&flags[0], 0), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_FutexWake(&flags[0], -1), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_FutexWake(&flags[0], 1), 0);
+
+  Tid tids[2 * WORKER_THREAD_COUNT];
+  for (int i = 0; i < 2 * WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_futex_wait, (void*)&flags[i % 2]);
+    ck_assert_int_gt(tids[i], 0);
+  }
+  // Until all of them wait
+  for (int i = 0; i < 2 * WORKER_THREAD_COUNT; i++) {
+    CSC369_ThreadStats stats;
+    do {
+      CSC369_ThreadYield();
+      ck_assert_int_eq(CSC369_ThreadGetStats(tids[i], &stats), 0);
+    } while (stats.voluntary_switches == 0);
+  }
+
+  // Only the threads waiting on the address are woken up, n at a time
+  flags[0] = 1;
+  ck_assert_int_eq(CSC369_FutexWake(&flags[0], 3), 3);
+  ck_assert_int_eq(CSC369_FutexWake(&flags[0], 2 * WORKER_THREAD_COUNT), WORKER_THREAD_COUNT - 3);
+  ck_assert_int_eq(CSC369_FutexWake(&flags[0], 1), 0);
+  while (shared_integer < WORKER_THREAD_COUNT)
+    CSC369_ThreadYield();
+
+  flags[1] = 1;
+  ck_assert_int_eq(CSC369_FutexWake(&flags[1], 2 * WORKER_THREAD_COUNT), WORKER_THREAD_COUNT);
+  while (shared_integer < 2 * WORKER_THREAD_COUNT)
+    CSC369_ThreadYield();
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_futex_lock_contended)
+{
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_futex_increment, NULL);
+    ck_assert_int_gt(tids[i], 0);
+  }
+
+  int exit_codes[WORKER_THREAD_COUNT];
+  ck_assert_int_eq(CSC369_ThreadJoinAll(tids, WORKER_THREAD_COUNT, exit_codes), 0);
+  ck_assert_int_eq(shared_integer, WORKER_THREAD_COUNT * MUTEX_ITERATIONS);
+  ck_assert_int_eq(futex_lock, 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_rwlock_errors)
+{
+  ck_assert_int_eq(CSC369_RWLockInit(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockReadUnlock(&rwlock), CSC369_ERROR_THREAD_BAD);
+  ck_assert_int_eq(CSC369_RWLockWriteUnlock(&rwlock), CSC369_ERROR_THREAD_BAD);
+
+  ck_assert_int_eq(CSC369_RWLockReadLock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockTryReadLock(&rwlock), 1);
+  ck_assert_int_eq(CSC369_RWLockTryWriteLock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockWriteUnlock(&rwlock), CSC369_ERROR_THREAD_BAD);
+  // No other thread could unlock it
+  ck_assert_int_eq(CSC369_RWLockWriteLock(&rwlock), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_RWLockDestroy(&rwlock), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_RWLockReadUnlock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockReadUnlock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockReadUnlock(&rwlock), CSC369_ERROR_THREAD_BAD);
+
+  ck_assert_int_eq(CSC369_RWLockWriteLock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockWriteLock(&rwlock), CSC369_ERROR_THREAD_BAD);
+  ck_assert_int_eq(CSC369_RWLockReadLock(&rwlock), CSC369_ERROR_THREAD_BAD);
+  ck_assert_int_eq(CSC369_RWLockTryReadLock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockReadUnlock(&rwlock), CSC369_ERROR_THREAD_BAD);
+  ck_assert_int_eq(CSC369_RWLockDestroy(&rwlock), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_RWLockWriteUnlock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockTryWriteLock(&rwlock), 1);
+  ck_assert_int_eq(CSC369_RWLockWriteUnlock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockDestroy(&rwlock), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_rwlock_contended)
+{
+  ck_assert_int_eq(CSC369_RWLockInit(&rwlock), 0);
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    // A quarter of the threads write
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_rwlock_access, (void*)(long)(i % 4 == 0));
+    ck_assert_int_gt(tids[i], 0);
+  }
+
+  int exit_codes[WORKER_THREAD_COUNT];
+  ck_assert_int_eq(CSC369_ThreadJoinAll(tids, WORKER_THREAD_COUNT, exit_codes), 0);
+  ck_assert_int_eq(shared_integer, WORKER_THREAD_COUNT / 4 * MUTEX_ITERATIONS);
+  ck_assert_int_eq(CSC369_RWLockDestroy(&rwlock), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_rwlock_batch_readers)
+{
+  ck_assert_int_eq(CSC369_RWLockInit(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockWriteLock(&rwlock), 0);
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_rwlock_read, NULL);
+    ck_assert_int_gt(tids[i], 0);
+  }
+  // Until all of them wait
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    CSC369_ThreadStats stats;
+    do {
+      CSC369_ThreadYield();
+      ck_assert_int_eq(CSC369_ThreadGetStats(tids[i], &stats), 0);
+    } while (stats.voluntary_switches == 0);
+  }
+
+  // The waiting readers are admitted before the lock can be written again
+  ck_assert_int_eq(CSC369_RWLockWriteUnlock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockWriteLock(&rwlock), 0);
+  ck_assert_int_eq(shared_integer, WORKER_THREAD_COUNT);
+  ck_assert_int_eq(CSC369_RWLockWriteUnlock(&rwlock), 0);
+  ck_assert_int_eq(CSC369_RWLockDestroy(&rwlock), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_barrier_errors)
+{
+  ck_assert_int_eq(CSC369_BarrierInit(&barrier, 0), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_BarrierInit(&barrier, 1), 0);
+  ck_assert_int_eq(CSC369_BarrierWait(&barrier), 1);
+  ck_assert_int_eq(CSC369_BarrierWait(&barrier), 1);
+  ck_assert_int_eq(CSC369_BarrierDestroy(&barrier), 0);
+
+  ck_assert_int_eq(CSC369_BarrierInit(&barrier, 2), 0);
+  // No other thread could arrive
+  ck_assert_int_eq(CSC369_BarrierWait(&barrier), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_BarrierDestroy(&barrier), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_barrier_phases)
+{
+  ck_assert_int_eq(CSC369_BarrierInit(&barrier, WORKER_THREAD_COUNT), 0);
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_barrier_phases, NULL);
+    ck_assert_int_gt(tids[i], 0);
+  }
+
+  int exit_codes[WORKER_THREAD_COUNT];
+  ck_assert_int_eq(CSC369_ThreadJoinAll(tids, WORKER_THREAD_COUNT, exit_codes), 0);
+  // One thread arrived last in each phase
+  ck_assert_int_eq(shared_integer, BARRIER_PHASES);
+  ck_assert_int_eq(CSC369_BarrierDestroy(&barrier), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_latch_count_down)
+{
+  ck_assert_int_eq(CSC369_LatchInit(&latch, -1), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_LatchInit(&latch, 2), 0);
+  ck_assert_int_eq(CSC369_LatchCountDown(&latch, -1), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_LatchCountDown(&latch, 3), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_LatchTryWait(&latch), 0);
+
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_latch_wait, NULL);
+    ck_assert_int_gt(tids[i], 0);
+  }
+  // Until all of them wait
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    CSC369_ThreadStats stats;
+    do {
+      CSC369_ThreadYield();
+      ck_assert_int_eq(CSC369_ThreadGetStats(tids[i], &stats), 0);
+    } while (stats.voluntary_switches == 0);
+  }
+
+  ck_assert_int_eq(CSC369_LatchCountDown(&latch, 1), 0);
+  ck_assert_int_eq(CSC369_LatchTryWait(&latch), 0);
+  ck_assert_int_eq(CSC369_LatchCountDown(&latch, 1), 0);
+  ck_assert_int_eq(CSC369_LatchTryWait(&latch), 1);
+  ck_assert_int_eq(CSC369_LatchCountDown(&latch, 1), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_LatchWait(&latch), 0);
+
+  int exit_codes[WORKER_THREAD_COUNT];
+  ck_assert_int_eq(CSC369_ThreadJoinAll(tids, WORKER_THREAD_COUNT, exit_codes), 0);
+  ck_assert_int_eq(shared_integer, WORKER_THREAD_COUNT);
+  ck_assert_int_eq(CSC369_LatchDestroy(&latch), 0);
+
+  ck_assert_int_eq(CSC369_LatchInit(&latch, 1), 0);
+  // No other thread could count it down
+  ck_assert_int_eq(CSC369_LatchWait(&latch), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_LatchDestroy(&latch), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_cond_broadcast)
+{
+  ck_assert_int_eq(CSC369_MutexInit(&mutex), 0);
+  ck_assert_int_eq(CSC369_CondInit(&cond), 0);
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_cond_wait, NULL), 0);
+  }
+
+  // Every thread is now waiting on the condition variable
+  while (CSC369_ThreadYield() != CSC369_ThreadId());
+  ck_assert_int_eq(CSC369_MutexLock(&mutex), 0);
+  cond_ready = 1;
+  ck_assert_int_eq(CSC369_CondBroadcast(&cond), THREAD_COUNT);
+  ck_assert_int_eq(CSC369_MutexUnlock(&mutex), 0);
+
+  yield_till_main_thread();
+  ck_assert_int_eq(shared_integer, THREAD_COUNT);
+  ck_assert_int_eq(CSC369_CondSignal(&cond), 0);
+  ck_assert_int_eq(CSC369_CondDestroy(&cond), 0);
+  ck_assert_int_eq(CSC369_MutexDestroy(&mutex), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_sema_post)
+{
+  ck_assert_int_eq(CSC369_SemaInit(&sema, -1), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_SemaInit(&sema, 1), 0);
+  ck_assert_int_eq(CSC369_SemaWait(&sema), 0);
+  // No other thread could post
+  ck_assert_int_eq(CSC369_SemaWait(&sema), CSC369_ERROR_SYS_THREAD);
+
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_sema_wait, NULL), 0);
+  }
+  for (int i = 0; i < THREAD_COUNT; i++) {
+    CSC369_SemaPost(&sema);
+  }
+
+  yield_till_main_thread();
+  ck_assert_int_eq(shared_integer, THREAD_COUNT);
+  ck_assert_int_eq(CSC369_SemaDestroy(&sema), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing channels
+//****************************************************************************
+START_TEST(test_chan_try)
+{
+  ck_assert(CSC369_ChanCreate(-2, sizeof(int)) == NULL);
+  CSC369_Chan* chan = CSC369_ChanCreate(2, sizeof(int));
+  ck_assert(chan != NULL);
+
+  int value = 1;
+  ck_assert_int_eq(CSC369_ChanTryRecv(chan, &value), CSC369_ERROR_WOULD_BLOCK);
+  ck_assert_int_eq(CSC369_ChanTrySend(chan, &value), 0);
+  value = 2;
+  ck_assert_int_eq(CSC369_ChanTrySend(chan, &value), 0);
+  ck_assert_int_eq(CSC369_ChanTrySend(chan, &value), CSC369_ERROR_WOULD_BLOCK);
+
+  // Buffered elements can still be received after closing
+  ck_assert_int_eq(CSC369_ChanClose(chan), 0);
+  ck_assert_int_eq(CSC369_ChanClose(chan), CSC369_ERROR_CLOSED);
+  ck_assert_int_eq(CSC369_ChanTrySend(chan, &value), CSC369_ERROR_CLOSED);
+  ck_assert_int_eq(CSC369_ChanTryRecv(chan, &value), 0);
+  ck_assert_int_eq(value, 1);
+  ck_assert_int_eq(CSC369_ChanRecv(chan, &value), 0);
+  ck_assert_int_eq(value, 2);
+  ck_assert_int_eq(CSC369_ChanRecv(chan, &value), CSC369_ERROR_CLOSED);
+  ck_assert_int_eq(CSC369_ChanDestroy(chan), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_chan_no_sender)
+{
+  CSC369_Chan* chan = CSC369_ChanCreate(0, sizeof(int));
+  int value;
+  ck_assert_int_eq(CSC369_ChanRecv(chan, &value), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_ChanSend(chan, &value), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_ChanDestroy(chan), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_chan_unbounded)
+{
+  CSC369_Chan* chan = CSC369_ChanCreate(CSC369_CHAN_UNBOUNDED, sizeof(long));
+  ck_assert(chan != NULL);
+  // Never blocks, even with no receiver
+  f_chan_produce(chan);
+  for (long i = 1; i <= CHAN_ELEMENTS; i++) {
+    long value;
+    ck_assert_int_eq(CSC369_ChanTryRecv(chan, &value), 0);
+    ck_assert_int_eq(value, i);
+  }
+  ck_assert_int_eq(CSC369_ChanDestroy(chan), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_chan_pipeline)
+{
+  // Unbuffered into buffered stages
+  CSC369_Chan* chans[2] = { CSC369_ChanCreate(0, sizeof(long)),
+                            CSC369_ChanCreate(4, sizeof(long)) };
+  ck_assert(chans[0] != NULL && chans[1] != NULL);
+  ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_chan_produce, chans[0]), 0);
+  ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_chan_double, chans), 0);
+
+  ck_assert_int_eq(chan_sum(chans[1]), (long)CHAN_ELEMENTS * (CHAN_ELEMENTS + 1));
+  yield_till_main_thread();
+  ck_assert_int_eq(CSC369_ChanDestroy(chans[0]), 0);
+  ck_assert_int_eq(CSC369_ChanDestroy(chans[1]), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_chan_select)
+{
+  CSC369_Chan* chans[2] = { CSC369_ChanCreate(0, sizeof(long)),
+                            CSC369_ChanCreate(0, sizeof(long)) };
+  long values[2];
+  CSC369_SelectCase cases[2] = { { chans[0], CSC369_SELECT_RECV, &values[0], 0 },
+                                 { chans[1], CSC369_SELECT_RECV, &values[1], 0 } };
+  ck_assert_int_eq(CSC369_ChanSelect(cases, 2, 0), CSC369_ERROR_WOULD_BLOCK);
+  ck_assert_int_eq(CSC369_ChanSelect(cases, 0, 1), CSC369_ERROR_OTHER);
+
+  ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_chan_produce, chans[0]), 0);
+  ck_assert_int_gt(CSC369_ThreadCreate((void (*)(void*))f_chan_produce, chans[1]), 0);
+
+  // Receive from both until both are closed
+  long sums[2] = { 0, 0 };
+  int open = 2;
+  while (open > 0) {
+    int const index = CSC369_ChanSelect(cases, open, 1);
+    ck_assert_int_ge(index, 0);
+    if (cases[index].status == CSC369_ERROR_CLOSED) {
+      // Stop selecting the closed channel
+      CSC369_SelectCase const closed = cases[index];
+      cases[index] = cases[open - 1];
+      cases[--open] = closed;
+    } else {
+      ck_assert_int_eq(cases[index].status, 0);
+      sums[cases[index].chan == chans[1]] += *(long*)cases[index].elem;
+    }
+  }
+  ck_assert_int_eq(sums[0], (long)CHAN_ELEMENTS * (CHAN_ELEMENTS + 1) / 2);
+  ck_assert_int_eq(sums[1], (long)CHAN_ELEMENTS * (CHAN_ELEMENTS + 1) / 2);
+  yield_till_main_thread();
+  ck_assert_int_eq(CSC369_ChanDestroy(chans[0]), 0);
+  ck_assert_int_eq(CSC369_ChanDestroy(chans[1]), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_chan_select_kill)
+{
+  CSC369_Chan* chans[2] = { CSC369_ChanCreate(0, sizeof(long)),
+                            CSC369_ChanCreate(0, sizeof(long)) };
+  ck_assert(chans[0] != NULL && chans[1] != NULL);
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_chan_select_forever, chans);
+  ck_assert_int_gt(tid, 0);
+  yield_till_main_thread();
+
+  // Killing the selecting thread takes it off both channels at once
+  ck_assert_int_eq(CSC369_ChanDestroy(chans[0]), CSC369_ERROR_OTHER);
+  ck_assert_int_eq(CSC369_ThreadKill(tid), tid);
+  ck_assert_int_eq(CSC369_ChanDestroy(chans[0]), 0);
+  ck_assert_int_eq(CSC369_ChanDestroy(chans[1]), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing executors
+//****************************************************************************
+START_TEST(test_executor_submit)
+{
+  ck_assert(CSC369_ExecutorCreate(0) == NULL);
+  CSC369_Executor* executor = CSC369_ExecutorCreate(4);
+  ck_assert(executor != NULL);
+
+  CSC369_Future* futures[EXECUTOR_TASKS];
+  for (long i = 0; i < EXECUTOR_TASKS; i++) {
+    futures[i] = CSC369_ExecutorSubmit(executor, (void* (*)(void*))f_square, (void*)i);
+    ck_assert(futures[i] != NULL);
+  }
+  // The executor cannot go away while its futures are outstanding
+  ck_assert_int_eq(CSC369_ExecutorDestroy(executor), CSC369_ERROR_OTHER);
+  for (long i = 0; i < EXECUTOR_TASKS; i++) {
+    void* result;
+    ck_assert_int_eq(CSC369_FutureWait(futures[i], &result), 0);
+    ck_assert_int_eq((long)result, i * i);
+  }
+
+  // Futures are reused once waited on
+  for (long i = 0; i < EXECUTOR_TASKS; i++) {
+    void* result;
+    CSC369_Future* future =
+      CSC369_ExecutorSubmit(executor, (void* (*)(void*))f_square, (void*)i);
+    ck_assert(future != NULL);
+    ck_assert_int_eq(CSC369_FutureWait(future, &result), 0);
+    ck_assert_int_eq((long)result, i * i);
+  }
+  ck_assert_int_eq(CSC369_ExecutorDestroy(executor), 0);
+  // Its threads are gone
+  ck_assert_int_eq(yield_till_main_thread(), 1);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_executor_kept_exit_codes)
+{
+  CSC369_Executor* executor = CSC369_ExecutorCreate(4);
+  ck_assert(executor != NULL);
+  void* result;
+  CSC369_Future* future =
+    CSC369_ExecutorSubmit(executor, (void* (*)(void*))f_square, (void*)3L);
+  ck_assert(future != NULL);
+  ck_assert_int_eq(CSC369_FutureWait(future, &result), 0);
+  ck_assert_int_eq((long)result, 9);
+  ck_assert_int_eq(CSC369_ExecutorDestroy(executor), 0);
+
+  // Its threads do not keep their exit codes, so their identifiers are reused
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_yield_explicit_exit, (void*)EXIT_CODE_1);
+  ck_assert_int_gt(tid, 0);
+  ck_assert_int_le(tid, 4);
+  int exit_code;
+  ck_assert_int_eq(CSC369_ThreadJoin(tid, &exit_code), tid);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing fork-join tasks
+//****************************************************************************
+START_TEST(test_task_spawn_sync)
+{
+  ck_assert(CSC369_TaskPoolCreate(-1) == NULL);
+  CSC369_TaskPool* pool = CSC369_TaskPoolCreate(TASK_POOL_THREADS);
+  ck_assert(pool != NULL);
+
+  FibTask task = { pool, FIB_N, 0 };
+  f_fib(&task);
+  ck_assert_int_eq(task.result, FIB_RESULT);
+  ck_assert_int_eq(CSC369_TaskPoolDestroy(pool), 0);
+  // Its threads are gone
+  ck_assert_int_eq(yield_till_main_thread(), 1);
+
+  // Without threads, the waiting thread runs every task
+  pool = CSC369_TaskPoolCreate(0);
+  ck_assert(pool != NULL);
+  task.pool = pool;
+  task.result = 0;
+  f_fib(&task);
+  ck_assert_int_eq(task.result, FIB_RESULT);
+  ck_assert_int_eq(CSC369_TaskPoolDestroy(pool), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_task_parallel_for)
+{
+  CSC369_TaskPool* pool = CSC369_TaskPoolCreate(TASK_POOL_THREADS);
+  ck_assert(pool != NULL);
+  long sum = 0;
+  ck_assert_int_eq(
+    CSC369_ParallelFor(pool, 0, PARALLEL_FOR_END, 0, (void (*)(long, long, void*))f_add_range, &sum),
+    CSC369_ERROR_OTHER);
+  ck_assert_int_eq(
+    CSC369_ParallelFor(pool, 0, PARALLEL_FOR_END, 16, (void (*)(long, long, void*))f_add_range, &sum),
+    0);
+  ck_assert_int_eq(sum, (long)PARALLEL_FOR_END * (PARALLEL_FOR_END - 1) / 2);
+  ck_assert_int_eq(CSC369_TaskPoolDestroy(pool), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing statistics
+//****************************************************************************
+START_TEST(test_thread_stats)
+{
+  CSC369_ThreadStats stats;
+  ck_assert_int_eq(CSC369_ThreadGetStats(-1, &stats), CSC369_ERROR_TID_INVALID);
+  ck_assert_int_eq(CSC369_ThreadGetStats(5, &stats), CSC369_ERROR_SYS_THREAD);
+
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_sleep, queue);
+  ck_assert_int_gt(tid, 0);
+  // Until the thread has gone to sleep
+  do {
+    CSC369_ThreadYield();
+    ck_assert_int_eq(CSC369_ThreadGetStats(tid, &stats), 0);
+  } while (stats.voluntary_switches == 0);
+  ck_assert_int_eq(stats.voluntary_switches, 1);
+  ck_assert_int_eq(stats.wakeups, 0);
+
+  CSC369_ThreadSpin(SLEEP_DURATION);
+  ck_assert_int_eq(CSC369_ThreadGetStats(tid, &stats), 0);
+  ck_assert_int_ge(stats.blocked_nsec, SLEEP_DURATION * 1000L);
+  ck_assert_int_eq(CSC369_ThreadWakeAll(queue), 1);
+  ck_assert_int_eq(CSC369_ThreadGetStats(tid, &stats), 0);
+  ck_assert_int_eq(stats.wakeups, 1);
+
+  // We have been running (or preempted) all along
+  ck_assert_int_eq(CSC369_ThreadGetStats(0, &stats), 0);
+  ck_assert_int_ge(stats.run_nsec, SLEEP_DURATION * 1000L);
+  ck_assert_int_ge(stats.voluntary_switches, 1);
+
+  char* dump = NULL;
+  size_t dump_size = 0;
+  FILE* file = open_memstream(&dump, &dump_size);
+  CSC369_ThreadDumpStats(file);
+  fclose(file);
+  ck_assert(strstr(dump, "run_us") != NULL);
+  ck_assert(strstr(dump, "blocked") != NULL);
+  free(dump);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_trace_dump)
+{
+  ck_assert_int_eq(CSC369_TraceEnable(1), 0);
+  Tid const sleeper = CSC369_ThreadCreate((void (*)(void*))f_sleep_for, (void*)SLEEP_DURATION);
+  ck_assert_int_gt(sleeper, 0);
+  Tid const victim = CSC369_ThreadCreate((void (*)(void*))f_sleep_for, (void*)(10 * SLEEP_DURATION));
+  ck_assert_int_gt(victim, 0);
+  CSC369_ThreadYield();
+  ck_assert_int_eq(CSC369_ThreadKill(victim), victim);
+  // Long enough to be preempted
+  CSC369_ThreadSpin(SLEEP_DURATION);
+  int exit_code;
+  ck_assert_int_eq(CSC369_ThreadJoin(sleeper, &exit_code), sleeper);
+  ck_assert_int_eq(CSC369_TraceEnable(0), 1);
+
+  ck_assert_int_eq(CSC369_TraceDump("/nonexistent/trace.json"), CSC369_ERROR_OTHER);
+  char path[] = "/tmp/csc369_trace_XXXXXX";
+  int const fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+  ck_assert_int_gt(CSC369_TraceDump(path), 0);
+
+  FILE* file = fopen(path, "r");
+  static char json[1 << 20];
+  size_t const len = fread(json, 1, sizeof(json) - 1, file);
+  json[len] = '\0';
+  fclose(file);
+  unlink(path);
+  ck_assert(strstr(json, "\"traceEvents\"") != NULL);
+  ck_assert(strstr(json, "\"name\":\"thread 0\"") != NULL);
+  char const* const names[] = { "create", "sleep", "wake", "kill", "exit", "preempt" };
+  for (int i = 0; i < 6; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "\"name\":\"%s\"", names[i]);
+    ck_assert_msg(strstr(json, name) != NULL, "missing %s", names[i]);
+  }
+  // Every time is within the few seconds the test ran, counting from 0
+  char const* const keys[] = { "\"ts\":", "\"dur\":" };
+  for (int i = 0; i < 2; i++) {
+    for (char const* p = strstr(json, keys[i]); p != NULL; p = strstr(p + 1, keys[i])) {
+      double const usec = strtod(p + strlen(keys[i]), NULL);
+      ck_assert_msg(usec >= 0 && usec < 1e8, "bad time %f", usec);
+    }
+  }
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+//****************************************************************************
+// Testing I/O
+//****************************************************************************
+START_TEST(test_io_read_blocks_only_caller)
+{
+  int fds[2];
+  ck_assert_int_eq(pipe(fds), 0);
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_read_pipe, (void*)(long)fds[0]);
+  ck_assert_int_gt(tid, 0);
+
+  // The reader sleeps on the empty pipe, and we keep running
+  ck_assert_int_eq(CSC369_ThreadSleepFor(SLEEP_DURATION), 0);
+  ck_assert_int_eq(shared_integer, 0);
+
+  ck_assert_int_eq(CSC369_Write(fds[1], "hello", 5), 5);
+  int exit_code;
+  // On another worker, the reader may have exited already
+  int const ret = CSC369_ThreadJoin(tid, &exit_code);
+  ck_assert(ret == tid || ret == CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(shared_integer, 1);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_io_read_only_thread)
+{
+  // No other thread can run, so only the file descriptor can wake us
+  int fds[2];
+  ck_assert_int_eq(pipe(fds), 0);
+  // The writer must not receive the interrupt signal, so it starts blocked
+  sigset_t mask, omask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGALRM);
+  pthread_sigmask(SIG_BLOCK, &mask, &omask);
+  pthread_t writer;
+  ck_assert_int_eq(pthread_create(&writer, NULL, pthread_write_pipe, &fds[1]), 0);
+  pthread_sigmask(SIG_SETMASK, &omask, NULL);
+  f_read_pipe(fds[0]);
+  pthread_join(writer, NULL);
+
+  close(fds[1]);
+  char buf[1];
+  ck_assert_int_eq(CSC369_Read(fds[0], buf, sizeof(buf)), 0);
+  ck_assert_int_eq(CSC369_Read(-1, buf, sizeof(buf)), -1);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_io_accept)
+{
+  int const listener = socket(AF_INET, SOCK_STREAM, 0);
+  ck_assert_int_ge(listener, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  ck_assert_int_eq(bind(listener, (struct sockaddr*)&addr, len), 0);
+  ck_assert_int_eq(getsockname(listener, (struct sockaddr*)&addr, &len), 0);
+  ck_assert_int_eq(listen(listener, 1), 0);
+
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_accept_echo, (void*)(long)listener);
+  ck_assert_int_gt(tid, 0);
+  ck_assert_int_eq(CSC369_ThreadSleepFor(SLEEP_DURATION), 0);
+
+  int const fd = socket(AF_INET, SOCK_STREAM, 0);
+  ck_assert_int_eq(CSC369_Connect(fd, (struct sockaddr*)&addr, len), 0);
+  ck_assert_int_eq(CSC369_Write(fd, "hello", 5), 5);
+  char buf[16] = { 0 };
+  ck_assert_int_eq(CSC369_Read(fd, buf, sizeof(buf)), 5);
+  ck_assert_str_eq(buf, "hello");
+  int exit_code;
+  CSC369_ThreadJoin(tid, &exit_code);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_io_errno_preempted)
+{
+  Tid tids[WORKER_THREAD_COUNT];
+  for (int i = 0; i < WORKER_THREAD_COUNT; i++) {
+    tids[i] = CSC369_ThreadCreate((void (*)(void*))f_keep_errno, (void*)(long)(i + 1));
+    ck_assert_int_gt(tids[i], 0);
+  }
+
+  int exit_codes[WORKER_THREAD_COUNT];
+  ck_assert_int_eq(CSC369_ThreadJoinAll(tids, WORKER_THREAD_COUNT, exit_codes), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
+START_TEST(test_io_kill_reader)
+{
+  int fds[2];
+  ck_assert_int_eq(pipe(fds), 0);
+  Tid const tid = CSC369_ThreadCreate((void (*)(void*))f_read_pipe, (void*)(long)fds[0]);
+  ck_assert_int_gt(tid, 0);
+  yield_till_main_thread();
+
+  // Nothing is left that could wake us
+  ck_assert_int_eq(CSC369_ThreadKill(tid), tid);
+  CSC369_WaitQueue* queue = CSC369_WaitQueueCreate();
+  ck_assert_int_eq(CSC369_ThreadSleep(queue), CSC369_ERROR_SYS_THREAD);
+  ck_assert_int_eq(CSC369_WaitQueueDestroy(queue), 0);
+
+  _exit(CSC369_TESTS_EXIT_SUCCESS);
+}
+END_TEST
+
 //****************************************************************************
 // libcheck boilerplate
 //****************************************************************************
@@ -301,6 +2124,14 @@ main(void)
   tcase_add_exit_test(sleep_case, test_wakenext_f_sleep, CSC369_TESTS_EXIT_SUCCESS);
   tcase_add_exit_test(sleep_case, test_wakeall_f_sleep, CSC369_TESTS_EXIT_SUCCESS);
   tcase_add_exit_test(sleep_case, test_wakeall_f_sleep_max, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sleep_case, test_waken_f_sleep, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sleep_case, test_wake_and_yield, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sleep_case, test_wake_and_yield_round_trip, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sleep_case, test_sleep_for_only_thread, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sleep_case, test_sleep_for_runs_others, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sleep_case, test_sleep_for_f_sleep_for, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sleep_case, test_sleep_timeout, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sleep_case, test_kill_sleep_for, CSC369_TESTS_EXIT_SUCCESS);
 
   TCase* join_case = tcase_create("Join Test Case");
   tcase_add_checked_fixture(join_case, set_up_with_interrupts, NULL);
@@ -310,10 +2141,126 @@ main(void)
   tcase_add_exit_test(join_case, test_join_main_exits, CSC369_TESTS_EXIT_SUCCESS);
   tcase_add_exit_test(join_case, test_join_main_exits_many, CSC369_TESTS_EXIT_SUCCESS);
   tcase_add_exit_test(join_case, test_join_main_is_killed, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(join_case, test_join_any_all, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(join_case, test_join_any_all_killed, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* kept_join_case = tcase_create("Kept Exit Code Join Test Case");
+  tcase_add_checked_fixture(kept_join_case, set_up_with_kept_exit_codes, NULL);
+  tcase_add_exit_test(kept_join_case, test_join_kept_exit_code, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(kept_join_case, test_executor_kept_exit_codes, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* config_case = tcase_create("Config Test Case");
+  tcase_add_exit_test(config_case, test_create_large_max, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(config_case, test_create_small_max, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* quantum_case = tcase_create("Quantum Test Case");
+  tcase_add_checked_fixture(quantum_case, set_up_with_interrupts, NULL);
+  tcase_add_exit_test(quantum_case, test_quantum_errors, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(quantum_case, test_quantum_long_slice, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(quantum_case, test_quantum_only_thread, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(quantum_case, test_quantum_deferred_preemption, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* chan_case = tcase_create("Channel Test Case");
+  tcase_add_checked_fixture(chan_case, set_up_with_interrupts, NULL);
+  tcase_add_exit_test(chan_case, test_chan_try, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(chan_case, test_chan_no_sender, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(chan_case, test_chan_unbounded, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(chan_case, test_chan_pipeline, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(chan_case, test_chan_select, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(chan_case, test_chan_select_kill, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* executor_case = tcase_create("Executor Test Case");
+  tcase_add_checked_fixture(executor_case, set_up_with_interrupts, NULL);
+  tcase_add_exit_test(executor_case, test_executor_submit, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* task_case = tcase_create("Task Test Case");
+  tcase_add_checked_fixture(task_case, set_up_with_interrupts, NULL);
+  tcase_add_exit_test(task_case, test_task_spawn_sync, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(task_case, test_task_parallel_for, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* stats_case = tcase_create("Stats Test Case");
+  tcase_add_checked_fixture(stats_case, set_up_with_interrupts, NULL);
+  tcase_add_exit_test(stats_case, test_thread_stats, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(stats_case, test_trace_dump, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* io_case = tcase_create("I/O Test Case");
+  tcase_add_checked_fixture(io_case, set_up_with_interrupts, NULL);
+  tcase_add_exit_test(io_case, test_io_read_blocks_only_caller, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(io_case, test_io_read_only_thread, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(io_case, test_io_accept, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(io_case, test_io_kill_reader, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(io_case, test_io_errno_preempted, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* sync_case = tcase_create("Sync Test Case");
+  tcase_add_checked_fixture(sync_case, set_up_with_interrupts, NULL);
+  tcase_add_exit_test(sync_case, test_mutex_errors, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_mutex_contended, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_cond_broadcast, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_sema_post, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_rwlock_errors, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_rwlock_contended, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_rwlock_batch_readers, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_barrier_errors, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_barrier_phases, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_latch_count_down, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_futex_wait_wake, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_case, test_futex_lock_contended, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* sync_workers_case = tcase_create("Sync Workers Test Case");
+  tcase_add_checked_fixture(sync_workers_case, set_up_with_workers, NULL);
+  tcase_add_exit_test(sync_workers_case, test_mutex_contended, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_workers_case, test_rwlock_contended, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_workers_case, test_barrier_phases, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(sync_workers_case, test_futex_lock_contended, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* workers_case = tcase_create("Workers Test Case");
+  tcase_add_checked_fixture(workers_case, set_up_with_workers, NULL);
+  tcase_add_exit_test(workers_case, test_workers_run_threads, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_workers_sleep_no_work, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_workers_wakeall_f_sleep, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_sleep_for_only_thread, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_sleep_for_f_sleep_for, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_sleep_timeout, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_io_read_blocks_only_caller, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_io_read_only_thread, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_io_accept, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_io_errno_preempted, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_chan_pipeline, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_chan_select, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_wake_and_yield_round_trip, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_executor_submit, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_task_spawn_sync, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_task_parallel_for, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_join_any_all, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(workers_case, test_join_any_all_killed, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* policy_case = tcase_create("Policy Test Case");
+  tcase_add_checked_fixture(policy_case, set_up_with_mlfq, NULL);
+  tcase_add_exit_test(policy_case, test_mlfq_new_thread_before_hog, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(policy_case, test_mlfq_wakeall_f_sleep, CSC369_TESTS_EXIT_SUCCESS);
+
+  TCase* fair_case = tcase_create("Fair Policy Test Case");
+  tcase_add_checked_fixture(fair_case, set_up_with_fair, NULL);
+  tcase_add_exit_test(fair_case, test_fair_weights, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(fair_case, test_fair_set_weight_errors, CSC369_TESTS_EXIT_SUCCESS);
+  tcase_add_exit_test(fair_case, test_fair_wakeall_f_sleep, CSC369_TESTS_EXIT_SUCCESS);
 
   Suite* suite = suite_create("Student Test Suite");
   suite_add_tcase(suite, sleep_case);
   suite_add_tcase(suite, join_case);
+  suite_add_tcase(suite, kept_join_case);
+  suite_add_tcase(suite, config_case);
+  suite_add_tcase(suite, quantum_case);
+  suite_add_tcase(suite, sync_case);
+  suite_add_tcase(suite, io_case);
+  suite_add_tcase(suite, chan_case);
+  suite_add_tcase(suite, executor_case);
+  suite_add_tcase(suite, task_case);
+  suite_add_tcase(suite, stats_case);
+  suite_add_tcase(suite, workers_case);
+  suite_add_tcase(suite, policy_case);
+  suite_add_tcase(suite, fair_case);
+  suite_add_tcase(suite, sync_workers_case);
 
   SRunner* suite_runner = srunner_create(suite);
   srunner_run_all(suite_runner, CK_VERBOSE);